@@ -50,6 +50,7 @@
 #include "sl_simple_timer.h"
 #include "app_button_press.h"
 #include"sl_pwm_instances.h"
+#include "mesh_uuid.h"
 
 
 /// timeout for registering new devices after startup
@@ -58,6 +59,8 @@
 #define DEVICE_REGISTER_LONG_TIMEOUT   10000
 /// Length of the display name buffer
 #define NAME_BUF_LEN                   20
+/// Firmware revision written in the device UUID
+#define UUID_FW_REVISION               1
 /// Timout for Blinking LED during provisioning
 #define APP_LED_BLINKING_TIMEOUT       250
 /// Callback has not parameters
@@ -331,10 +334,9 @@ static void device_init_change_uuid() {
   sl_status_t retval;
   retval = sl_btmesh_node_get_uuid(&temp);
   app_assert_status_f(retval, "Getting UUID failed:\n");
-  temp.data[0] = 0x02;
-  temp.data[1] = 0xFF;
-  temp.data[2] = 0x00;
-  temp.data[3] = 0x01;
+  mesh_uuid_write(&temp, MESH_UUID_CLASS_LIGHT,
+                  MESH_UUID_CAP_RELAY | MESH_UUID_CAP_PROXY,
+                  UUID_FW_REVISION);
   retval = sl_btmesh_node_set_uuid(temp);
   app_assert_status_f(retval, "Setting UUID failed\n");
 }
@@ -67,6 +67,7 @@
 
 
 #include "custom.h"
+#include "mesh_uuid.h"
 
 /*******************************************************************************
  * DEFINE
@@ -76,6 +77,9 @@
 
 #define BOOT_ERR_MSG_BUF_LEN 30
 
+// Firmware revision written in the device UUID
+#define UUID_FW_REVISION 1
+
 #define BUTTON_PRESS_BUTTON_0 0
 
 #define MAX_PERCENT         100
@@ -260,10 +264,10 @@ static void device_init_change_uuid() {
   sl_status_t retval;
   retval = sl_btmesh_node_get_uuid(&temp);
   app_assert_status_f(retval, "Getting UUID failed:\n");
-  temp.data[0] = 0x02;
-  temp.data[1] = 0xFF;
-  temp.data[2] = 0x00;
-  temp.data[3] = 0x01;
+  mesh_uuid_write(&temp, MESH_UUID_CLASS_SWITCH,
+                  MESH_UUID_CAP_RELAY | MESH_UUID_CAP_PROXY |
+                      MESH_UUID_CAP_LOW_POWER,
+                  UUID_FW_REVISION);
 
   retval = sl_btmesh_node_set_uuid(temp);
   app_assert_status_f(retval, "Setting UUID failed\n");
@@ -0,0 +1,80 @@
+#ifndef __MESH_UUID__
+#define __MESH_UUID__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sl_btmesh_api.h"
+
+/*
+ * Device UUID schema shared by every project of the group. Only the first
+ * MESH_UUID_PREFIX_LEN bytes are written, the others are left as set by the
+ * stack so that the UUID stays unique:
+ *
+ *   [0..1] family code, big endian
+ *   [2]    firmware revision
+ *   [3]    device class (low nibble) | capability bits (high nibble)
+ *
+ * Firmware written before this schema has 00 in byte 2 and 01 (node) or
+ * 02 (gateway) in byte 3, which reads as revision 0 without capabilities.
+ */
+#define MESH_UUID_PREFIX_LEN 4
+
+#define MESH_UUID_FAMILY 0x02FF
+
+// Device classes, MESH_UUID_CLASS_NODE is the one of the older node firmware
+// that did not tell which node it is
+#define MESH_UUID_CLASS_MASK 0x0F
+#define MESH_UUID_CLASS_COUNT 16
+#define MESH_UUID_CLASS_NODE 0x01
+#define MESH_UUID_CLASS_GATEWAY 0x02
+#define MESH_UUID_CLASS_LIGHT 0x03
+#define MESH_UUID_CLASS_SWITCH 0x04
+#define MESH_UUID_CLASS_SENSOR_SERVER 0x05
+#define MESH_UUID_CLASS_SENSOR_CLIENT 0x06
+
+// Capability bits, the mesh features built in the firmware
+#define MESH_UUID_CAP_MASK 0xF0
+#define MESH_UUID_CAP_RELAY 0x10
+#define MESH_UUID_CAP_PROXY 0x20
+#define MESH_UUID_CAP_FRIEND 0x40
+#define MESH_UUID_CAP_LOW_POWER 0x80
+
+/**
+ * @brief Write the schema into a UUID got from sl_btmesh_node_get_uuid
+ *
+ * @param uuid The UUID to update
+ * @param device_class One of MESH_UUID_CLASS_*
+ * @param caps MESH_UUID_CAP_* bits
+ * @param revision Firmware revision of the project
+ */
+static inline void mesh_uuid_write(uuid_128 *uuid, uint8_t device_class,
+                                   uint8_t caps, uint8_t revision) {
+  uuid->data[0] = (uint8_t)(MESH_UUID_FAMILY >> 8);
+  uuid->data[1] = (uint8_t)MESH_UUID_FAMILY;
+  uuid->data[2] = revision;
+  uuid->data[3] = (uint8_t)((caps & MESH_UUID_CAP_MASK) |
+                            (device_class & MESH_UUID_CLASS_MASK));
+}
+
+/**
+ * @brief Check if a UUID follows this schema
+ *
+ */
+static inline bool mesh_uuid_is_family(const uuid_128 *uuid) {
+  return ((uuid->data[0] << 8) | uuid->data[1]) == MESH_UUID_FAMILY;
+}
+
+static inline uint8_t mesh_uuid_get_class(const uuid_128 *uuid) {
+  return uuid->data[3] & MESH_UUID_CLASS_MASK;
+}
+
+static inline uint8_t mesh_uuid_get_caps(const uuid_128 *uuid) {
+  return uuid->data[3] & MESH_UUID_CAP_MASK;
+}
+
+static inline uint8_t mesh_uuid_get_revision(const uuid_128 *uuid) {
+  return uuid->data[2];
+}
+
+#endif  // __MESH_UUID__
@@ -0,0 +1,178 @@
+#include "AddressAllocator.h"
+
+#include <string.h>
+
+#include "app_log.h"
+
+#if ADDRESS_ALLOCATOR_SIZE % 32 != 0
+#error "ADDRESS_ALLOCATOR_SIZE must be a multiple of 32"
+#endif
+
+#define ADDRESS_ALLOCATOR_WORDS (ADDRESS_ALLOCATOR_SIZE / 32)
+
+typedef struct address_allocator {
+  // Bit set for each address in use, bit 0 of word 0 is ADDRESS_ALLOCATOR_FIRST
+  uint32_t used[ADDRESS_ALLOCATOR_WORDS];
+  // Bit set for the primary element address of each range, so that a range
+  // can be released from its address only
+  uint32_t head[ADDRESS_ALLOCATOR_WORDS];
+  // Bit set for each free address released under the current IV index
+  uint32_t quarantine[ADDRESS_ALLOCATOR_WORDS];
+  uint16_t num_used;
+  uint16_t num_quarantined;
+  uint32_t iv_index;
+  bool iv_index_known;
+} address_allocator_t;
+
+static address_allocator_t allocator_instance;
+
+void address_allocator_init(void) {
+  memset(&allocator_instance, 0, sizeof(allocator_instance));
+}
+
+static bool __test(const uint32_t *bitmap, uint16_t bit) {
+  return (bitmap[bit / 32] & (1UL << (bit % 32))) != 0;
+}
+
+/*
+ * Mark the addresses of a range as used, the part outside the managed space
+ * is ignored
+ * */
+static void __mark(uint16_t address, uint8_t elements) {
+  uint16_t bit;
+
+  for (uint8_t i = 0; i < elements; i++) {
+    if (address + i < ADDRESS_ALLOCATOR_FIRST) {
+      continue;
+    }
+    bit = address + i - ADDRESS_ALLOCATOR_FIRST;
+    if (bit >= ADDRESS_ALLOCATOR_SIZE) {
+      return;
+    }
+    if (i == 0) {
+      allocator_instance.head[bit / 32] |= 1UL << (bit % 32);
+    }
+    if (!__test(allocator_instance.used, bit)) {
+      allocator_instance.used[bit / 32] |= 1UL << (bit % 32);
+      allocator_instance.num_used++;
+    }
+    if (__test(allocator_instance.quarantine, bit)) {
+      allocator_instance.quarantine[bit / 32] &= ~(1UL << (bit % 32));
+      allocator_instance.num_quarantined--;
+    }
+  }
+}
+
+/*
+ * Find the lowest run of free addresses, the quarantined ones are left out
+ * unless with_quarantine is set.
+ * Return the first address of the run, ADDRESS_ALLOCATOR_NONE if none fits.
+ * */
+static uint16_t __find_run(uint8_t elements, bool with_quarantine) {
+  uint32_t taken[ADDRESS_ALLOCATOR_WORDS];
+  uint64_t run;
+  uint32_t next;
+
+  for (uint8_t w = 0; w < ADDRESS_ALLOCATOR_WORDS; w++) {
+    taken[w] = allocator_instance.used[w];
+    if (!with_quarantine) {
+      taken[w] |= allocator_instance.quarantine[w];
+    }
+  }
+
+  for (uint8_t w = 0; w < ADDRESS_ALLOCATOR_WORDS; w++) {
+    if (taken[w] == 0xFFFFFFFF) {
+      continue;
+    }
+
+    // Free addresses of this word and of the next one, so that a range can
+    // cross the word boundary. After the shifts, bit i is still set only if
+    // the addresses i to i + elements - 1 are all free.
+    next = (w + 1 < ADDRESS_ALLOCATOR_WORDS) ? ~taken[w + 1] : 0;
+    run = ((uint64_t)next << 32) | (uint32_t)~taken[w];
+    for (uint8_t i = 1; i < elements && run != 0; i++) {
+      run &= run >> 1;
+    }
+    run &= 0xFFFFFFFF;
+    if (run != 0) {
+      return ADDRESS_ALLOCATOR_FIRST + w * 32 + __builtin_ctz((uint32_t)run);
+    }
+  }
+  return ADDRESS_ALLOCATOR_NONE;
+}
+
+uint16_t address_allocator_alloc(uint8_t elements) {
+  uint16_t address;
+
+  if (elements == 0 || elements > ADDRESS_ALLOCATOR_MAX_ELEMENTS) {
+    return ADDRESS_ALLOCATOR_NONE;
+  }
+
+  address = __find_run(elements, false);
+  if (address == ADDRESS_ALLOCATOR_NONE) {
+    address = __find_run(elements, true);
+    if (address == ADDRESS_ALLOCATOR_NONE) {
+      app_log("No range of %d free addresses left\n", elements);
+      return ADDRESS_ALLOCATOR_NONE;
+    }
+    // The nodes may drop its first messages until their sequence numbers
+    // pass the ones of the removed node
+    app_log("Reusing released address %4.4x before an IV index update\n",
+            address);
+  }
+
+  __mark(address, elements);
+  return address;
+}
+
+void address_allocator_reserve(uint16_t address, uint8_t elements) {
+  __mark(address, elements);
+}
+
+void address_allocator_release(uint16_t address) {
+  uint16_t bit;
+
+  if (address < ADDRESS_ALLOCATOR_FIRST ||
+      address - ADDRESS_ALLOCATOR_FIRST >= ADDRESS_ALLOCATOR_SIZE) {
+    return;
+  }
+
+  bit = address - ADDRESS_ALLOCATOR_FIRST;
+  if (!__test(allocator_instance.head, bit)) {
+    return;
+  }
+  allocator_instance.head[bit / 32] &= ~(1UL << (bit % 32));
+
+  // The range ends at the next free address or at the next range
+  do {
+    allocator_instance.used[bit / 32] &= ~(1UL << (bit % 32));
+    allocator_instance.num_used--;
+    allocator_instance.quarantine[bit / 32] |= 1UL << (bit % 32);
+    allocator_instance.num_quarantined++;
+    bit++;
+  } while (bit < ADDRESS_ALLOCATOR_SIZE &&
+           __test(allocator_instance.used, bit) &&
+           !__test(allocator_instance.head, bit));
+}
+
+void address_allocator_on_iv_index(uint32_t iv_index) {
+  if (allocator_instance.iv_index_known &&
+      allocator_instance.iv_index != iv_index &&
+      allocator_instance.num_quarantined > 0) {
+    app_log("IV index %lu, %u released addresses free again\n", iv_index,
+            allocator_instance.num_quarantined);
+    memset(allocator_instance.quarantine, 0,
+           sizeof(allocator_instance.quarantine));
+    allocator_instance.num_quarantined = 0;
+  }
+  allocator_instance.iv_index = iv_index;
+  allocator_instance.iv_index_known = true;
+}
+
+uint16_t address_allocator_get_used(void) {
+  return allocator_instance.num_used;
+}
+
+uint16_t address_allocator_get_quarantined(void) {
+  return allocator_instance.num_quarantined;
+}
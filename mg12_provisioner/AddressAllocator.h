@@ -0,0 +1,81 @@
+#ifndef __ADDRESS_ALLOCATOR__
+#define __ADDRESS_ALLOCATOR__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// First unicast address handed out to the nodes, the ones below are left to
+// the provisioner
+#ifndef ADDRESS_ALLOCATOR_FIRST
+#define ADDRESS_ALLOCATOR_FIRST 0x0002
+#endif
+
+// Number of addresses managed from ADDRESS_ALLOCATOR_FIRST, a multiple of 32.
+// The nodes are packed from the bottom so that (address - FIRST) can be used
+// as an index by the gateway.
+#ifndef ADDRESS_ALLOCATOR_SIZE
+#define ADDRESS_ALLOCATOR_SIZE 256
+#endif
+
+// Largest range handed out at once
+#define ADDRESS_ALLOCATOR_MAX_ELEMENTS 32
+
+// Returned when no range is free
+#define ADDRESS_ALLOCATOR_NONE 0x0000
+
+/**
+ * @brief Init the allocator, every address is free
+ *
+ */
+void address_allocator_init(void);
+
+/**
+ * @brief Hand out the lowest free range of contiguous addresses
+ *
+ * @param elements Number of elements of the node
+ * @return uint16_t The primary element address, ADDRESS_ALLOCATOR_NONE if no
+ * range is large enough
+ */
+uint16_t address_allocator_alloc(uint8_t elements);
+
+/**
+ * @brief Mark a range as used, e.g. a node found in the device database
+ *
+ * @param address The primary element address
+ * @param elements Number of elements of the node
+ */
+void address_allocator_reserve(uint16_t address, uint8_t elements);
+
+/**
+ * @brief Give a range back once its node is removed. The nodes still hold
+ * the sequence numbers of the removed one in their replay protection list,
+ * so the range is quarantined: it is handed out only when no other range
+ * fits, until the IV index of the network moves. The quarantine is not kept
+ * across a reset.
+ *
+ * @param address The primary element address of the range
+ */
+void address_allocator_release(uint16_t address);
+
+/**
+ * @brief Follow the IV index the network transmits with. Once it moves, the
+ * replay protection lists start over and the quarantined ranges are free.
+ *
+ * @param iv_index The current IV index, the first call only records it
+ */
+void address_allocator_on_iv_index(uint32_t iv_index);
+
+/**
+ * @brief Get the number of addresses in use
+ *
+ */
+uint16_t address_allocator_get_used(void);
+
+/**
+ * @brief Get the number of released addresses waiting for the IV index to
+ * move
+ *
+ */
+uint16_t address_allocator_get_quarantined(void);
+
+#endif  // __ADDRESS_ALLOCATOR__
@@ -0,0 +1,105 @@
+#include "BeaconFilter.h"
+
+#include <string.h>
+
+#include "app_log.h"
+#include "sl_sleeptimer.h"
+
+/**
+ * @brief Bloom filter split in two time buckets: the UUIDs are added to the
+ * current one and looked up in both, the previous one is dropped when the
+ * bucket period ends
+ *
+ */
+typedef struct beacon_filter {
+  uint8_t buckets[2][(BEACON_FILTER_BITS + 7) / 8];
+  uint8_t current;
+  uint32_t bucket_start;
+  uint32_t bucket_ticks;
+
+  uint32_t received;
+  uint32_t suppressed;
+} beacon_filter_t;
+
+static beacon_filter_t filter_instance;
+
+void beacon_filter_init(void) {
+  memset(&filter_instance, 0, sizeof(filter_instance));
+  filter_instance.bucket_ticks =
+      sl_sleeptimer_ms_to_tick(BEACON_FILTER_BUCKET_MS);
+  filter_instance.bucket_start = sl_sleeptimer_get_tick_count();
+}
+
+static void __rotate(void) {
+  uint32_t now = sl_sleeptimer_get_tick_count();
+  uint32_t elapsed = now - filter_instance.bucket_start;
+
+  if (elapsed < filter_instance.bucket_ticks) {
+    return;
+  }
+
+  filter_instance.current ^= 1;
+  memset(filter_instance.buckets[filter_instance.current], 0,
+         sizeof(filter_instance.buckets[0]));
+  if (elapsed >= 2 * filter_instance.bucket_ticks) {
+    // No beacon for a while, the other bucket is stale as well
+    memset(filter_instance.buckets[filter_instance.current ^ 1], 0,
+           sizeof(filter_instance.buckets[0]));
+  }
+  filter_instance.bucket_start = now;
+}
+
+bool beacon_filter_seen(const uuid_128 *uuid) {
+  uint32_t h1 = 2166136261u;
+  uint32_t h2;
+  uint32_t bits[BEACON_FILTER_HASHES];
+  bool in_current = true;
+  bool in_previous = true;
+  uint8_t previous;
+
+  filter_instance.received++;
+  __rotate();
+  previous = filter_instance.current ^ 1;
+
+  // FNV-1a, the other indexes are derived by double hashing with a second
+  // hash mixed from the first one (murmur3 finalizer)
+  for (uint8_t i = 0; i < sizeof(uuid_128); i++) {
+    h1 ^= uuid->data[i];
+    h1 *= 16777619u;
+  }
+  h2 = h1;
+  h2 ^= h2 >> 16;
+  h2 *= 0x85ebca6bu;
+  h2 ^= h2 >> 13;
+  h2 *= 0xc2b2ae35u;
+  h2 ^= h2 >> 16;
+  h2 |= 1;
+
+  for (uint8_t i = 0; i < BEACON_FILTER_HASHES; i++) {
+    bits[i] = (h1 + i * h2) % BEACON_FILTER_BITS;
+    if (!(filter_instance.buckets[filter_instance.current][bits[i] >> 3] &
+          (1 << (bits[i] & 7)))) {
+      in_current = false;
+    }
+    if (!(filter_instance.buckets[previous][bits[i] >> 3] &
+          (1 << (bits[i] & 7)))) {
+      in_previous = false;
+    }
+  }
+
+  if (in_current || in_previous) {
+    filter_instance.suppressed++;
+    return true;
+  }
+
+  for (uint8_t i = 0; i < BEACON_FILTER_HASHES; i++) {
+    filter_instance.buckets[filter_instance.current][bits[i] >> 3] |=
+        1 << (bits[i] & 7);
+  }
+  return false;
+}
+
+void beacon_filter_print_stats(void) {
+  app_log("Beacons: %lu received, %lu dropped as repeats\n",
+          filter_instance.received, filter_instance.suppressed);
+}
@@ -0,0 +1,53 @@
+#ifndef __BEACON_FILTER__
+#define __BEACON_FILTER__
+
+#include <stdbool.h>
+
+#include "sl_btmesh_api.h"
+
+// Number of different UUIDs expected to beacon within one bucket period, the
+// filter is sized from it
+#ifndef BEACON_FILTER_EXPECTED_DEVICES
+#define BEACON_FILTER_EXPECTED_DEVICES 256
+#endif
+
+// Target false positive rate below 1% at BEACON_FILTER_EXPECTED_DEVICES: with
+// 12 bits per device and 6 bits set per UUID, a full bucket takes a new UUID
+// for a repeat with a probability of (1 - e^(-6/12))^6 = 0.37%, about 0.75%
+// looking in both buckets. Such a beacon is dropped until the buckets rotate.
+// 256 devices take 2 x 384 bytes.
+#define BEACON_FILTER_BITS_PER_DEVICE 12
+#define BEACON_FILTER_HASHES 6
+
+// Number of bits of each bucket of the filter
+#define BEACON_FILTER_BITS \
+  (BEACON_FILTER_EXPECTED_DEVICES * BEACON_FILTER_BITS_PER_DEVICE)
+
+// A UUID is let through again once it has not been let through for one to
+// two bucket periods, so that a device whose provisioning failed is picked
+// up again
+#define BEACON_FILTER_BUCKET_MS 2000
+
+/**
+ * @brief Init the filter, nothing is seen yet
+ *
+ */
+void beacon_filter_init(void);
+
+/**
+ * @brief Check if an unprovisioned beacon was already handled recently.
+ * If not, the UUID is added to the filter.
+ *
+ * @param uuid The UUID carried by the beacon
+ * @return true The beacon is a repeat and should be dropped
+ * @return false The beacon should be handled
+ */
+bool beacon_filter_seen(const uuid_128 *uuid);
+
+/**
+ * @brief Print the number of beacons received and dropped by the filter
+ *
+ */
+void beacon_filter_print_stats(void);
+
+#endif  // __BEACON_FILTER__
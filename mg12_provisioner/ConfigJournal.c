@@ -0,0 +1,148 @@
+#include "ConfigJournal.h"
+
+#include <string.h>
+
+#include "app_log.h"
+#include "nvm3_default.h"
+#include "sl_bt_api.h"
+#include "sl_sleeptimer.h"
+
+// Bump this when tsConfigJournalEntry changes so old NVM3 objects are dropped
+#define CONFIG_JOURNAL_FORMAT_VERSION 2
+
+typedef struct config_journal {
+  tsConfigJournalEntry entries[DEVICE_CONFIG_MAX_SESSIONS];
+  uint8_t dirty;
+  // Entries loaded at boot, their acks are from before the reset
+  uint8_t restored;
+  sl_sleeptimer_timer_handle_t flush_timer;
+  bool flush_pending;
+} config_journal_t;
+
+static config_journal_t journal_instance;
+
+static void flush_timer_on_timeout(sl_sleeptimer_timer_handle_t *handle,
+                                   void *data) {
+  (void)handle;
+  (void)data;
+
+  // Runs in interrupt context, NVM3 is written in the event loop
+  sl_bt_external_signal(CONFIG_JOURNAL_SIGNAL);
+}
+
+static void __write(uint8_t slot) {
+  tsConfigJournalEntry *entry = &journal_instance.entries[slot];
+
+  journal_instance.dirty &= ~(1 << slot);
+  if (entry->address == 0) {
+    nvm3_deleteObject(nvm3_defaultHandle, CONFIG_JOURNAL_NVM3_KEY_BASE + slot);
+  } else if (nvm3_writeData(nvm3_defaultHandle,
+                            CONFIG_JOURNAL_NVM3_KEY_BASE + slot, entry,
+                            sizeof(*entry)) != ECODE_NVM3_OK) {
+    app_log("Config journal: failed to save slot %d\n", slot);
+  }
+}
+
+static void __write_later(uint8_t slot) {
+  journal_instance.dirty |= 1 << slot;
+  if (journal_instance.flush_pending) {
+    return;
+  }
+  journal_instance.flush_pending = true;
+  sl_sleeptimer_start_timer_ms(
+      &journal_instance.flush_timer, CONFIG_JOURNAL_FLUSH_DELAY_MS,
+      flush_timer_on_timeout, NULL, 0,
+      SL_SLEEPTIMER_NO_HIGH_PRECISION_HF_CLOCKS_REQUIRED_FLAG);
+}
+
+void config_journal_init(void) {
+  tsConfigJournalEntry *entry;
+  Ecode_t ec;
+
+  memset(&journal_instance, 0, sizeof(journal_instance));
+
+  for (uint8_t i = 0; i < DEVICE_CONFIG_MAX_SESSIONS; i++) {
+    entry = &journal_instance.entries[i];
+    ec = nvm3_readData(nvm3_defaultHandle, CONFIG_JOURNAL_NVM3_KEY_BASE + i,
+                       entry, sizeof(*entry));
+    if (ec == ECODE_NVM3_OK &&
+        entry->format_version == CONFIG_JOURNAL_FORMAT_VERSION &&
+        entry->address != 0) {
+      app_log("Config journal: node %4.4x was being configured\n",
+              entry->address);
+      journal_instance.restored |= 1 << i;
+    } else {
+      memset(entry, 0, sizeof(*entry));
+    }
+  }
+}
+
+const tsConfigJournalEntry *config_journal_get(uint8_t slot) {
+  if (journal_instance.entries[slot].address == 0) {
+    return NULL;
+  }
+  return &journal_instance.entries[slot];
+}
+
+void config_journal_begin(uint8_t slot, uint16_t address, const uuid_128 *uuid,
+                          uint8_t device_type, uint16_t group_address) {
+  tsConfigJournalEntry *entry = &journal_instance.entries[slot];
+
+  memset(entry, 0, sizeof(*entry));
+  journal_instance.restored &= ~(1 << slot);
+  entry->format_version = CONFIG_JOURNAL_FORMAT_VERSION;
+  entry->device_type = device_type;
+  entry->address = address;
+  entry->uuid = *uuid;
+  entry->group_address = group_address;
+  __write(slot);
+}
+
+bool config_journal_set_plan(uint8_t slot, uint8_t num_cmds,
+                             uint32_t plan_check) {
+  tsConfigJournalEntry *entry = &journal_instance.entries[slot];
+  bool same_plan =
+      entry->num_cmds == num_cmds && entry->plan_check == plan_check;
+  bool restored = journal_instance.restored & (1 << slot);
+
+  journal_instance.restored &= ~(1 << slot);
+  if (same_plan) {
+    return true;
+  }
+
+  // The acks taken before a reset cannot be checked against the new steps.
+  // The ones of this run, taken before the plan was complete, are kept.
+  if (restored) {
+    memset(entry->acked, 0, sizeof(entry->acked));
+  }
+  entry->num_cmds = num_cmds;
+  entry->plan_check = plan_check;
+  __write_later(slot);
+  return false;
+}
+
+void config_journal_ack(uint8_t slot, uint8_t step) {
+  journal_instance.entries[slot].acked[step >> 3] |= 1 << (step & 7);
+  __write_later(slot);
+}
+
+bool config_journal_is_acked(uint8_t slot, uint8_t step) {
+  return journal_instance.entries[slot].acked[step >> 3] & (1 << (step & 7));
+}
+
+void config_journal_end(uint8_t slot) {
+  memset(&journal_instance.entries[slot], 0, sizeof(tsConfigJournalEntry));
+  __write(slot);
+}
+
+void config_journal_on_signal(uint32_t extsignals) {
+  if (!(extsignals & CONFIG_JOURNAL_SIGNAL)) {
+    return;
+  }
+  journal_instance.flush_pending = false;
+  for (uint8_t i = 0; i < DEVICE_CONFIG_MAX_SESSIONS; i++) {
+    if (journal_instance.dirty & (1 << i)) {
+      __write(i);
+    }
+  }
+}
@@ -0,0 +1,94 @@
+#ifndef __CONFIG_JOURNAL__
+#define __CONFIG_JOURNAL__
+
+#include <stdbool.h>
+
+#include "DeviceConfiguration.h"
+#include "sl_btmesh_api.h"
+
+// NVM3 keys: CONFIG_JOURNAL_NVM3_KEY_BASE + configuration session index
+#define CONFIG_JOURNAL_NVM3_KEY_BASE 0x0300
+
+// Acknowledged steps are written together this long after the first one.
+// A step acknowledged but not written yet is only sent again after a reset.
+#define CONFIG_JOURNAL_FLUSH_DELAY_MS 1000
+
+// External signal raised when the acks are due, see RETRY_ENGINE_SIGNAL
+#define CONFIG_JOURNAL_SIGNAL 0x08
+
+/**
+ * @brief Journal of the configuration of one node. A step is the index of a
+ * request in the plan, the plan itself is rebuilt from the DCD after a reset
+ * and checked against plan_check. An entry is free when its address is 0.
+ *
+ */
+typedef struct {
+  uint8_t format_version;
+  uint8_t device_type;
+  uint16_t address;
+  uuid_128 uuid;
+  uint16_t group_address;
+  // 0 until the whole DCD is planned
+  uint8_t num_cmds;
+  uint32_t plan_check;
+  uint8_t acked[(DEVICE_CONFIG_MAX_CMDS + 7) / 8];
+} tsConfigJournalEntry;
+
+/**
+ * @brief Load the journal left in NVM3
+ *
+ */
+void config_journal_init(void);
+
+/**
+ * @brief Get the journal of a configuration session
+ *
+ * @param slot Index of the configuration session
+ * @return const tsConfigJournalEntry* NULL if the slot has no journal
+ */
+const tsConfigJournalEntry *config_journal_get(uint8_t slot);
+
+/**
+ * @brief Start the journal of a node, written right away
+ *
+ */
+void config_journal_begin(uint8_t slot, uint16_t address, const uuid_128 *uuid,
+                          uint8_t device_type, uint16_t group_address);
+
+/**
+ * @brief Record the plan once the whole DCD is planned. The acks restored
+ * from NVM3 are dropped if they were taken for a different plan.
+ *
+ * @param num_cmds Number of steps of the plan
+ * @param plan_check Hash of the planned requests
+ * @return true if the recorded acks belong to this plan
+ */
+bool config_journal_set_plan(uint8_t slot, uint8_t num_cmds,
+                             uint32_t plan_check);
+
+/**
+ * @brief Record the ack of one step, the write is batched
+ *
+ */
+void config_journal_ack(uint8_t slot, uint8_t step);
+
+/**
+ * @brief Check if a step was acknowledged
+ *
+ */
+bool config_journal_is_acked(uint8_t slot, uint8_t step);
+
+/**
+ * @brief Drop the journal of a node once its configuration ended
+ *
+ */
+void config_journal_end(uint8_t slot);
+
+/**
+ * @brief Write the pending acks when CONFIG_JOURNAL_SIGNAL is raised
+ *
+ * @param extsignals Signals of the sl_bt_evt_system_external_signal event
+ */
+void config_journal_on_signal(uint32_t extsignals);
+
+#endif  // __CONFIG_JOURNAL__
@@ -0,0 +1,125 @@
+#include "ConfigPlan.h"
+
+#include <stddef.h>
+
+#include "DeviceConfiguration.h"
+#include "NetworkConfiguration.h"
+
+/*
+ * The plan of every device type, sorted by device type then model ID. The
+ * CONFIG_PLAN_ANY_MODEL entry closes the block of its device type.
+ *
+ * Only the models taking part in a control action get a group, the others
+ * (config, health, level, power on/off, setup servers...) are left alone so
+ * that they neither use subscription slots nor publish statuses nobody reads:
+ * - clients publish to the group they control, they do not listen to it
+ * - servers subscribe to the group their clients publish to
+ * - of the lighting servers, only the on/off server publishes its status, it
+ *   is the one decoded by the gateway. A change of the light then costs one
+ *   status per node instead of one per server model.
+ * - sensor servers publish to the group, sensor clients listen to it
+ * The gateway controls LIGHT_GROUP_2 and listens to both light groups.
+ *
+ * A model is never given more than CONFIG_PLAN_MAX_SUBS groups, below the 4
+ * subscriptions per model of the nodes.
+ * */
+static const tsConfigPlanEntry config_plan_table[] = {
+    {TARGET_DEVICE_TYPE_NODE,
+     LIGHT_MODEL_ID,
+     CONFIG_PLAN_BIND | CONFIG_PLAN_PUB | CONFIG_PLAN_SUB,
+     CONFIG_PLAN_TARGET_GROUP,
+     1,
+     {CONFIG_PLAN_TARGET_GROUP, 0}},
+    {TARGET_DEVICE_TYPE_NODE,
+     SWITCH_MODEL_ID,
+     CONFIG_PLAN_BIND | CONFIG_PLAN_PUB,
+     CONFIG_PLAN_TARGET_GROUP,
+     0,
+     {0, 0}},
+    {TARGET_DEVICE_TYPE_NODE,
+     SENSOR_SERVER_MODEL,
+     CONFIG_PLAN_BIND | CONFIG_PLAN_PUB,
+     CONFIG_PLAN_TARGET_GROUP,
+     0,
+     {0, 0}},
+    {TARGET_DEVICE_TYPE_NODE,
+     SENSOR_CLIENT_MODEL,
+     CONFIG_PLAN_BIND | CONFIG_PLAN_SUB,
+     0,
+     1,
+     {CONFIG_PLAN_TARGET_GROUP, 0}},
+    {TARGET_DEVICE_TYPE_NODE,
+     LIGHTNESS_SEVER_MODEL,
+     CONFIG_PLAN_BIND | CONFIG_PLAN_SUB | CONFIG_PLAN_HEARTBEAT,
+     0,
+     1,
+     {CONFIG_PLAN_TARGET_GROUP, 0}},
+    {TARGET_DEVICE_TYPE_NODE,
+     LIGHTNESS_CLIENT_MODEL,
+     CONFIG_PLAN_BIND | CONFIG_PLAN_PUB,
+     CONFIG_PLAN_TARGET_GROUP,
+     0,
+     {0, 0}},
+    {TARGET_DEVICE_TYPE_NODE, CONFIG_PLAN_ANY_MODEL, 0, 0, 0, {0, 0}},
+
+    {TARGET_DEVICE_TYPE_GATEWAY,
+     SWITCH_MODEL_ID,
+     CONFIG_PLAN_BIND | CONFIG_PLAN_PUB | CONFIG_PLAN_SUB,
+     LIGHT_GROUP_2,
+     2,
+     {LIGHT_GROUP_1, LIGHT_GROUP_2}},
+    {TARGET_DEVICE_TYPE_GATEWAY,
+     SENSOR_CLIENT_MODEL,
+     CONFIG_PLAN_BIND | CONFIG_PLAN_SUB,
+     0,
+     2,
+     {LIGHT_GROUP_1, LIGHT_GROUP_2}},
+    {TARGET_DEVICE_TYPE_GATEWAY, CONFIG_PLAN_ANY_MODEL, 0, 0, 0, {0, 0}},
+};
+
+#define CONFIG_PLAN_TABLE_LEN \
+  (sizeof(config_plan_table) / sizeof(config_plan_table[0]))
+
+const tsConfigPlanEntry *config_plan_lookup(uint8_t device_type,
+                                            uint16_t model_id) {
+  const tsConfigPlanEntry *entry;
+
+  for (size_t i = 0; i < CONFIG_PLAN_TABLE_LEN; i++) {
+    entry = &config_plan_table[i];
+    if (entry->device_type != device_type) {
+      continue;
+    }
+    if (entry->model_id == model_id ||
+        entry->model_id == CONFIG_PLAN_ANY_MODEL) {
+      return entry->actions != 0 ? entry : NULL;
+    }
+  }
+  return NULL;
+}
+
+static uint32_t __fnv_u16(uint32_t hash, uint16_t value) {
+  hash = (hash ^ (value & 0xFF)) * 16777619u;
+  return (hash ^ (value >> 8)) * 16777619u;
+}
+
+uint32_t config_plan_get_hash(void) {
+  static uint32_t hash = 0;
+  const tsConfigPlanEntry *entry;
+
+  if (hash != 0) {
+    return hash;
+  }
+
+  hash = 2166136261u;
+  for (size_t i = 0; i < CONFIG_PLAN_TABLE_LEN; i++) {
+    entry = &config_plan_table[i];
+    hash = __fnv_u16(hash, entry->device_type);
+    hash = __fnv_u16(hash, entry->model_id);
+    hash = __fnv_u16(hash, entry->actions);
+    hash = __fnv_u16(hash, entry->pub_address);
+    for (uint8_t j = 0; j < entry->num_subs; j++) {
+      hash = __fnv_u16(hash, entry->sub_addresses[j]);
+    }
+  }
+  return hash;
+}
@@ -0,0 +1,65 @@
+#ifndef __CONFIG_PLAN__
+#define __CONFIG_PLAN__
+
+#include <stdint.h>
+
+// Actions applied to a model
+#define CONFIG_PLAN_BIND 0x01
+#define CONFIG_PLAN_PUB 0x02
+#define CONFIG_PLAN_SUB 0x04
+// Set the heartbeat publication of the node once it is configured
+#define CONFIG_PLAN_HEARTBEAT 0x08
+
+// Model ID matching every SIG model without an entry of its own
+#define CONFIG_PLAN_ANY_MODEL 0xFFFF
+
+// Address replaced by the group chosen when provisioning started
+#define CONFIG_PLAN_TARGET_GROUP 0x0000
+
+// Max number of groups a model is subscribed to by one entry
+#define CONFIG_PLAN_MAX_SUBS 2
+
+/**
+ * @brief What to configure on one model of one device type
+ *
+ */
+typedef struct {
+  uint8_t device_type;
+  uint16_t model_id;
+  uint8_t actions;
+  uint16_t pub_address;
+  uint8_t num_subs;
+  uint16_t sub_addresses[CONFIG_PLAN_MAX_SUBS];
+} tsConfigPlanEntry;
+
+/**
+ * @brief Look up what to configure on a SIG model
+ *
+ * @param device_type TARGET_DEVICE_TYPE_NODE or TARGET_DEVICE_TYPE_GATEWAY
+ * @param model_id SIG model ID read from the DCD
+ * @return const tsConfigPlanEntry* NULL if the model is left untouched
+ */
+const tsConfigPlanEntry *config_plan_lookup(uint8_t device_type,
+                                            uint16_t model_id);
+
+/**
+ * @brief Hash of the plan table, it changes when a build changes what is
+ * configured on the nodes
+ *
+ * @return uint32_t FNV-1a of the table
+ */
+uint32_t config_plan_get_hash(void);
+
+/**
+ * @brief Resolve an address of the plan
+ *
+ * @param address pub_address or one of sub_addresses of an entry
+ * @param target_group The group chosen when provisioning started
+ * @return uint16_t The address to send to the node
+ */
+static inline uint16_t config_plan_address(uint16_t address,
+                                           uint16_t target_group) {
+  return address == CONFIG_PLAN_TARGET_GROUP ? target_group : address;
+}
+
+#endif  // __CONFIG_PLAN__
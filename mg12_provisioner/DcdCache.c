@@ -0,0 +1,145 @@
+#include "DcdCache.h"
+
+#include <string.h>
+
+#include "DeviceClass.h"
+#include "app_log.h"
+
+#if DCD_CACHE_USE_NVM3
+#include "nvm3_default.h"
+#endif
+
+// Bump this when tsDcdCacheEntry changes so old NVM3 objects are dropped
+#define DCD_CACHE_FORMAT_VERSION 3
+
+typedef struct dcd_cache {
+  tsDcdCacheEntry entries[DCD_CACHE_SIZE];
+  // Sequence number of the last use of each entry, 0 if the slot is empty
+  uint32_t last_used[DCD_CACHE_SIZE];
+  uint32_t use_counter;
+
+  uint32_t uuid_lookups;
+  uint32_t uuid_hits;
+  uint32_t header_lookups;
+  uint32_t header_hits;
+} dcd_cache_t;
+
+static dcd_cache_t cache_instance;
+
+static void __entry_touch(uint8_t index) {
+  cache_instance.last_used[index] = ++cache_instance.use_counter;
+}
+
+void dcd_cache_init(void) {
+  memset(&cache_instance, 0, sizeof(cache_instance));
+
+#if DCD_CACHE_USE_NVM3
+  for (uint8_t i = 0; i < DCD_CACHE_SIZE; i++) {
+    Ecode_t ec = nvm3_readData(nvm3_defaultHandle, DCD_CACHE_NVM3_KEY_BASE + i,
+                               &cache_instance.entries[i],
+                               sizeof(tsDcdCacheEntry));
+    if (ec == ECODE_NVM3_OK &&
+        cache_instance.entries[i].format_version == DCD_CACHE_FORMAT_VERSION) {
+      cache_instance.entries[i].comp.arena = cache_instance.entries[i].words;
+      cache_instance.entries[i].comp.capacity = DCD_CACHE_MAX_WORDS;
+      __entry_touch(i);
+      app_log("DCD cache: loaded product %4.4x:%4.4x v%d\n",
+              cache_instance.entries[i].comp.companyID,
+              cache_instance.entries[i].comp.productID,
+              cache_instance.entries[i].comp.version);
+    } else {
+      memset(&cache_instance.entries[i], 0, sizeof(tsDcdCacheEntry));
+    }
+  }
+#endif
+}
+
+static bool __entry_same_prefix(uint8_t index, const uuid_128 *uuid) {
+  return memcmp(cache_instance.entries[index].uuid_prefix, uuid->data,
+                DCD_CACHE_UUID_PREFIX_LEN) == 0;
+}
+
+static bool __cached_by_uuid(const uuid_128 *uuid) {
+  return (device_class_lookup(uuid)->flags & DEVICE_CLASS_FLAG_DCD_BY_UUID) !=
+         0;
+}
+
+const tsDcdCacheEntry *dcd_cache_find_by_uuid(const uuid_128 *uuid) {
+#if DCD_CACHE_UUID_PREFIX_LOOKUP
+  if (!__cached_by_uuid(uuid)) {
+    return NULL;
+  }
+  cache_instance.uuid_lookups++;
+  for (uint8_t i = 0; i < DCD_CACHE_SIZE; i++) {
+    if (cache_instance.last_used[i] > 0 && __entry_same_prefix(i, uuid)) {
+      cache_instance.uuid_hits++;
+      __entry_touch(i);
+      return &cache_instance.entries[i];
+    }
+  }
+#else
+  (void)uuid;
+#endif
+  return NULL;
+}
+
+const tsDcdCacheEntry *dcd_cache_find_by_header(
+    const tsDcdComposition *pHeader, const uuid_128 *uuid) {
+  // The old node firmware writes the same prefix for every node type
+  if (!__cached_by_uuid(uuid)) {
+    return NULL;
+  }
+  cache_instance.header_lookups++;
+  for (uint8_t i = 0; i < DCD_CACHE_SIZE; i++) {
+    if (cache_instance.last_used[i] > 0 && __entry_same_prefix(i, uuid) &&
+        cache_instance.entries[i].comp.companyID == pHeader->companyID &&
+        cache_instance.entries[i].comp.productID == pHeader->productID &&
+        cache_instance.entries[i].comp.version == pHeader->version) {
+      cache_instance.header_hits++;
+      __entry_touch(i);
+      return &cache_instance.entries[i];
+    }
+  }
+  return NULL;
+}
+
+void dcd_cache_store(const tsDcdComposition *comp, const uuid_128 *uuid) {
+  uint8_t victim = 0;
+  tsDcdCacheEntry *entry;
+
+  if (comp->used > DCD_CACHE_MAX_WORDS) {
+    app_log("DCD cache: product %4.4x:%4.4x takes %d words, not cached\n",
+            comp->companyID, comp->productID, comp->used);
+    return;
+  }
+
+  for (uint8_t i = 1; i < DCD_CACHE_SIZE; i++) {
+    if (cache_instance.last_used[i] < cache_instance.last_used[victim]) {
+      victim = i;
+    }
+  }
+
+  entry = &cache_instance.entries[victim];
+  memset(entry, 0, sizeof(*entry));
+  entry->format_version = DCD_CACHE_FORMAT_VERSION;
+  memcpy(entry->uuid_prefix, uuid->data, DCD_CACHE_UUID_PREFIX_LEN);
+  dcd_composition_init(&entry->comp, entry->words, DCD_CACHE_MAX_WORDS);
+  dcd_composition_copy(&entry->comp, comp);
+  __entry_touch(victim);
+
+  app_log("DCD cache: stored product %4.4x:%4.4x v%d in slot %d\n",
+          comp->companyID, comp->productID, comp->version, victim);
+
+#if DCD_CACHE_USE_NVM3
+  if (nvm3_writeData(nvm3_defaultHandle, DCD_CACHE_NVM3_KEY_BASE + victim,
+                     entry, sizeof(*entry)) != ECODE_NVM3_OK) {
+    app_log("DCD cache: failed to save slot %d\n", victim);
+  }
+#endif
+}
+
+void dcd_cache_print_stats(void) {
+  app_log("DCD cache: fetch skipped %lu/%lu, decode skipped %lu/%lu\n",
+          cache_instance.uuid_hits, cache_instance.uuid_lookups,
+          cache_instance.header_hits, cache_instance.header_lookups);
+}
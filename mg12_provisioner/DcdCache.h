@@ -0,0 +1,87 @@
+#ifndef __DCD_CACHE__
+#define __DCD_CACHE__
+
+#include "mesh_uuid.h"
+#include "DcdParser.h"
+#include "sl_btmesh_api.h"
+
+// Number of different products whose composition is kept in RAM
+#define DCD_CACHE_SIZE 4
+
+// Set to 1 to keep the cached compositions in NVM3 across resets
+#define DCD_CACHE_USE_NVM3 1
+
+// NVM3 keys used by the cache: DCD_CACHE_NVM3_KEY_BASE + slot index
+#define DCD_CACHE_NVM3_KEY_BASE 0x0100
+
+// Largest composition kept, in 16-bit words. An entry is saved as one NVM3
+// object so it must stay below the max object size, larger compositions are
+// decoded again for each node.
+#define DCD_CACHE_MAX_WORDS 96
+
+// Number of leading UUID bytes identifying the product of a device
+#define DCD_CACHE_UUID_PREFIX_LEN MESH_UUID_PREFIX_LEN
+
+// Set to 1 to look the composition up by UUID prefix and skip the DCD fetch.
+// Only done for the classes with DEVICE_CLASS_FLAG_DCD_BY_UUID, whose prefix
+// tells the product and its firmware revision apart.
+#define DCD_CACHE_UUID_PREFIX_LOOKUP 1
+
+/**
+ * @brief The decoded composition of one product
+ *
+ */
+typedef struct {
+  uint8_t format_version;
+  uint8_t uuid_prefix[DCD_CACHE_UUID_PREFIX_LEN];
+  // its arena is words, set again when the entry is loaded
+  tsDcdComposition comp;
+  uint16_t words[DCD_CACHE_MAX_WORDS];
+} tsDcdCacheEntry;
+
+/**
+ * @brief Init the cache and load the compositions saved in NVM3
+ *
+ */
+void dcd_cache_init(void);
+
+/**
+ * @brief Look the composition of a device up before fetching its DCD
+ *
+ * @param uuid The UUID of the device
+ * @return const tsDcdCacheEntry* NULL on miss, if the lookup is disabled or
+ * if the class of the device can not be cached by UUID
+ */
+const tsDcdCacheEntry *dcd_cache_find_by_uuid(const uuid_128 *uuid);
+
+/**
+ * @brief Look the composition up once the header of a DCD is decoded so that
+ * the rest of it does not need to be decoded again. Every node firmware of
+ * the group reports the same company, product and version ids, so the entry
+ * must also come from the same UUID prefix. A device whose class can not be
+ * cached by UUID always misses.
+ *
+ * @param pHeader Composition whose header (company, product, version) is set
+ * @param uuid The UUID of the device the DCD comes from
+ * @return const tsDcdCacheEntry* NULL on miss
+ */
+const tsDcdCacheEntry *dcd_cache_find_by_header(
+    const tsDcdComposition *pHeader, const uuid_128 *uuid);
+
+/**
+ * @brief Save a decoded composition, evicting the least recently used one
+ * if the cache is full. Compositions larger than DCD_CACHE_MAX_WORDS are not
+ * saved.
+ *
+ * @param comp The decoded composition
+ * @param uuid The UUID of the device the DCD came from
+ */
+void dcd_cache_store(const tsDcdComposition *comp, const uuid_128 *uuid);
+
+/**
+ * @brief Print the hit rate of the cache
+ *
+ */
+void dcd_cache_print_stats(void);
+
+#endif  // __DCD_CACHE__
@@ -0,0 +1,178 @@
+#include "DcdParser.h"
+
+#include <string.h>
+
+#include "app_log.h"
+
+// Size of the DCD page 0 header and of the header of each element
+#define DCD_HEADER_LEN 10
+#define DCD_ELEM_HEADER_LEN 4
+
+typedef enum {
+  DCD_STATE_HEADER = 0,
+  DCD_STATE_ELEM_HEADER,
+  DCD_STATE_MODELS,
+  DCD_STATE_SKIP,
+  DCD_STATE_ERROR,
+} tsDcdParserState;
+
+static uint16_t __get_u16(const uint8_t *p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static void __expect(tsDcdParser *parser, uint8_t state, uint8_t size) {
+  parser->state = state;
+  parser->field_len = 0;
+  parser->field_size = size;
+}
+
+void dcd_composition_init(tsDcdComposition *comp, uint16_t *arena,
+                          uint16_t capacity) {
+  memset(comp, 0, sizeof(*comp));
+  comp->arena = arena;
+  comp->capacity = capacity;
+}
+
+bool dcd_composition_copy(tsDcdComposition *dst, const tsDcdComposition *src) {
+  uint16_t *arena = dst->arena;
+  uint16_t capacity = dst->capacity;
+
+  if (src->used > capacity) {
+    return false;
+  }
+  memcpy(dst, src, sizeof(*dst));
+  dst->arena = arena;
+  dst->capacity = capacity;
+  memcpy(arena, src->arena, src->used * sizeof(uint16_t));
+  return true;
+}
+
+void dcd_parser_init(tsDcdParser *parser, tsDcdComposition *out) {
+  memset(parser, 0, sizeof(*parser));
+  dcd_composition_init(out, out->arena, out->capacity);
+  parser->out = out;
+  __expect(parser, DCD_STATE_HEADER, DCD_HEADER_LEN);
+}
+
+/*
+ * Handle one field once all its bytes are collected
+ * */
+static uint8_t __field_done(tsDcdParser *parser) {
+  tsDcdComposition *comp = parser->out;
+  const uint8_t *f = parser->field;
+  uint8_t numSIGModels, numVendorModels;
+
+  switch (parser->state) {
+    case DCD_STATE_HEADER:
+      comp->companyID = __get_u16(&f[0]);
+      comp->productID = __get_u16(&f[2]);
+      comp->version = __get_u16(&f[4]);
+      comp->replayCap = __get_u16(&f[6]);
+      comp->featureBitmask = __get_u16(&f[8]);
+      app_log("DCD: company ID %4.4x, Product ID %4.4x\r\n", comp->companyID,
+              comp->productID);
+      __expect(parser, DCD_STATE_ELEM_HEADER, DCD_ELEM_HEADER_LEN);
+      break;
+    case DCD_STATE_ELEM_HEADER:
+      numSIGModels = f[2];
+      numVendorModels = f[3];
+      parser->words_left = numSIGModels + 2 * numVendorModels;
+      if (comp->used + 2 + parser->words_left > comp->capacity) {
+        app_log("ERROR: element %d does not fit in the DCD arena\r\n",
+                comp->number_of_elements);
+        parser->state = DCD_STATE_ERROR;
+        return DCD_PARSER_ARENA_FULL;
+      }
+      comp->arena[comp->used++] = __get_u16(&f[0]);
+      comp->arena[comp->used++] = numSIGModels | (numVendorModels << 8);
+      if (parser->words_left == 0) {
+        comp->number_of_elements++;
+        __expect(parser, DCD_STATE_ELEM_HEADER, DCD_ELEM_HEADER_LEN);
+      } else {
+        __expect(parser, DCD_STATE_MODELS, 2);
+      }
+      break;
+    case DCD_STATE_MODELS:
+      comp->arena[comp->used++] = __get_u16(f);
+      parser->words_left--;
+      if (parser->words_left == 0) {
+        comp->number_of_elements++;
+        __expect(parser, DCD_STATE_ELEM_HEADER, DCD_ELEM_HEADER_LEN);
+      } else {
+        __expect(parser, DCD_STATE_MODELS, 2);
+      }
+      break;
+    default:
+      break;
+  }
+  return DCD_PARSER_OK;
+}
+
+uint8_t dcd_parser_feed(tsDcdParser *parser, const uint8_t *data,
+                        uint8_t len) {
+  uint8_t retval;
+
+  for (uint8_t i = 0; i < len; i++) {
+    if (parser->state == DCD_STATE_SKIP) {
+      return DCD_PARSER_OK;
+    }
+    if (parser->state == DCD_STATE_ERROR) {
+      return DCD_PARSER_ERROR;
+    }
+
+    parser->field[parser->field_len++] = data[i];
+    if (parser->field_len == parser->field_size) {
+      retval = __field_done(parser);
+      if (retval != DCD_PARSER_OK) {
+        return retval;
+      }
+    }
+  }
+  return DCD_PARSER_OK;
+}
+
+bool dcd_parser_header_done(const tsDcdParser *parser) {
+  return parser->state != DCD_STATE_HEADER;
+}
+
+void dcd_parser_skip(tsDcdParser *parser) {
+  parser->state = DCD_STATE_SKIP;
+}
+
+bool dcd_parser_finish(const tsDcdParser *parser) {
+  if (parser->state == DCD_STATE_SKIP) {
+    return true;
+  }
+  return parser->state == DCD_STATE_ELEM_HEADER && parser->field_len == 0 &&
+         parser->out->number_of_elements > 0;
+}
+
+uint16_t dcd_composition_get_element(const tsDcdComposition *comp,
+                                     uint16_t offset, tsDcdElementView *view) {
+  view->location = comp->arena[offset];
+  view->numSIGModels = comp->arena[offset + 1] & 0xFF;
+  view->numVendorModels = comp->arena[offset + 1] >> 8;
+  view->SIG_models = &comp->arena[offset + 2];
+  view->vendor_models = &comp->arena[offset + 2 + view->numSIGModels];
+
+  return offset + 2 + view->numSIGModels + 2 * view->numVendorModels;
+}
+
+static uint32_t __fnv_u16(uint32_t hash, uint16_t value) {
+  hash = (hash ^ (value & 0xFF)) * 16777619u;
+  return (hash ^ (value >> 8)) * 16777619u;
+}
+
+uint32_t dcd_composition_hash(const tsDcdComposition *comp) {
+  uint32_t hash = 2166136261u;
+
+  hash = __fnv_u16(hash, comp->companyID);
+  hash = __fnv_u16(hash, comp->productID);
+  hash = __fnv_u16(hash, comp->version);
+  hash = __fnv_u16(hash, comp->replayCap);
+  hash = __fnv_u16(hash, comp->featureBitmask);
+  for (uint16_t i = 0; i < comp->used; i++) {
+    hash = __fnv_u16(hash, comp->arena[i]);
+  }
+  return hash;
+}
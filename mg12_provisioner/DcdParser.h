@@ -0,0 +1,142 @@
+#ifndef __DCD_PARSER__
+#define __DCD_PARSER__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define DCD_PARSER_OK 0
+#define DCD_PARSER_ERROR 1
+#define DCD_PARSER_ARENA_FULL 2
+
+/**
+ * @brief Decoded page 0 of a node composition. The elements are packed one
+ * after the other in an arena owned by the caller as:
+ * [location][numSIGModels | numVendorModels << 8][SIG ids...]
+ * [vendor id, model id]...
+ * Each element takes 2 words plus 1 per SIG model and 2 per vendor model, so
+ * the composition only takes the words the node really needs.
+ *
+ */
+typedef struct {
+  uint16_t companyID;
+  uint16_t productID;
+  uint16_t version;
+  uint16_t replayCap;
+  uint16_t featureBitmask;
+  uint8_t number_of_elements;
+  // words of the arena in use
+  uint16_t used;
+  // words the arena can hold, the owner may lower it once the arena is
+  // shared with something else
+  uint16_t capacity;
+  uint16_t *arena;
+} tsDcdComposition;
+
+/**
+ * @brief View of one element inside the arena of a composition
+ *
+ */
+typedef struct {
+  uint16_t location;
+  uint8_t numSIGModels;
+  uint8_t numVendorModels;
+  const uint16_t *SIG_models;
+  // pairs of vendor id, model id
+  const uint16_t *vendor_models;
+} tsDcdElementView;
+
+/**
+ * @brief State of the incremental decoding of one DCD
+ *
+ */
+typedef struct {
+  tsDcdComposition *out;
+  uint8_t state;
+  // bytes of the field being decoded, a field may span two fragments
+  uint8_t field[10];
+  uint8_t field_len;
+  uint8_t field_size;
+  // model words left in the current element
+  uint16_t words_left;
+} tsDcdParser;
+
+/**
+ * @brief Give a composition its arena, it is emptied
+ *
+ * @param comp The composition
+ * @param arena Words the elements are decoded into
+ * @param capacity Number of words of the arena
+ */
+void dcd_composition_init(tsDcdComposition *comp, uint16_t *arena,
+                          uint16_t capacity);
+
+/**
+ * @brief Copy a composition into another one, keeping the arena of the
+ * destination
+ *
+ * @param dst The composition to fill
+ * @param src The composition to copy
+ * @return true if the elements of src fit in the arena of dst
+ */
+bool dcd_composition_copy(tsDcdComposition *dst, const tsDcdComposition *src);
+
+/**
+ * @brief Start decoding a new DCD into a composition
+ *
+ * @param parser The parser state
+ * @param out The composition to fill, it is emptied but keeps its arena
+ */
+void dcd_parser_init(tsDcdParser *parser, tsDcdComposition *out);
+
+/**
+ * @brief Decode one fragment of DCD data as soon as it arrives. Elements are
+ * appended to the composition as they complete.
+ *
+ * @param parser The parser state
+ * @param data The fragment
+ * @param len Length of the fragment
+ * @return uint8_t Status code defined above
+ */
+uint8_t dcd_parser_feed(tsDcdParser *parser, const uint8_t *data,
+                        uint8_t len);
+
+/**
+ * @brief Check if the header of the composition has been decoded
+ *
+ */
+bool dcd_parser_header_done(const tsDcdParser *parser);
+
+/**
+ * @brief Stop decoding, the remaining fragments are ignored
+ *
+ */
+void dcd_parser_skip(tsDcdParser *parser);
+
+/**
+ * @brief Check that the DCD ended on an element boundary
+ *
+ * @return true if the composition is complete and valid
+ */
+bool dcd_parser_finish(const tsDcdParser *parser);
+
+/**
+ * @brief Read the element starting at a given offset of the arena
+ *
+ * @param comp The composition
+ * @param offset Offset of the element, 0 for the primary element
+ * @param [out] view The element
+ * @return uint16_t Offset of the next element
+ */
+uint16_t dcd_composition_get_element(const tsDcdComposition *comp,
+                                     uint16_t offset, tsDcdElementView *view);
+
+/**
+ * @brief Hash of a decoded composition, used to tell if the DCD of a node
+ * changed
+ *
+ * @param comp The composition
+ * @return uint32_t FNV-1a of the header and the used part of the arena
+ */
+uint32_t dcd_composition_hash(const tsDcdComposition *comp);
+
+#endif  // __DCD_PARSER__
@@ -0,0 +1,52 @@
+#include "DeviceClass.h"
+
+#include "DeviceConfiguration.h"
+
+// Score of the classes going first: a gateway before everything, then the
+// lights since they relay for the nodes provisioned after them
+#define SCORE_GATEWAY 0x0100
+#define SCORE_RELAY_NODE 0x0020
+
+/*
+ * Indexed by MESH_UUID_CLASS_*. MESH_UUID_CLASS_NODE is written by the older
+ * firmware of every node type so it can not be cached by UUID. A class left
+ * out here comes from a newer firmware and is handled as a plain node.
+ * */
+static const device_class_t device_class_table[MESH_UUID_CLASS_COUNT] = {
+    [MESH_UUID_CLASS_NODE] = {"node", TARGET_DEVICE_TYPE_NODE, 0,
+                              DEVICE_CLASS_FLAG_PROVISION},
+    [MESH_UUID_CLASS_GATEWAY] = {"gateway", TARGET_DEVICE_TYPE_GATEWAY,
+                                 SCORE_GATEWAY,
+                                 DEVICE_CLASS_FLAG_PROVISION |
+                                     DEVICE_CLASS_FLAG_DCD_BY_UUID},
+    [MESH_UUID_CLASS_LIGHT] = {"light", TARGET_DEVICE_TYPE_NODE,
+                               SCORE_RELAY_NODE,
+                               DEVICE_CLASS_FLAG_PROVISION |
+                                   DEVICE_CLASS_FLAG_DCD_BY_UUID},
+    [MESH_UUID_CLASS_SWITCH] = {"switch", TARGET_DEVICE_TYPE_NODE, 0,
+                                DEVICE_CLASS_FLAG_PROVISION |
+                                    DEVICE_CLASS_FLAG_DCD_BY_UUID},
+    [MESH_UUID_CLASS_SENSOR_SERVER] = {"sensor server",
+                                       TARGET_DEVICE_TYPE_NODE, 0,
+                                       DEVICE_CLASS_FLAG_PROVISION |
+                                           DEVICE_CLASS_FLAG_DCD_BY_UUID},
+    [MESH_UUID_CLASS_SENSOR_CLIENT] = {"sensor client",
+                                       TARGET_DEVICE_TYPE_NODE, 0,
+                                       DEVICE_CLASS_FLAG_PROVISION |
+                                           DEVICE_CLASS_FLAG_DCD_BY_UUID},
+};
+
+static const device_class_t device_class_unknown = {
+    "unknown", TARGET_DEVICE_TYPE_NODE, 0, DEVICE_CLASS_FLAG_PROVISION};
+
+static const device_class_t device_class_foreign = {"foreign", 0, 0, 0};
+
+const device_class_t *device_class_lookup(const uuid_128 *uuid) {
+  const device_class_t *device_class;
+
+  if (!mesh_uuid_is_family(uuid)) {
+    return &device_class_foreign;
+  }
+  device_class = &device_class_table[mesh_uuid_get_class(uuid)];
+  return device_class->name != NULL ? device_class : &device_class_unknown;
+}
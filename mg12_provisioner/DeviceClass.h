@@ -0,0 +1,40 @@
+#ifndef __DEVICE_CLASS__
+#define __DEVICE_CLASS__
+
+#include <stdint.h>
+
+#include "mesh_uuid.h"
+#include "sl_btmesh_api.h"
+
+// The devices of the class are provisioned and configured by us
+#define DEVICE_CLASS_FLAG_PROVISION 0x01
+// The devices of the class with the same UUID prefix (family, revision,
+// class and capabilities) have the same composition, their DCD may be taken
+// from the cache without fetching it
+#define DEVICE_CLASS_FLAG_DCD_BY_UUID 0x02
+
+/**
+ * @brief What the provisioner does with the devices of one class
+ *
+ */
+typedef struct {
+  const char *name;
+  // TARGET_DEVICE_TYPE_*, picks the config plan of the node
+  uint8_t device_type;
+  // Added to the beacon score, see device_manager_get_next_device
+  uint16_t score;
+  uint8_t flags;
+} device_class_t;
+
+/**
+ * @brief Classify a device from its UUID, see common/mesh_uuid.h. The
+ * lookup is a constant table indexed by the class, done once when the first
+ * beacon of a device arrives.
+ *
+ * @param uuid The UUID of the device
+ * @return const device_class_t* Never NULL, devices of another family get a
+ * class without DEVICE_CLASS_FLAG_PROVISION
+ */
+const device_class_t *device_class_lookup(const uuid_128 *uuid);
+
+#endif  // __DEVICE_CLASS__
@@ -5,622 +5,1141 @@
 #include "app_log.h"
 
 /* This will be the model agregator: config and load model */
+#include "ConfigJournal.h"
+#include "ConfigPlan.h"
+#include "DcdCache.h"
 #include "DeviceConfiguration.h"
 #include "NetworkConfiguration.h"
+#include "NodeDatabase.h"
+#include "RetryEngine.h"
+#include "StageLatency.h"
 #include "StatusIndicator.h"
+#include "TtlTuner.h"
 #include "sl_bluetooth.h"
 #include "sl_bt_api.h"
 #include "sl_btmesh.h"
 #include "sl_btmesh_api.h"
 
-// Hold to maximum of 5 elements
-tsDCD_ElemContent _sDCD_Table[MAX_ELEMS_PER_DEV] = {0};
+#define CONFIG_MAX_RETRIES 3
 
-// DCD content of the last provisioned device. (the example code decodes up to
-// two elements, but only the primary element is used in the configuration to
-// simplify the code) tsDCD_ElemContent _sDCD_Prim; tsDCD_ElemContent _sDCD_2nd;
-// /* second DCD element is decoded if present, but not used for anything (just
-// informative) */
+// ANCHOR - Configuration section
+
+/**
+ * NOTE What this module needs when configure model in the target device?
+ * Network ID (get from the network header)
+ * Appkey Index (get from the network header)
+ * Target Address (set by provisioner in the provisioning process) (send from
+ * the main program) DCD of the target (this module will get this later) Pub &
+ * sub address for each model (get from the network header)
+ */
 
-uint8_t _dcd_raw[256];  // raw content of the DCD received from remote node
-uint8_t _dcd_raw_len;
-uint8_t number_of_elements = 1;
+typedef enum {
+  CONFIG_CMD_BIND = 0,
+  CONFIG_CMD_PUB,
+  CONFIG_CMD_SUB,
+  // Node-wide steps, only sent once every model command is acknowledged
+  CONFIG_CMD_PROXY,
+  CONFIG_CMD_HEARTBEAT,
+} tsConfigCmdType;
+
+typedef enum {
+  CONFIG_CMD_PENDING = 0,
+  CONFIG_CMD_IN_FLIGHT,
+  // Failed, waiting for its retry time
+  CONFIG_CMD_BACKOFF,
+  CONFIG_CMD_DONE,
+} tsConfigCmdState;
 
 /**
- * NOTE This function currently can only decode DCD data of maximun 2 elements.
- * If there are more than 2, it will discard all the exceedings.
+ * @brief One foundation config request to be sent to the node
  *
  */
-void DCD_decode(void) {
-  tsDCD_Header *pHeader;
-  tsDCD_Elem *pElem;
-  uint8_t byte_offset;
+typedef struct {
+  uint8_t type;
+  uint8_t state;
+  uint8_t element_index;
+  uint8_t retries_left;
+  tsModel model;
+  // pub or sub address, unused for binding
+  uint16_t address;
+  uint32_t handle;
+  // Status deadline when in flight, retry time when in backoff
+  uint32_t deadline;
+} tsConfigCmd;
 
-  pHeader = (tsDCD_Header *)&_dcd_raw;
+/**
+ * @brief This struct hold the config data for one node. All models are bound
+ * to the same appkey (there is exactly one appkey in the network)
+ *
+ */
+typedef struct {
+  // The commands sit at the top of the session arena, cmds[0] is the lowest
+  tsConfigCmd *cmds;
+  uint8_t num_cmds;
+  uint8_t num_done;
+  uint8_t num_in_flight;
+  // First command that may still be pending, the ones before are all sent
+  uint8_t next_pending;
+} tsConfig;
 
-  app_log("DCD: company ID %4.4x, Product ID %4.4x\r\n", pHeader->companyID,
-          pHeader->productID);
+/**
+ * @brief Everything needed to configure one node. A session is free when its
+ * target address is 0 (unassigned address)
+ *
+ */
+typedef struct {
+  uint16_t target_device_address;
+  uint16_t target_group_address;
+  uint8_t target_device_type;
+  uuid_128 dev_uuid;
+
+  // Handle of the DCD request
+  uint32_t dcd_handle;
+  uint32_t dcd_deadline;
+  uint8_t dcd_retries_left;
+  bool dcd_backoff;
+
+  // The DCD is decoded fragment by fragment, each element is planned as soon
+  // as it is complete
+  tsDcdParser dcd_parser;
+  tsDcdComposition dcd;
+  bool dcd_complete;
+  uint8_t planned_elements;
+  uint16_t planned_offset;
+
+  tsConfig config;
+  uint8_t need_to_set_heartbeat_pub;
+
+  // Holds the words of the DCD from the bottom and the commands from the top,
+  // reset with the session
+  uint32_t arena[DEVICE_CONFIG_ARENA_BYTES / sizeof(uint32_t)];
+
+  // Resumed from the journal after a reset, nothing is sent until the whole
+  // plan is rebuilt and checked against the journal
+  bool resuming;
+  bool plan_journaled;
+
+  // Only the publications of a configured node are sent again, e.g. with a
+  // new TTL. Such a session is not journaled and a failure leaves the node
+  // in the network.
+  bool pub_only;
+} tsConfigSession;
+
+static tsConfigSession _sSessions[DEVICE_CONFIG_MAX_SESSIONS];
+
+// Most bytes of its arena a session used, DCD and commands together
+static uint16_t _arenaPeak;
+
+static const char *const config_cmd_names[] = {
+    "APP BIND", "PUB SET", "SUB ADD", "GATT PROXY", "HEARTBEAT PUB"};
+
+static tsConfigSession *__session_find_by_dcd_handle(uint32_t handle) {
+  for (uint8_t i = 0; i < DEVICE_CONFIG_MAX_SESSIONS; i++) {
+    if (_sSessions[i].target_device_address != 0 &&
+        _sSessions[i].dcd_handle == handle) {
+      return &_sSessions[i];
+    }
+  }
+  return NULL;
+}
 
-  pElem = (tsDCD_Elem *)pHeader->payload;
+/**
+ * @brief Find the in-flight command a status event answers
+ *
+ * @param handle Handle carried by the status event
+ * @param [out] pSession The session owning the command
+ * @return tsConfigCmd* NULL if no session waits for this handle
+ */
+static tsConfigCmd *__cmd_find_by_handle(uint32_t handle,
+                                         tsConfigSession **pSession) {
+  tsConfig *config;
 
-  // decode primary element:
-  DCD_decode_element(pElem, &_sDCD_Prim);
+  for (uint8_t i = 0; i < DEVICE_CONFIG_MAX_SESSIONS; i++) {
+    if (_sSessions[i].target_device_address == 0) {
+      continue;
+    }
+    config = &_sSessions[i].config;
+    for (uint8_t j = 0; j < config->num_cmds; j++) {
+      if (config->cmds[j].state == CONFIG_CMD_IN_FLIGHT &&
+          config->cmds[j].handle == handle) {
+        *pSession = &_sSessions[i];
+        return &config->cmds[j];
+      }
+    }
+  }
+  return NULL;
+}
 
-  // check if DCD has more than one element by calculating where we are
-  // currently at the raw DCD array and compare against the total size of the
-  // raw DCD:
-  byte_offset = 10 + 4 + pElem->numSIGModels * 2 +
-                pElem->numVendorModels *
-                    4;  // +10 for DCD header, +4 for header in the DCD element
+static tsConfigSession *__session_find_by_address(uint16_t address) {
+  for (uint8_t i = 0; i < DEVICE_CONFIG_MAX_SESSIONS; i++) {
+    if (_sSessions[i].target_device_address == address) {
+      return &_sSessions[i];
+    }
+  }
+  return NULL;
+}
 
-  // TODO: Modify this code to make this function works even when there are more
-  // than 2 elements
-  if (byte_offset < _dcd_raw_len) {
-    // set elem pointer to the beginning of 2nd element:
-    pElem = (tsDCD_Elem *)&(_dcd_raw[byte_offset]);
+static uint8_t __session_slot(const tsConfigSession *session) {
+  return (uint8_t)(session - _sSessions);
+}
 
-    app_log(
-        "Decoding 2nd element (just informative, not used for anything)\r\n");
-    DCD_decode_element(pElem, &_sDCD_2nd);
+static void __session_release(tsConfigSession *session) {
+  uint16_t used = (uint16_t)(session->dcd.used * sizeof(uint16_t) +
+                             session->config.num_cmds * sizeof(tsConfigCmd));
 
-    number_of_elements = 2;
-    app_log("Total number of elements in the DCD is %d\n", number_of_elements);
+  if (used > _arenaPeak) {
+    _arenaPeak = used;
   }
+  memset(session, 0, sizeof(*session));
 }
 
-/* function for decoding one element inside the DCD. Parameters:
- *  pElem: pointer to the beginning of element in the raw DCD data
- *  pDest: pointer to a struct where the decoded values are written
+/*
+ * Empty the arena of a new session: the whole of it is free for the DCD until
+ * the first command is planned
  * */
-void DCD_decode_element(tsDCD_Elem *pElem, tsDCD_ElemContent *pDest) {
-  uint16_t *pu16;
-  int i;
-
-  memset(pDest, 0, sizeof(*pDest));
-
-  pDest->numSIGModels = pElem->numSIGModels;
-  pDest->numVendorModels = pElem->numVendorModels;
+static void __session_arena_reset(tsConfigSession *session) {
+  dcd_composition_init(&session->dcd, (uint16_t *)session->arena,
+                       DEVICE_CONFIG_ARENA_BYTES / sizeof(uint16_t));
+  session->config.cmds =
+      (tsConfigCmd *)((uint8_t *)session->arena + DEVICE_CONFIG_ARENA_BYTES);
+  session->config.num_cmds = 0;
+}
 
-  app_log("Num sig models: %d\r\n", pDest->numSIGModels);
-  app_log("Num vendor models: %d\r\n", pDest->numVendorModels);
+/*
+ * Make room for one more command below the ones planned. The commands are
+ * moved down by one so that they stay in planning order, the DCD keeps the
+ * words it holds plus the ones of the element being decoded.
+ * */
+static tsConfigCmd *__session_arena_push_cmd(tsConfigSession *session) {
+  tsConfig *config = &session->config;
+  uint16_t dcd_words = session->dcd.used;
+  uint16_t free_bytes;
 
-  if (pDest->numSIGModels > MAX_SIG_MODELS) {
-    app_log(
-        "ERROR: number of SIG models in DCD exceeds MAX_SIG_MODELS (%u) "
-        "limit!\r\n",
-        MAX_SIG_MODELS);
-    return;
+  if (!session->dcd_complete) {
+    dcd_words += session->dcd_parser.words_left;
   }
-  if (pDest->numVendorModels > MAX_VENDOR_MODELS) {
-    app_log(
-        "ERROR: number of VENDOR models in DCD exceeds MAX_VENDOR_MODELS (%u) "
-        "limit!\r\n",
-        MAX_VENDOR_MODELS);
-    return;
+  free_bytes = DEVICE_CONFIG_ARENA_BYTES - dcd_words * sizeof(uint16_t) -
+               config->num_cmds * sizeof(tsConfigCmd);
+  if (config->num_cmds >= DEVICE_CONFIG_MAX_CMDS ||
+      free_bytes < sizeof(tsConfigCmd)) {
+    return NULL;
   }
 
-  // set pointer to the first model:
-  pu16 = (uint16_t *)pElem->payload;
+  memmove(config->cmds - 1, config->cmds,
+          config->num_cmds * sizeof(tsConfigCmd));
+  config->cmds--;
+  session->dcd.capacity =
+      (uint16_t)(((uint8_t *)config->cmds - (uint8_t *)session->arena) /
+                 sizeof(uint16_t));
+  return &config->cmds[config->num_cmds++];
+}
+
+static void config_plan_elements(tsConfigSession *session);
+static void config_start(tsConfigSession *session);
+static bool config_dcd_retry(tsConfigSession *session);
 
-  // grab the SIG models from the DCD data
-  for (i = 0; i < pDest->numSIGModels; i++) {
-    pDest->SIG_models[i] = *pu16;
-    pu16++;
-    app_log("model ID: %4.4x\r\n", pDest->SIG_models[i]);
+/*
+ * Request the DCD of the node, the decoding starts over
+ * */
+static sl_status_t config_dcd_fetch(tsConfigSession *session) {
+  sl_status_t sc;
+
+  dcd_parser_init(&session->dcd_parser, &session->dcd);
+  session->planned_elements = 0;
+  session->planned_offset = 0;
+
+  sc = sl_btmesh_config_client_get_dcd(
+      NETWORK_ID, session->target_device_address, 0, &session->dcd_handle);
+  if (sc == SL_STATUS_OK) {
+    session->dcd_backoff = false;
+    session->dcd_deadline =
+        retry_engine_now_ms() + RETRY_ENGINE_REQUEST_TIMEOUT_MS;
+    retry_engine_wake_at(session->dcd_deadline);
   }
+  return sc;
+}
 
-  // grab the vendor models from the DCD data
-  for (i = 0; i < pDest->numVendorModels; i++) {
-    pDest->vendor_models[i].vendor_id = *pu16;
-    pu16++;
-    pDest->vendor_models[i].model_id = *pu16;
-    pu16++;
-
-    app_log("vendor ID: %4.4x, model ID: %4.4x\r\n",
-            pDest->vendor_models[i].vendor_id,
-            pDest->vendor_models[i].model_id);
+/*
+ * Start the journal of a session, the publication updates have none
+ * */
+static void config_journal_open(tsConfigSession *session) {
+  if (!session->pub_only) {
+    config_journal_begin(__session_slot(session),
+                         session->target_device_address, &session->dev_uuid,
+                         session->target_device_type,
+                         session->target_group_address);
   }
 }
 
-// ANCHOR - Configuration section
+/*
+ * Take a free session for the node and start it from the cached DCD, or
+ * request the DCD
+ * */
+static sl_status_t config_session_open(uint16_t target_device,
+                                       uint16_t target_group,
+                                       uint8_t device_type, uuid_128 dev_uuid,
+                                       bool pub_only) {
+  sl_status_t sc;
+  tsConfigSession *session;
+  const tsDcdCacheEntry *cached;
+
+  if (target_device == 0) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  if (__session_find_by_address(target_device) != NULL) {
+    // e.g. resumed from the journal after a reset
+    return SL_STATUS_ALREADY_EXISTS;
+  }
 
-/**
- * NOTE What this module needs when configure model in the target device?
- * Network ID (get from the network header)
- * Appkey Index (get from the network header)
- * Target Address (set by provisioner in the provisioning process) (send from
- * the main program) DCD of the target (this module will get this later) Pub &
- * sub address for each model (get from the network header)
- */
-static uint16_t target_device_address = 0;
-static uint16_t target_group_address = 0;
-static uint8_t target_device_type = TARGET_DEVICE_TYPE_NODE;
+  session = __session_find_by_address(0);
+  if (session == NULL) {
+    return SL_STATUS_NO_MORE_RESOURCE;
+  }
 
-// Always start with element 0
-static uint8_t element_index = 0;
+  __session_arena_reset(session);
+  session->target_group_address = target_group;
+  session->target_device_type = device_type;
+  session->dev_uuid = dev_uuid;
+  session->pub_only = pub_only;
+  app_log("The target address is %2x\n", target_device);
+
+  // A cached composition larger than the arena is fetched like an unknown one
+  cached = dcd_cache_find_by_uuid(&dev_uuid);
+  if (cached != NULL && dcd_composition_copy(&session->dcd, &cached->comp)) {
+    app_log("DCD of product %4.4x:%4.4x found in cache, skip fetching\n",
+            cached->comp.companyID, cached->comp.productID);
+    session->target_device_address = target_device;
+    config_journal_open(session);
+    session->dcd_complete = true;
+    dcd_cache_print_stats();
+    config_plan_elements(session);
+    config_start(session);
+    return SL_STATUS_OK;
+  }
 
-static uuid_128 current_dev_uuid;
+  session->target_device_address = target_device;
+  session->dcd_retries_left = CONFIG_MAX_RETRIES;
+  sc = config_dcd_fetch(session);
+  if (sc != SL_STATUS_OK) {
+    __session_release(session);
+    return sc;
+  }
+  config_journal_open(session);
+  return sc;
+}
 
 /**
  * @brief This function will initialize the variable needed for configuring the
  * target device then start it
  *
  * @param [in] target The network address of the target device
- * @return uint8_t
+ * @return sl_status_t
  */
-uint8_t device_configuration_config_session(uint16_t target_device,
-                                            uint16_t target_group,
-                                            uint8_t device_type,
-                                            uuid_128 dev_uuid) {
-  target_device_address = target_device;
-  target_group_address = target_group;
-  target_device_type = device_type;
-  current_dev_uuid = dev_uuid;
-  app_log("The target address is %2x\n", target_device_address);
+sl_status_t device_configuration_config_session(uint16_t target_device,
+                                                uint16_t target_group,
+                                                uint8_t device_type,
+                                                uuid_128 dev_uuid) {
+  return config_session_open(target_device, target_group, device_type,
+                             dev_uuid, false);
+}
 
-  return sl_btmesh_config_client_get_dcd(NETWORK_ID, target_device_address, 0,
-                                         NULL);
+sl_status_t device_configuration_update_pubs(uint16_t target_device,
+                                             uint16_t target_group,
+                                             uint8_t device_type,
+                                             uuid_128 dev_uuid) {
+  // One session is always left to the nodes being commissioned, the one
+  // finishing starts the next waiting node
+  if (device_configuration_get_active_count() >=
+      DEVICE_CONFIG_MAX_SESSIONS - 1) {
+    return SL_STATUS_NO_MORE_RESOURCE;
+  }
+  return config_session_open(target_device, target_group, device_type,
+                             dev_uuid, true);
 }
 
-/**
- * @brief This struct hold the config data for the last provisioned device
- *
- */
-typedef struct {
-  // model bindings to be done. for simplicity, all models are bound to same
-  // appkey in this example (assuming there is exactly one appkey used and the
-  // same appkey is used for all model bindings)
-  tsModel bind_model[MAX_ELEMS_PER_DEV * 6];
-  uint8_t num_bind;
-  uint8_t num_bind_done;
-
-  // publish addresses for up to 4 models
-  tsModel pub_model[MAX_ELEMS_PER_DEV * 6];
-  uint16_t pub_address[MAX_ELEMS_PER_DEV * 6];
-  uint8_t num_pub;
-  uint8_t num_pub_done;
-
-  // subscription addresses for up to 4 models
-  tsModel sub_model[MAX_ELEMS_PER_DEV * 6];
-  uint16_t sub_address[MAX_ELEMS_PER_DEV * 6];
-  uint8_t num_sub;
-  uint8_t num_sub_done;
+void device_configuration_resume(void) {
+  const tsConfigJournalEntry *entry;
+  tsConfigSession *session;
+  uint16_t address;
 
-} tsConfig;
+  for (uint8_t i = 0; i < DEVICE_CONFIG_MAX_SESSIONS; i++) {
+    entry = config_journal_get(i);
+    if (entry == NULL) {
+      continue;
+    }
 
-// config data to be sent to last provisioned node:
-tsConfig _sConfig;
+    if (sl_btmesh_prov_get_ddb_entry(entry->uuid, NULL, NULL, &address,
+                                     NULL) != SL_STATUS_OK ||
+        address != entry->address) {
+      app_log("Node %4.4x left the network, dropping its journal\n",
+              entry->address);
+      config_journal_end(i);
+      continue;
+    }
+
+    session = &_sSessions[i];
+    __session_arena_reset(session);
+    session->target_device_address = entry->address;
+    session->target_group_address = entry->group_address;
+    session->target_device_type = entry->device_type;
+    session->dev_uuid = entry->uuid;
+    session->dcd_retries_left = CONFIG_MAX_RETRIES;
+    session->resuming = true;
+
+    app_log("Resuming the configuration of %4.4x\n", entry->address);
+    if (config_dcd_fetch(session) != SL_STATUS_OK) {
+      // Tried again by the retry engine
+      config_dcd_retry(session);
+    }
+  }
+}
+
+uint16_t device_configuration_get_session_size(void) {
+  return sizeof(tsConfigSession);
+}
+
+uint16_t device_configuration_get_arena_peak(void) {
+  return _arenaPeak;
+}
+
+uint8_t device_configuration_get_active_count(void) {
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < DEVICE_CONFIG_MAX_SESSIONS; i++) {
+    if (_sSessions[i].target_device_address != 0) {
+      count++;
+    }
+  }
+  return count;
+}
+
+/*
+ * Add one command to the list of configurations to be done. A command already
+ * planned is not added twice, and a publication replaces the one already
+ * planned for the same model since a model only has one publish address.
+ * */
+static void config_cmd_add(tsConfigSession *session, uint8_t type,
+                           uint8_t element_index, uint16_t model_id,
+                           uint16_t vendor_id, uint16_t address) {
+  tsConfig *config = &session->config;
+  tsConfigCmd *cmd = NULL;
+
+  for (uint8_t i = 0; i < config->num_cmds; i++) {
+    if (config->cmds[i].type != type ||
+        config->cmds[i].element_index != element_index ||
+        config->cmds[i].model.model_id != model_id ||
+        config->cmds[i].model.vendor_id != vendor_id) {
+      continue;
+    }
+    if (type == CONFIG_CMD_PUB && config->cmds[i].address != address &&
+        config->cmds[i].state == CONFIG_CMD_PENDING) {
+      cmd = &config->cmds[i];
+      break;
+    }
+    if (config->cmds[i].address == address) {
+      return;
+    }
+  }
+
+  if (cmd == NULL) {
+    cmd = __session_arena_push_cmd(session);
+    if (cmd == NULL) {
+      app_log("ERROR: config arena full, %s model %4.4x dropped\r\n",
+              config_cmd_names[type], model_id);
+      return;
+    }
+  }
+
+  cmd->type = type;
+  cmd->state = CONFIG_CMD_PENDING;
+  cmd->element_index = element_index;
+  cmd->retries_left = CONFIG_MAX_RETRIES;
+  cmd->deadline = 0;
+  cmd->model.model_id = model_id;
+  cmd->model.vendor_id = vendor_id;
+  cmd->address = address;
+}
 
 /*
- * Add one publication setting to the list of configurations to be done
+ * Plan the configuration of one element: each SIG model is looked up in the
+ * plan table of the device type
  * */
-static void config_pub_add(uint16_t model_id, uint16_t vendor_id,
-                           uint16_t address) {
-  _sConfig.pub_model[_sConfig.num_pub].model_id = model_id;
-  _sConfig.pub_model[_sConfig.num_pub].vendor_id = vendor_id;
-  _sConfig.pub_address[_sConfig.num_pub] = address;
-  _sConfig.num_pub++;
-  app_log("Add pub num\nCurent done num = %d\nTarget address %x\nTotal = %d\n",
-          _sConfig.num_pub_done, address, _sConfig.num_pub);
+static void config_check(tsConfigSession *session, uint8_t element_index,
+                         const tsDcdElementView *elem) {
+  tsConfig *config = &session->config;
+  uint16_t group_address = session->target_group_address;
+  const tsConfigPlanEntry *plan;
+  uint16_t model_id;
+  uint8_t actions;
+
+  app_log("Config check of node %4.4x, device type id %d, elem index %d\n",
+          session->target_device_address, session->target_device_type,
+          element_index);
+
+  for (uint8_t j = 0; j < elem->numSIGModels; j++) {
+    model_id = elem->SIG_models[j];
+    plan = config_plan_lookup(session->target_device_type, model_id);
+    if (plan == NULL) {
+      continue;
+    }
+    actions = session->pub_only ? (plan->actions & CONFIG_PLAN_PUB)
+                                : plan->actions;
+
+    if (actions & CONFIG_PLAN_BIND) {
+      config_cmd_add(session, CONFIG_CMD_BIND, element_index, model_id, 0xFFFF,
+                     0);
+    }
+    if (actions & CONFIG_PLAN_PUB) {
+      config_cmd_add(session, CONFIG_CMD_PUB, element_index, model_id, 0xFFFF,
+                     config_plan_address(plan->pub_address, group_address));
+    }
+    if (actions & CONFIG_PLAN_SUB) {
+      for (uint8_t k = 0; k < plan->num_subs; k++) {
+        config_cmd_add(
+            session, CONFIG_CMD_SUB, element_index, model_id, 0xFFFF,
+            config_plan_address(plan->sub_addresses[k], group_address));
+      }
+    }
+    if (actions & CONFIG_PLAN_HEARTBEAT) {
+      session->need_to_set_heartbeat_pub = 1;
+    }
+  }
+
+  app_log("Config commands total = %d, window = %d\n", config->num_cmds,
+          DEVICE_CONFIG_WINDOW_SIZE);
 }
 
 /*
- * Add one subscription setting to the list of configurations to be done
+ * Plan the elements of the DCD decoded since the last call
  * */
-static void config_sub_add(uint16_t model_id, uint16_t vendor_id,
-                           uint16_t address) {
-  _sConfig.sub_model[_sConfig.num_sub].model_id = model_id;
-  _sConfig.sub_model[_sConfig.num_sub].vendor_id = vendor_id;
-  _sConfig.sub_address[_sConfig.num_sub] = address;
-  _sConfig.num_sub++;
-  app_log("Add sub num\nCurent done num = %d\nTarget_address %x\nTotal = %d\n",
-          _sConfig.num_sub_done, address, _sConfig.num_pub);
+static void config_plan_elements(tsConfigSession *session) {
+  tsDcdElementView elem;
+
+  while (session->planned_elements < session->dcd.number_of_elements) {
+    session->planned_offset = dcd_composition_get_element(
+        &session->dcd, session->planned_offset, &elem);
+    config_check(session, session->planned_elements, &elem);
+    session->planned_elements++;
+  }
 }
 
 /*
- * Add one appkey/model bind setting to the list of configurations to be done
+ * Plan the node-wide steps once every element is planned: the GATT proxy of
+ * all nodes, and the heartbeat publication of the nodes whose plan asks for
+ * it. They go through the same window and retries as the model commands.
  * */
-static void config_bind_add(uint16_t model_id, uint16_t vendor_id) {
-  _sConfig.bind_model[_sConfig.num_bind].model_id = model_id;
-  _sConfig.bind_model[_sConfig.num_bind].vendor_id = vendor_id;
-  _sConfig.num_bind++;
-}
-
-uint8_t need_to_set_heartbeat_pub = 0;
-uint8_t need_to_set_heartbeat_sub = 0;
-
-// TODO Make this fucntion more flexible in stead of hard-coding
-
-static void config_check() {
-  app_log("--------------------------------------------\n");
-  app_log("Config check function\n");
-  app_log("Total number of elements: %d\n", number_of_elements);
-  app_log("Current device type id %d\n", target_device_type);
-  app_log("Current elem index %d\n", element_index);
-
-  memset(&_sConfig, 0, sizeof(_sConfig));
-  // scan the SIG models in the DCD data
-  if (target_device_type == TARGET_DEVICE_TYPE_NODE) {
-    for (int j = 0; j < _sDCD_Table[element_index].numSIGModels; j++) {
-      if (_sDCD_Table[element_index].SIG_models[j] != 0x0000) {
-        config_bind_add(_sDCD_Table[element_index].SIG_models[j], 0xFFFF);
-        config_pub_add(_sDCD_Table[element_index].SIG_models[j], 0xFFFF,
-                       target_group_address);
-        config_sub_add(_sDCD_Table[element_index].SIG_models[j], 0xFFFF,
-                       target_group_address);
-
-        if (need_to_set_heartbeat_pub < 1 &&
-            _sDCD_Table[element_index].SIG_models[j] == LIGHTNESS_SEVER_MODEL) {
-          need_to_set_heartbeat_pub = 1;
-        }
-      }
+static void config_plan_node(tsConfigSession *session) {
+  config_cmd_add(session, CONFIG_CMD_PROXY, 0, 0, 0xFFFF, 0);
+  if (session->need_to_set_heartbeat_pub > 0) {
+    config_cmd_add(session, CONFIG_CMD_HEARTBEAT, 0, 0, 0xFFFF,
+                   session->target_group_address);
+  }
+}
+
+/*
+ * Send one config request to the node
+ * */
+static sl_status_t config_cmd_send(tsConfigSession *session,
+                                   tsConfigCmd *cmd) {
+  sl_status_t retval = SL_STATUS_INVALID_PARAMETER;
+
+  switch (cmd->type) {
+    case CONFIG_CMD_BIND:
+      retval = sl_btmesh_config_client_bind_model(
+          NETWORK_ID, session->target_device_address, cmd->element_index,
+          cmd->model.vendor_id, cmd->model.model_id, APPKEY_INDEX,
+          &cmd->handle);
+      break;
+    case CONFIG_CMD_PUB:
+      retval = sl_btmesh_config_client_set_model_pub(
+          NETWORK_ID, session->target_device_address,
+          cmd->element_index, /* element index */
+          cmd->model.vendor_id, cmd->model.model_id, cmd->address,
+          APPKEY_INDEX,
+          0,  /* friendship credential flag */
+          ttl_tuner_get_pub_ttl(session->target_device_address),
+          0,  /* period = NONE */
+          0,  /* Publication retransmission count */
+          50, /* Publication retransmission interval */
+          &cmd->handle);
+      break;
+    case CONFIG_CMD_SUB:
+      retval = sl_btmesh_config_client_add_model_sub(
+          NETWORK_ID, session->target_device_address, cmd->element_index,
+          cmd->model.vendor_id, cmd->model.model_id, cmd->address,
+          &cmd->handle);
+      break;
+    case CONFIG_CMD_PROXY:
+      retval = sl_btmesh_config_client_set_gatt_proxy(
+          NETWORK_ID, session->target_device_address, 1, &cmd->handle);
+      break;
+    case CONFIG_CMD_HEARTBEAT:
+      retval = sl_btmesh_config_client_set_heartbeat_pub(
+          NETWORK_ID,
+          session->target_device_address,
+          cmd->address,  // Address the heartbeats are sent to
+          NETWORK_ID,
+          0xFF,  // Send indefinitely
+          TTL_TUNER_HEARTBEAT_PERIOD_LOG,
+          TTL_TUNER_HEARTBEAT_TTL,
+          0x0F,  // Features
+          &cmd->handle);
+      break;
+    default:
+      break;
+  }
+
+  app_log("%s %4.4x: model %4.4x in element %d -> %4.4x, result %lx\r\n",
+          config_cmd_names[cmd->type], session->target_device_address,
+          cmd->model.model_id, cmd->element_index, cmd->address, retval);
+  return retval;
+}
+
+/*
+ * Give up on the node: cancel what is still in flight and remove it from the
+ * device database so that it can be reset and provisioned again
+ * */
+static void config_failed(tsConfigSession *session) {
+  uint16_t address = session->target_device_address;
+  tsConfig *config = &session->config;
+
+  if (!session->dcd_complete && !session->dcd_backoff) {
+    sl_btmesh_config_client_cancel_request(session->dcd_handle);
+  }
+  for (uint8_t i = 0; i < config->num_cmds; i++) {
+    if (config->cmds[i].state == CONFIG_CMD_IN_FLIGHT) {
+      sl_btmesh_config_client_cancel_request(config->cmds[i].handle);
     }
-  } else if (target_device_type == TARGET_DEVICE_TYPE_GATEWAY) {
-    need_to_set_heartbeat_sub = 1;
-    target_group_address = LIGHT_GROUP_1;
-    for (int j = 0; j < _sDCD_Table[element_index].numSIGModels; j++) {
-      if (_sDCD_Table[element_index].SIG_models[j] != 0x0000) {
-        config_bind_add(_sDCD_Table[element_index].SIG_models[j], 0xFFFF);
-        config_pub_add(_sDCD_Table[element_index].SIG_models[j], 0xFFFF,
-                       target_group_address);
-        config_sub_add(_sDCD_Table[element_index].SIG_models[j], 0xFFFF,
-                       target_group_address);
-      }
+  }
+
+  // The node keeps the publications it had, they are tried again later
+  if (session->pub_only) {
+    app_log("Publications of %4.4x not updated\n", address);
+    __session_release(session);
+    return;
+  }
+
+  status_indicator_on_failed();
+  app_log(
+      "Configuration of %4.4x failed\nRemoving dev from entry "
+      "table\nReset the device to re-provisioning\n",
+      address);
+  sl_btmesh_prov_delete_ddb_entry(session->dev_uuid);
+  node_db_remove(&session->dev_uuid);
+  config_journal_end(__session_slot(session));
+  __session_release(session);
+  device_config_configuration_on_failed_callback(address);
+}
+
+/*
+ * Every step is acknowledged, proxy and heartbeat publication included:
+ * record the node in the node database and report the success. A session
+ * updating the publications only records the new TTL.
+ * */
+static void config_complete(tsConfigSession *session) {
+  uint16_t address = session->target_device_address;
+  const tsNodeRecord *previous = node_db_find_by_address(address);
+  tsNodeRecord record;
+
+  if (session->pub_only) {
+    if (previous != NULL) {
+      record = *previous;
+      record.pub_ttl = ttl_tuner_get_pub_ttl(address);
+      node_db_store(&record);
     }
-    target_group_address = LIGHT_GROUP_2;
-    for (int j = 0; j < _sDCD_Table[element_index].numSIGModels; j++) {
-      if (_sDCD_Table[element_index].SIG_models[j] != 0x0000) {
-        config_pub_add(_sDCD_Table[element_index].SIG_models[j], 0xFFFF,
-                       target_group_address);
-        config_sub_add(_sDCD_Table[element_index].SIG_models[j], 0xFFFF,
-                       target_group_address);
-      }
+    app_log("Publications of %4.4x updated\r\n", address);
+    __session_release(session);
+    return;
+  }
+
+  app_log("***\r\nconfiguration of %4.4x complete\r\n***\r\n", address);
+
+  stage_latency_mark(&session->dev_uuid, STAGE_LATENCY_PROXY_HEARTBEAT_SET);
+
+  memset(&record, 0, sizeof(record));
+  record.address = address;
+  record.uuid = session->dev_uuid;
+  record.device_type = session->target_device_type;
+  record.number_of_elements = session->dcd.number_of_elements;
+  record.num_cmds = session->config.num_cmds;
+  record.group_address = session->target_group_address;
+  record.plan_hash = config_plan_get_hash();
+  record.dcd_hash = dcd_composition_hash(&session->dcd);
+  record.hops = (previous != NULL) ? previous->hops : 0;
+  record.pub_ttl = ttl_tuner_get_pub_ttl(address);
+  node_db_store(&record);
+  config_journal_end(__session_slot(session));
+
+  __session_release(session);
+  device_config_configuration_on_success_callback(address);
+}
+
+/*
+ * Put a failed command in backoff until its retry time.
+ * Return false if it has no retry left and the session was given up.
+ * */
+static bool config_cmd_retry(tsConfigSession *session, tsConfigCmd *cmd) {
+  if (cmd->retries_left == 0) {
+    config_failed(session);
+    return false;
+  }
+
+  cmd->state = CONFIG_CMD_BACKOFF;
+  cmd->deadline = retry_engine_now_ms() +
+                  retry_engine_backoff_ms(CONFIG_MAX_RETRIES -
+                                          cmd->retries_left);
+  cmd->retries_left--;
+  retry_engine_wake_at(cmd->deadline);
+  return true;
+}
+
+/*
+ * Same for the DCD request
+ * */
+static bool config_dcd_retry(tsConfigSession *session) {
+  if (session->dcd_retries_left == 0) {
+    config_failed(session);
+    return false;
+  }
+
+  session->dcd_backoff = true;
+  session->dcd_deadline =
+      retry_engine_now_ms() +
+      retry_engine_backoff_ms(CONFIG_MAX_RETRIES - session->dcd_retries_left);
+  session->dcd_retries_left--;
+  retry_engine_wake_at(session->dcd_deadline);
+  return true;
+}
+
+/*
+ * Check that every bind, pub and sub of the session is acknowledged
+ * */
+static bool config_models_done(const tsConfig *config) {
+  for (uint8_t i = 0; i < config->num_cmds; i++) {
+    if (config->cmds[i].type < CONFIG_CMD_PROXY &&
+        config->cmds[i].state != CONFIG_CMD_DONE) {
+      return false;
     }
   }
+  return true;
+}
+
+/*
+ * Send pending commands of the session until the window is full.
+ * Return false if the session had to be given up.
+ * */
+static bool config_pump(tsConfigSession *session) {
+  tsConfig *config = &session->config;
+  tsConfigCmd *cmd;
+  sl_status_t retval;
 
-  _sConfig.num_bind_done = 0;
-  _sConfig.num_pub_done = 0;
-  _sConfig.num_sub_done = 0;
+  if (session->resuming) {
+    return true;
+  }
 
-  target_device_type = TARGET_DEVICE_TYPE_NODE;
+  while (config->next_pending < config->num_cmds &&
+         config->num_in_flight < DEVICE_CONFIG_WINDOW_SIZE) {
+    cmd = &config->cmds[config->next_pending];
+    if (cmd->state != CONFIG_CMD_PENDING) {
+      config->next_pending++;
+      continue;
+    }
+    // The node-wide steps are planned last, they wait for the models
+    if (cmd->type >= CONFIG_CMD_PROXY && !config_models_done(config)) {
+      break;
+    }
+
+    retval = config_cmd_send(session, cmd);
+    if (retval == SL_STATUS_OK) {
+      cmd->state = CONFIG_CMD_IN_FLIGHT;
+      cmd->deadline = retry_engine_now_ms() + RETRY_ENGINE_REQUEST_TIMEOUT_MS;
+      retry_engine_wake_at(cmd->deadline);
+      config->num_in_flight++;
+      config->next_pending++;
+    } else if (retval == SL_STATUS_NO_MORE_RESOURCE &&
+               config->num_in_flight > 0) {
+      // The stack is out of buffers, try again when a status comes back
+      break;
+    } else if (!config_cmd_retry(session, cmd)) {
+      return false;
+    } else if (retval == SL_STATUS_NO_MORE_RESOURCE) {
+      break;
+    }
+  }
+  return true;
+}
+
+/*
+ * Refill the window of every session, a completed request may have freed
+ * stack resources another node was waiting for
+ * */
+static void config_pump_all(void) {
+  for (uint8_t i = 0; i < DEVICE_CONFIG_MAX_SESSIONS; i++) {
+    if (_sSessions[i].target_device_address != 0 &&
+        _sSessions[i].config.num_cmds > 0) {
+      config_pump(&_sSessions[i]);
+    }
+  }
+}
+
+/*
+ * Hash of the planned requests, the same DCD and plan table always give the
+ * same steps in the same order
+ * */
+static uint32_t config_plan_check(const tsConfig *config) {
+  uint32_t hash = 2166136261u;
+  const tsConfigCmd *cmd;
+
+  for (uint8_t i = 0; i < config->num_cmds; i++) {
+    cmd = &config->cmds[i];
+    hash = (hash ^ cmd->type) * 16777619u;
+    hash = (hash ^ cmd->element_index) * 16777619u;
+    hash = (hash ^ cmd->model.model_id) * 16777619u;
+    hash = (hash ^ cmd->model.vendor_id) * 16777619u;
+    hash = (hash ^ cmd->address) * 16777619u;
+  }
+  return hash;
+}
+
+/*
+ * Record the complete plan in the journal. A session resumed after a reset
+ * skips the steps acknowledged before it, if the plan did not change.
+ * */
+static void config_journal_plan(tsConfigSession *session) {
+  tsConfig *config = &session->config;
+  uint8_t slot = __session_slot(session);
+  bool same_plan = config_journal_set_plan(slot, config->num_cmds,
+                                           config_plan_check(config));
+
+  session->plan_journaled = true;
+  if (!session->resuming) {
+    return;
+  }
+  session->resuming = false;
+
+  if (!same_plan) {
+    app_log("Plan of %4.4x changed since the reset, starting over\r\n",
+            session->target_device_address);
+    return;
+  }
+
+  for (uint8_t i = 0; i < config->num_cmds; i++) {
+    if (config_journal_is_acked(slot, i)) {
+      config->cmds[i].state = CONFIG_CMD_DONE;
+      config->num_done++;
+    }
+  }
+  app_log("Resuming %4.4x, %d/%d steps already acknowledged\r\n",
+          session->target_device_address, config->num_done, config->num_cmds);
+}
+
+/*
+ * Mark the latency stage of each command type whose commands are all done.
+ * Only meaningful once the DCD is complete, no command is planned after that.
+ * */
+static void config_mark_stages(tsConfigSession *session) {
+  const tsConfig *config = &session->config;
+  uint8_t planned = 0;
+  uint8_t pending = 0;
+
+  for (uint8_t i = 0; i < config->num_cmds; i++) {
+    planned |= 1 << config->cmds[i].type;
+    if (config->cmds[i].state != CONFIG_CMD_DONE) {
+      pending |= 1 << config->cmds[i].type;
+    }
+  }
+  for (uint8_t type = CONFIG_CMD_BIND; type <= CONFIG_CMD_SUB; type++) {
+    if ((planned & ~pending) & (1 << type)) {
+      stage_latency_mark(&session->dev_uuid, STAGE_LATENCY_BIND_DONE + type);
+    }
+  }
+}
+
+/*
+ * Plan the configuration from the decoded DCD and start sending it
+ * */
+static void config_start(tsConfigSession *session) {
+  if (session->dcd_complete && !session->plan_journaled && session->pub_only) {
+    // Nothing to resume after a reset, the TTL is checked again anyway
+    session->plan_journaled = true;
+  } else if (session->dcd_complete && !session->plan_journaled) {
+    stage_latency_mark(&session->dev_uuid, STAGE_LATENCY_DCD_RECEIVED);
+    config_plan_node(session);
+    config_journal_plan(session);
+    config_mark_stages(session);
+  }
+
+  if (session->dcd_complete &&
+      session->config.num_done == session->config.num_cmds) {
+    config_complete(session);
+  } else {
+    config_pump(session);
+  }
+}
+
+/*
+ * Check the result of a status event against the command type.
+ * Publish parameters rejected (0x1307) are accepted for publications and
+ * "not a subscribe model" (0x1308) for subscriptions.
+ * */
+static bool config_cmd_result_ok(const tsConfigCmd *cmd, uint16_t result) {
+  if (result == SL_STATUS_OK) {
+    return true;
+  }
+  if (cmd->type == CONFIG_CMD_PUB && result == 0x1307) {
+    return true;
+  }
+  if (cmd->type == CONFIG_CMD_SUB && result == 0x1308) {
+    return true;
+  }
+  return false;
+}
+
+/*
+ * Retire one in-flight command out of order when its status arrives
+ * */
+static void config_cmd_on_status(uint32_t handle, uint16_t result) {
+  tsConfigSession *session;
+  tsConfigCmd *cmd = __cmd_find_by_handle(handle, &session);
+  tsConfig *config;
+
+  if (cmd == NULL) {
+    return;
+  }
+  config = &session->config;
+  config->num_in_flight--;
+
+  if (config_cmd_result_ok(cmd, result)) {
+    cmd->state = CONFIG_CMD_DONE;
+    config->num_done++;
+    if (!session->pub_only) {
+      config_journal_ack(__session_slot(session), cmd - config->cmds);
+    }
+    app_log(" %s %4.4x model %4.4x OK (%d/%d)\r\n", config_cmd_names[cmd->type],
+            session->target_device_address, cmd->model.model_id,
+            config->num_done, config->num_cmds);
+    if (session->dcd_complete) {
+      config_mark_stages(session);
+    }
+  } else {
+    app_log(" %s %4.4x model %4.4x failed with code %x\r\n",
+            config_cmd_names[cmd->type], session->target_device_address,
+            cmd->model.model_id, result);
+    // Invalid publish parameters (0x1307) is not an answer to a bind or a
+    // sub, it is retried like the other errors and ends the session only once
+    // the retries are exhausted
+    if (!config_cmd_retry(session, cmd)) {
+      config_pump_all();
+      return;
+    }
+    app_log("Retrying in %lu ms\r\n",
+            cmd->deadline - retry_engine_now_ms());
+  }
+
+  if (session->dcd_complete && config->num_done == config->num_cmds) {
+    config_complete(session);
+  }
+  config_pump_all();
 }
 
-static uint8_t retries_left = 3;
 void device_config_handle_mesh_evt(sl_btmesh_msg_t *evt) {
   sl_btmesh_evt_config_client_dcd_data_t *pDCD;
-  uint16_t result;
-  sl_status_t retval;
-  uint16_t vendor_id, model_id, pub_address, sub_address;
+  const tsDcdCacheEntry *cached;
+  tsConfigSession *session;
+  bool header_done;
+
   switch (SL_BT_MSG_ID(evt->header)) {
     case sl_btmesh_evt_config_client_dcd_data_id:
       pDCD = &evt->data.evt_config_client_dcd_data;
+      session = __session_find_by_dcd_handle(pDCD->handle);
+      if (session == NULL || session->dcd_complete || session->dcd_backoff) {
+        break;
+      }
       app_log("DCD data event, received %u bytes\r\n", pDCD->data.len);
+      session->dcd_deadline =
+          retry_engine_now_ms() + RETRY_ENGINE_REQUEST_TIMEOUT_MS;
+
+      header_done = dcd_parser_header_done(&session->dcd_parser);
+      if (dcd_parser_feed(&session->dcd_parser, pDCD->data.data,
+                          pDCD->data.len) != DCD_PARSER_OK) {
+        config_failed(session);
+        break;
+      }
 
-      // copy the data into one large array. the data may come in multiple
-      // smaller pieces. the data is not decoded until all DCD events have been
-      // received (see below)
-      if ((_dcd_raw_len + pDCD->data.len) <= 256) {
-        memcpy(&(_dcd_raw[_dcd_raw_len]), pDCD->data.data, pDCD->data.len);
-        _dcd_raw_len += pDCD->data.len;
+      // Same product as a node seen before, no need to decode the rest
+      if (!header_done && dcd_parser_header_done(&session->dcd_parser)) {
+        cached = dcd_cache_find_by_header(&session->dcd, &session->dev_uuid);
+        if (cached != NULL) {
+          app_log("Product %4.4x:%4.4x already decoded\r\n",
+                  cached->comp.companyID, cached->comp.productID);
+          dcd_parser_skip(&session->dcd_parser);
+          if (!dcd_composition_copy(&session->dcd, &cached->comp)) {
+            config_failed(session);
+            break;
+          }
+          session->dcd_complete = true;
+          dcd_cache_print_stats();
+        }
       }
 
+      // Start configuring the elements already complete
+      config_plan_elements(session);
+      config_start(session);
       break;
     case sl_btmesh_evt_config_client_dcd_data_end_id:
-      app_log("DCD data end event. Decoding the data.\r\n");
-      // decode the DCD content
-      DCD_decode();
-
-      // check the desired configuration settings depending on what's in the DCD
-      config_check();
-
-      app_log("------------------------------------------------------------\n");
-      app_log("App bind done/total app bind = %d/%d\n", _sConfig.num_bind_done,
-              _sConfig.num_bind);
-      app_log("Model sub bind done/model sub bind total = %d/%d\n",
-              _sConfig.num_sub_done, _sConfig.num_sub);
-      app_log("Model pub bind done/model pub bind total = %d/%d\n",
-              _sConfig.num_pub_done, _sConfig.num_pub);
-      app_log(
-          "-----------------------------------------------------------\n\n");
-
-      model_id = _sConfig.bind_model[_sConfig.num_bind_done].model_id;
-      vendor_id = _sConfig.bind_model[_sConfig.num_bind_done].vendor_id;
-
-      app_log("Binding appkey index %x to model ID %x in elem %d", APPKEY_INDEX, model_id, element_index);
-      retval = sl_btmesh_config_client_bind_model(
-          NETWORK_ID, target_device_address, element_index, vendor_id, model_id,
-          APPKEY_INDEX, NULL);
+      session = __session_find_by_dcd_handle(
+          evt->data.evt_config_client_dcd_data_end.handle);
+      if (session == NULL || session->dcd_complete || session->dcd_backoff) {
+        break;
+      }
+
+      if (evt->data.evt_config_client_dcd_data_end.result != SL_STATUS_OK) {
+        app_log("DCD request of %4.4x failed, result %x\r\n",
+                session->target_device_address,
+                evt->data.evt_config_client_dcd_data_end.result);
+        config_dcd_retry(session);
+        break;
+      }
+
+      if (!dcd_parser_finish(&session->dcd_parser)) {
+        app_log("DCD of %4.4x incomplete or invalid\r\n",
+                session->target_device_address);
+        config_failed(session);
+        break;
+      }
+
+      app_log("DCD data end event, %d elements decoded.\r\n",
+              session->dcd.number_of_elements);
+      session->dcd_complete = true;
+      dcd_cache_store(&session->dcd, &session->dev_uuid);
+      dcd_cache_print_stats();
 
+      config_start(session);
       break;
     case sl_btmesh_evt_config_client_binding_status_id:
-      result = evt->data.evt_config_client_appkey_status.result;
-      if (result == SL_STATUS_OK) {
-        app_log(" bind complete\r\n");
-        _sConfig.num_bind_done++;
-
-        if (_sConfig.num_bind_done < _sConfig.num_bind) {
-          // take the next model from the list of models to be bound with
-          // application key. for simplicity, the same appkey is used for all
-          // models but it is possible to also use several appkeys
-          model_id = _sConfig.bind_model[_sConfig.num_bind_done].model_id;
-          vendor_id = _sConfig.bind_model[_sConfig.num_bind_done].vendor_id;
-
-          app_log("APP BIND, config %d/%d:: model %4.4x in element %d key index %x\r\n",
-                  _sConfig.num_bind_done + 1, _sConfig.num_bind, model_id, element_index,
-                  APPKEY_INDEX);
-
-          retval = sl_btmesh_config_client_bind_model(
-              NETWORK_ID, target_device_address, element_index, vendor_id,
-              model_id, APPKEY_INDEX, NULL);
-          if (retval == SL_STATUS_OK) {
-            app_log("Binding model 0x%4.4x\r\n", model_id);
-          } else {
-            app_log("Binding model %x, error: %lx\r\n", model_id, retval);
-          }
-        } else {
-          retries_left = 3;
-          // get the next model/address pair from the configuration list:
-          model_id = _sConfig.pub_model[_sConfig.num_pub_done].model_id;
-          vendor_id = _sConfig.pub_model[_sConfig.num_pub_done].vendor_id;
-          pub_address = _sConfig.pub_address[_sConfig.num_pub_done];
-
-          app_log("PUB SET, config %d/%d: model %4.4x in element %d-> address %4.4x\r\n",
-                  _sConfig.num_pub_done + 1, _sConfig.num_pub, model_id, element_index,
-                  pub_address);
-
-          retval = sl_btmesh_config_client_set_model_pub(
-              NETWORK_ID, target_device_address,
-              element_index, /* element index */
-              vendor_id, model_id, pub_address, APPKEY_INDEX,
-              0,  /* friendship credential flag */
-              3,  /* Publication time-to-live value */
-              0,  /* period = NONE */
-              0,  /* Publication retransmission count */
-              50, /* Publication retransmission interval */
-              NULL);
-
-          if (retval == SL_STATUS_OK) {
-            app_log(" waiting pub ack\r\n");
-          }
-        }
-      } else {
-        app_log(" appkey bind failed with code %x\r\n", result);
-        if (retries_left > 0 && result != 0x1307) {
-          app_log("Retrying...");
-
-          model_id = _sConfig.bind_model[_sConfig.num_bind_done].model_id;
-          vendor_id = _sConfig.bind_model[_sConfig.num_bind_done].vendor_id;
-
-          app_log("APP BIND, config %d/%d:: model %4.4x key index %x\r\n",
-                  _sConfig.num_bind_done + 1, _sConfig.num_bind, model_id,
-                  APPKEY_INDEX);
-
-          retval = sl_btmesh_config_client_bind_model(
-              NETWORK_ID, target_device_address, element_index, vendor_id,
-              model_id, APPKEY_INDEX, NULL);
-          if (retval == SL_STATUS_OK) {
-            app_log("Binding model 0x%4.4x\r\n", model_id);
-          } else {
-            app_log("Binding model %x, error: %lx\r\n", model_id, retval);
-          }
-          retries_left--;
-        } else {
-          status_indicator_on_failed();
-          app_log(
-              "Failed when binding appkey to model\nRemoving dev from entry "
-              "table\nReset the device to re-provisioning\n");
-          sl_btmesh_prov_delete_ddb_entry(current_dev_uuid);
-        }
-      }
+      config_cmd_on_status(evt->data.evt_config_client_binding_status.handle,
+                           evt->data.evt_config_client_binding_status.result);
       break;
     case sl_btmesh_evt_config_client_model_pub_status_id:
-      result = evt->data.evt_config_client_model_pub_status.result;
-      if (result == SL_STATUS_OK || result == 0x1307) {
-        app_log(" pub set OK\r\n");
-        _sConfig.num_pub_done++;
-
-        if (_sConfig.num_pub_done < _sConfig.num_pub) {
-          /* more publication settings to be done
-          ** get the next model/address pair from the configuration list: */
-          model_id = _sConfig.pub_model[_sConfig.num_pub_done].model_id;
-          vendor_id = _sConfig.pub_model[_sConfig.num_pub_done].vendor_id;
-          pub_address = _sConfig.pub_address[_sConfig.num_pub_done];
-
-          app_log("PUB SET, config %d/%d: model %4.4x -> address %4.4x\r\n",
-                  _sConfig.num_pub_done + 1, _sConfig.num_pub, model_id,
-                  pub_address);
-
-          retval = sl_btmesh_config_client_set_model_pub(
-              NETWORK_ID, target_device_address,
-              element_index, /* element index */
-              vendor_id, model_id, pub_address, APPKEY_INDEX,
-              0,  /* friendship credential flag */
-              3,  /* Publication time-to-live value */
-              0,  /* period = NONE */
-              0,  /* Publication retransmission count */
-              50, /* Publication retransmission interval */
-              NULL);
-        } else {
-          retries_left = 3;
-          // move to next step which is configuring subscription settings
-          // get the next model/address pair from the configuration list:
-          model_id = _sConfig.sub_model[_sConfig.num_sub_done].model_id;
-          vendor_id = _sConfig.sub_model[_sConfig.num_sub_done].vendor_id;
-          sub_address = _sConfig.sub_address[_sConfig.num_sub_done];
-
-          app_log("SUB ADD, config %d/%d: model %4.4x -> address %4.4x\r\n",
-                  _sConfig.num_sub_done + 1, _sConfig.num_sub, model_id,
-                  sub_address);
-
-          retval = sl_btmesh_config_client_add_model_sub(
-              NETWORK_ID, target_device_address, element_index, vendor_id,
-              model_id, sub_address, NULL);
-
-          if (retval == SL_STATUS_OK) {
-            app_log(" waiting sub ack\r\n");
-          }
-        }
-      } else {
-        app_log(" pub set failed with code %x\r\n", result);
-        if (retries_left > 0 && result != 0x1307) {
-          app_log("Retrying...");
-          model_id = _sConfig.pub_model[_sConfig.num_pub_done].model_id;
-          vendor_id = _sConfig.pub_model[_sConfig.num_pub_done].vendor_id;
-          pub_address = _sConfig.pub_address[_sConfig.num_pub_done];
-
-          app_log("PUB SET, config %d/%d: model %4.4x -> address %4.4x\r\n",
-                  _sConfig.num_pub_done + 1, _sConfig.num_pub, model_id,
-                  pub_address);
-
-          retval = sl_btmesh_config_client_set_model_pub(
-              NETWORK_ID, target_device_address,
-              element_index, /* element index */
-              vendor_id, model_id, pub_address, APPKEY_INDEX,
-              0,  /* friendship credential flag */
-              3,  /* Publication time-to-live value */
-              0,  /* period = NONE */
-              0,  /* Publication retransmission count */
-              50, /* Publication retransmission interval */
-              NULL);
-          retries_left--;
-        } else {
-          status_indicator_on_failed();
-          app_log(
-              "Model pub set retries all failed\nRemoving dev from entry "
-              "table\nReset the device to re-provisioning\n");
-          sl_btmesh_prov_delete_ddb_entry(current_dev_uuid);
-        }
-      }
+      config_cmd_on_status(evt->data.evt_config_client_model_pub_status.handle,
+                           evt->data.evt_config_client_model_pub_status.result);
       break;
     case sl_btmesh_evt_config_client_model_sub_status_id:
-      result = evt->data.evt_config_client_model_sub_status.result;
-      if (result == SL_STATUS_OK || result == 0x1308) {
-        app_log(" sub add OK\r\n");
-        _sConfig.num_sub_done++;
-        if (_sConfig.num_sub_done < _sConfig.num_sub) {
-          // move to next step which is configuring subscription settings
-          // get the next model/address pair from the configuration list:
-          model_id = _sConfig.sub_model[_sConfig.num_sub_done].model_id;
-          vendor_id = _sConfig.sub_model[_sConfig.num_sub_done].vendor_id;
-          sub_address = _sConfig.sub_address[_sConfig.num_sub_done];
-
-          app_log("SUB ADD, config %d/%d: model %4.4x -> address %4.4x\r\n",
-                  _sConfig.num_sub_done + 1, _sConfig.num_sub, model_id,
-                  sub_address);
-
-          retval = sl_btmesh_config_client_add_model_sub(
-              NETWORK_ID, target_device_address, element_index, vendor_id,
-              model_id, sub_address, NULL);
-
-          if (retval == SL_STATUS_OK) {
-            app_log(" waiting sub ack\r\n");
-          }
-        } else {
-          app_log("***\r\nconfiguration complete\r\n***\r\n");
-          _dcd_raw_len = 0;
-
-          if (element_index < number_of_elements - 1) {
-            app_log("Handling the second elements\n");
-            element_index++;
-            config_check();
-
-            model_id = _sConfig.bind_model[_sConfig.num_bind_done].model_id;
-            vendor_id = _sConfig.bind_model[_sConfig.num_bind_done].vendor_id;
-
-            app_log("Binding appkey index %x to model ID %x", APPKEY_INDEX,
-                    model_id);
-
-            result = sl_btmesh_config_client_bind_model(
-                NETWORK_ID, target_device_address, element_index, vendor_id,
-                model_id, APPKEY_INDEX, NULL);
-          } else {
-            device_config_configuration_on_success_callback();
-
-            // Setting gatt_proxy on for all node
-            app_log("Turning on the gatt_proxy\n");
-            result = sl_btmesh_config_client_set_gatt_proxy(
-                NETWORK_ID, target_device_address, 1, NULL);
-
-            if (result != SL_STATUS_OK) {
-              app_log("Failed to set gatt_proxy on node, code %x\n", result);
-            }
-
-            if (need_to_set_heartbeat_pub > 0) {
-              app_log(
-                  "Sending command to set the heartbeat pub for the node\n");
-              result = sl_btmesh_config_client_set_heartbeat_pub(
-                  NETWORK_ID, 
-                  target_device_address, // Client to set
-                  target_group_address, // Address the message to be sent to
-                  NETWORK_ID, 
-                  0xFF, // Send indefinitely
-                  3, // period_log 2^2 = 4s
-                  5, // ttl
-                  0x0F, // Features
-                  NULL);
-
-              if (result != SL_STATUS_OK) {
-                app_log("Command sending failed, code %x\n", result);
-              } else {
-                app_log("Heartbeat pub command success\n");
-              }
-
-              need_to_set_heartbeat_pub = 0;
-            }
-          }
-          element_index = 0;
-          number_of_elements = 1;
-        }
-      } else {
-        app_log(" sub add failed with code %x\r\n", result);
-        if (retries_left > 0 && result != 0x1307) {
-          model_id = _sConfig.sub_model[_sConfig.num_sub_done].model_id;
-          vendor_id = _sConfig.sub_model[_sConfig.num_sub_done].vendor_id;
-          sub_address = _sConfig.sub_address[_sConfig.num_sub_done];
-
-          app_log("SUB ADD, config %d/%d: model %4.4x -> address %4.4x\r\n",
-                  _sConfig.num_sub_done + 1, _sConfig.num_sub, model_id,
-                  sub_address);
-
-          retval = sl_btmesh_config_client_add_model_sub(
-              NETWORK_ID, target_device_address, element_index, vendor_id,
-              model_id, sub_address, NULL);
-
-          if (retval == SL_STATUS_OK) {
-            app_log(" waiting sub ack\r\n");
-          }
-
-          retries_left--;
-        } else {
-          status_indicator_on_failed();
-          app_log(
-              "Model sub bind retries all failed\nRemoving dev from entry "
-              "table\nReset the device to re-provisioning\n");
-          sl_btmesh_prov_delete_ddb_entry(current_dev_uuid);
-        }
-      }
+      config_cmd_on_status(evt->data.evt_config_client_model_sub_status.handle,
+                           evt->data.evt_config_client_model_sub_status.result);
       break;
     case sl_btmesh_evt_config_client_gatt_proxy_status_id:
-      result = evt->data.evt_config_client_gatt_proxy_status.result;
-      if (result != SL_STATUS_OK) {
-        app_log("Device respond failed when turning on gatt proxy\n");
-      } else {
-        app_log("Turned on gatt_proxy on node\n");
-      }
+      config_cmd_on_status(
+          evt->data.evt_config_client_gatt_proxy_status.handle,
+          evt->data.evt_config_client_gatt_proxy_status.result);
       break;
     case sl_btmesh_evt_config_client_heartbeat_pub_status_id:
-      result = evt->data.evt_config_client_heartbeat_pub_status.result;
-      if (result != SL_STATUS_OK) {
-        app_log("Device respond: set heartbeat publish failed\n");
-      } else {
-        app_log("Device respond: set heartbeat publish successfully\n");
-      }
+      config_cmd_on_status(
+          evt->data.evt_config_client_heartbeat_pub_status.handle,
+          evt->data.evt_config_client_heartbeat_pub_status.result);
+      break;
     default:
       break;
   }
 }
 
+/*
+ * Check the deadlines of one session: cancel the requests that got no status
+ * in time and send again the ones whose backoff is over
+ * */
+static bool config_session_tick(tsConfigSession *session, uint32_t now) {
+  tsConfig *config = &session->config;
+  tsConfigCmd *cmd;
+
+  if (!session->dcd_complete &&
+      retry_engine_is_due(session->dcd_deadline, now)) {
+    if (!session->dcd_backoff) {
+      app_log("DCD request of %4.4x timed out\r\n",
+              session->target_device_address);
+      retry_engine_count_timeout();
+      sl_btmesh_config_client_cancel_request(session->dcd_handle);
+      if (!config_dcd_retry(session)) {
+        return false;
+      }
+    } else if (!retry_engine_take_budget()) {
+      session->dcd_deadline = now + RETRY_ENGINE_BUDGET_REFILL_MS;
+    } else if (config_dcd_fetch(session) != SL_STATUS_OK &&
+               !config_dcd_retry(session)) {
+      return false;
+    }
+  }
+
+  for (uint8_t i = 0; i < config->num_cmds; i++) {
+    cmd = &config->cmds[i];
+    if (!retry_engine_is_due(cmd->deadline, now)) {
+      continue;
+    }
+
+    if (cmd->state == CONFIG_CMD_IN_FLIGHT) {
+      app_log(" %s %4.4x model %4.4x timed out\r\n",
+              config_cmd_names[cmd->type], session->target_device_address,
+              cmd->model.model_id);
+      retry_engine_count_timeout();
+      sl_btmesh_config_client_cancel_request(cmd->handle);
+      config->num_in_flight--;
+      if (!config_cmd_retry(session, cmd)) {
+        return false;
+      }
+    } else if (cmd->state == CONFIG_CMD_BACKOFF) {
+      if (!retry_engine_take_budget()) {
+        cmd->deadline = now + RETRY_ENGINE_BUDGET_REFILL_MS;
+        continue;
+      }
+      cmd->state = CONFIG_CMD_PENDING;
+      if (config->next_pending > i) {
+        config->next_pending = i;
+      }
+    }
+  }
+  return true;
+}
+
+/*
+ * Arm the retry timer for the earliest deadline of the session
+ * */
+static void config_session_wake(tsConfigSession *session) {
+  tsConfig *config = &session->config;
+
+  if (!session->dcd_complete) {
+    retry_engine_wake_at(session->dcd_deadline);
+  }
+  for (uint8_t i = 0; i < config->num_cmds; i++) {
+    if (config->cmds[i].state == CONFIG_CMD_IN_FLIGHT ||
+        config->cmds[i].state == CONFIG_CMD_BACKOFF) {
+      retry_engine_wake_at(config->cmds[i].deadline);
+    }
+  }
+}
+
+void device_config_on_retry_tick(void) {
+  uint32_t now = retry_engine_now_ms();
+
+  for (uint8_t i = 0; i < DEVICE_CONFIG_MAX_SESSIONS; i++) {
+    if (_sSessions[i].target_device_address != 0) {
+      config_session_tick(&_sSessions[i], now);
+    }
+  }
+
+  config_pump_all();
+
+  for (uint8_t i = 0; i < DEVICE_CONFIG_MAX_SESSIONS; i++) {
+    if (_sSessions[i].target_device_address != 0) {
+      config_session_wake(&_sSessions[i]);
+    }
+  }
+}
+
 // NOTE I am considering adding one callback function
 // below to let the main program be able to do after the configuration process
 // complete Like proivsioning next device for example
-SL_WEAK void device_config_configuration_on_success_callback() {}
\ No newline at end of file
+SL_WEAK void device_config_configuration_on_success_callback(uint16_t address) {
+  (void)address;
+}
+
+SL_WEAK void device_config_configuration_on_failed_callback(uint16_t address) {
+  (void)address;
+}
@@ -3,74 +3,124 @@
 
 #include "sl_btmesh_api.h"
 
-// #include "bg_types.h"
+#include "DcdParser.h"
 
-// max number of SIG models in the DCD
-#define MAX_SIG_MODELS 10
+#define TARGET_DEVICE_TYPE_NODE 0x01
+#define TARGET_DEVICE_TYPE_GATEWAY 0x02
 
-// max number of vendor models in the DCD
-#define MAX_VENDOR_MODELS 4
+// The max number of nodes being configured at the same time
+#define DEVICE_CONFIG_MAX_SESSIONS 4
 
-// The max number of elements each device should support
-#define MAX_ELEMS_PER_DEV 2
+// Bytes each session decodes the DCD of its node and plans its config
+// requests in. The DCD grows from the bottom and the requests from the top,
+// so a node with many elements and few requests fits as well as the opposite,
+// e.g. 24 elements of 5 models with 60 requests.
+#ifndef DEVICE_CONFIG_ARENA_BYTES
+#define DEVICE_CONFIG_ARENA_BYTES 1536
+#endif
 
-#define TARGET_DEVICE_TYPE_NODE 0x01
-#define TARGET_DEVICE_TYPE_GATEWAY 0x02
+// The max number of config requests (bind, pub and sub) planned for a node,
+// the arena usually runs out first
+#define DEVICE_CONFIG_MAX_CMDS 96
+
+// The max number of config requests waiting for their status at the same
+// time for one node
+#define DEVICE_CONFIG_WINDOW_SIZE 4
 
 typedef struct {
   uint16_t model_id;
   uint16_t vendor_id;
 } tsModel;
 
-/* struct for storing the content of one element in the DCD */
-typedef struct {
-  uint16_t SIG_models[MAX_SIG_MODELS];
-  uint8_t numSIGModels;
+/**
+ * @brief Start configuring a node. Each node gets its own session so that
+ * several nodes can be configured at the same time.
+ *
+ * @param target_device The unicast address of the node
+ * @param target_group The group address the node models are configured to
+ * @param device_type TARGET_DEVICE_TYPE_NODE or TARGET_DEVICE_TYPE_GATEWAY
+ * @param dev_uuid The UUID of the node
+ * @return sl_status_t SL_STATUS_NO_MORE_RESOURCE if all sessions are busy,
+ * SL_STATUS_ALREADY_EXISTS if the node is being configured already
+ */
+sl_status_t device_configuration_config_session(uint16_t target_device,
+                                                uint16_t target_group,
+                                                uint8_t device_type,
+                                                uuid_128 dev_uuid);
 
-  tsModel vendor_models[MAX_VENDOR_MODELS];
-  uint8_t numVendorModels;
-} tsDCD_ElemContent;
+/**
+ * @brief Send again only the publications of a configured node, with the
+ * TTL given by ttl_tuner_get_pub_ttl. The rest of its configuration is left
+ * alone and the callbacks are not called, the record of the node gets the
+ * new TTL once every publication is acknowledged.
+ *
+ * @param target_device The unicast address of the node
+ * @param target_group The group address the node models are configured to
+ * @param device_type TARGET_DEVICE_TYPE_NODE or TARGET_DEVICE_TYPE_GATEWAY
+ * @param dev_uuid The UUID of the node
+ * @return sl_status_t SL_STATUS_NO_MORE_RESOURCE if less than two sessions
+ * are free, SL_STATUS_ALREADY_EXISTS if the node is being configured
+ */
+sl_status_t device_configuration_update_pubs(uint16_t target_device,
+                                             uint16_t target_group,
+                                             uint8_t device_type,
+                                             uuid_128 dev_uuid);
 
-/* this struct is used to help decoding the raw DCD data */
-typedef struct {
-  uint16_t companyID;
-  uint16_t productID;
-  uint16_t version;
-  uint16_t replayCap;
-  uint16_t featureBitmask;
-  uint8_t payload[1];
-} tsDCD_Header;
-
-/* this struct is used to help decoding the raw DCD data */
-typedef struct {
-  uint16_t location;
-  uint8_t numSIGModels;
-  uint8_t numVendorModels;
-  uint8_t payload[1];
-} tsDCD_Elem;
+/**
+ * @brief Resume the configurations left in the journal by a reset, from
+ * their first step not acknowledged. Call it once the stack is ready, before
+ * starting new configurations.
+ *
+ */
+void device_configuration_resume(void);
 
-void DCD_decode(void);
+/**
+ * @brief Get the number of nodes currently being configured
+ *
+ * @return uint8_t Number of busy sessions
+ */
+uint8_t device_configuration_get_active_count(void);
 
-void DCD_decode_element(tsDCD_Elem *pElem, tsDCD_ElemContent *pDest);
+/**
+ * @brief Get the RAM taken by one session, its arena included
+ *
+ */
+uint16_t device_configuration_get_session_size(void);
 
-uint8_t device_configuration_config_session(uint16_t target_device,
-                                            uint16_t target_group,
-                                            uint8_t device_type,
-                                            uuid_128 dev_uuid);
+/**
+ * @brief Get the most bytes of its arena a finished session used, to size
+ * DEVICE_CONFIG_ARENA_BYTES
+ *
+ */
+uint16_t device_configuration_get_arena_peak(void);
 
 void device_config_handle_mesh_evt(sl_btmesh_msg_t *evt);
 
+/**
+ * @brief Check the deadlines of the requests sent to the nodes, called when
+ * the retry timer expires
+ *
+ */
+void device_config_on_retry_tick(void);
+
 /**
  * @brief This is the prototype for the callback fucntion
  * User should self-define it.
  * This function will be called when the configuration press complete
  * successfully
  *
+ * @param address The unicast address of the configured node
  */
-void device_config_configuration_on_success_callback();
+void device_config_configuration_on_success_callback(uint16_t address);
 
-// Defines to avoid old code confict with elements table change.
-#define _sDCD_Prim _sDCD_Table[0]
-#define _sDCD_2nd _sDCD_Table[1]
+/**
+ * @brief This is the prototype for the callback fucntion
+ * User should self-define it.
+ * This function will be called when the configuration of a node is given up
+ * after all retries failed
+ *
+ * @param address The unicast address of the node
+ */
+void device_config_configuration_on_failed_callback(uint16_t address);
 
 #endif
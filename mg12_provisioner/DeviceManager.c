@@ -1,32 +1,290 @@
 #include "DeviceManager.h"
 
+#include <stddef.h>
 #include <string.h>
 
+#include "DeviceClass.h"
+#include "RetryEngine.h"
 #include "app_log.h"
+#include "sl_bt_api.h"
 #include "sl_btmesh_api.h"
+#include "sl_sleeptimer.h"
 
-#define MAX_PRESENT_DEVICE_NUMBER 12
+// Score given by each component on top of the one of the device class, a few
+// sightings are worth a better link by a few dB
+#define SCORE_PER_SIGHTING 4
+#define SCORE_MAX_SIGHTINGS 10
 
-#define DEVICE_FAMILY_CODE 0x02FF
+#if DEVICE_MANAGER_MAX_DEVICES > 254
+#error "DEVICE_MANAGER_MAX_DEVICES must fit the 8-bit slots of the index"
+#endif
+
+#if (DEVICE_MANAGER_HASH_SIZE & (DEVICE_MANAGER_HASH_SIZE - 1)) != 0 || \
+    DEVICE_MANAGER_HASH_SIZE < 2 * DEVICE_MANAGER_MAX_DEVICES
+#error "DEVICE_MANAGER_HASH_SIZE must be a power of two, twice the devices"
+#endif
+
+// Slot of an index pointing to no entry
+#define SLOT_EMPTY 0
+// Entry index of the lists pointing to no entry
+#define ENTRY_NONE 0xFF
 
 typedef struct device_entry {
   uuid_128 uuid;
   bd_addr add;
+  // Aging ticks left before the entry is dropped, reset by each beacon.
+  // 0 if the entry is free.
   int lifetime;
-  uint8_t same_family;
+  // Classified from the UUID by the first beacon
+  const device_class_t *device_class;
+  // Average RSSI of the beacons, in dBm
+  int8_t rssi;
+  uint8_t sightings;
+  // When its first beacon was seen, see retry_engine_now_ms
+  uint32_t first_seen_ms;
+  uint16_t score;
+  // Position in the priority queue
+  uint8_t heap_pos;
+  // Chains the free entries
+  uint8_t next;
 } device_entry_t;
 
+/**
+ * @brief Open addressing index over the device table with linear probing.
+ * A slot holds the entry index + 1, SLOT_EMPTY if unused.
+ *
+ */
+typedef struct device_index {
+  uint8_t slots[DEVICE_MANAGER_HASH_SIZE];
+  uint8_t key_offset;
+  uint8_t key_len;
+} device_index_t;
+
 typedef struct device_manager {
   uint8_t present_devices;
-  device_entry_t device_table[MAX_PRESENT_DEVICE_NUMBER];
+  device_entry_t device_table[DEVICE_MANAGER_MAX_DEVICES];
+  device_index_t by_address;
+  device_index_t by_uuid;
+  uint8_t first_free;
+  // Same family devices, max-heap on the score
+  uint8_t heap[DEVICE_MANAGER_MAX_DEVICES];
+  uint8_t heap_len;
+
+  sl_sleeptimer_timer_handle_t aging_timer;
+  uint32_t aged_out;
+  uint32_t evicted;
 } device_manager_t;
 
 static device_manager_t manager_instance;
 
+static const uint8_t *__entry_key(const device_index_t *index, uint8_t entry) {
+  return (const uint8_t *)&manager_instance.device_table[entry] +
+         index->key_offset;
+}
+
+/*
+ * FNV-1a of the key, reduced to a slot of the index
+ * */
+static uint16_t __hash(const uint8_t *key, uint8_t len) {
+  uint32_t hash = 2166136261u;
+
+  for (uint8_t i = 0; i < len; i++) {
+    hash ^= key[i];
+    hash *= 16777619u;
+  }
+  return (uint16_t)((hash ^ (hash >> 16)) & (DEVICE_MANAGER_HASH_SIZE - 1));
+}
+
+/**
+ * @brief Look a key up in an index
+ *
+ * @return uint8_t The entry index, ENTRY_NONE if the key is not present
+ */
+static uint8_t __index_find(const device_index_t *index, const uint8_t *key) {
+  uint16_t slot = __hash(key, index->key_len);
+
+  while (index->slots[slot] != SLOT_EMPTY) {
+    if (memcmp(__entry_key(index, index->slots[slot] - 1), key,
+               index->key_len) == 0) {
+      return index->slots[slot] - 1;
+    }
+    slot = (slot + 1) & (DEVICE_MANAGER_HASH_SIZE - 1);
+  }
+  return ENTRY_NONE;
+}
+
+static void __index_insert(device_index_t *index, uint8_t entry) {
+  uint16_t slot = __hash(__entry_key(index, entry), index->key_len);
+
+  while (index->slots[slot] != SLOT_EMPTY) {
+    slot = (slot + 1) & (DEVICE_MANAGER_HASH_SIZE - 1);
+  }
+  index->slots[slot] = entry + 1;
+}
+
+/*
+ * Remove an entry and shift back the ones probed past it, so that no
+ * tombstone is left and the lookups stay short under a steady beacon churn
+ * */
+static void __index_remove(device_index_t *index, uint8_t entry) {
+  const uint16_t mask = DEVICE_MANAGER_HASH_SIZE - 1;
+  uint16_t slot = __hash(__entry_key(index, entry), index->key_len);
+  uint16_t next;
+  uint16_t home;
+
+  while (index->slots[slot] != entry + 1) {
+    if (index->slots[slot] == SLOT_EMPTY) {
+      return;
+    }
+    slot = (slot + 1) & mask;
+  }
+
+  next = slot;
+  while (1) {
+    next = (next + 1) & mask;
+    if (index->slots[next] == SLOT_EMPTY) {
+      break;
+    }
+    home = __hash(__entry_key(index, index->slots[next] - 1), index->key_len);
+    // Move it back if its home slot is not between the hole and itself
+    if (((next - home) & mask) >= ((next - slot) & mask)) {
+      index->slots[slot] = index->slots[next];
+      slot = next;
+    }
+  }
+  index->slots[slot] = SLOT_EMPTY;
+}
+
+static uint16_t __device_score(const device_entry_t *device) {
+  uint16_t score = (uint16_t)(device->rssi + 128);
+  uint8_t sightings = device->sightings;
+
+  if (sightings > SCORE_MAX_SIGHTINGS) {
+    sightings = SCORE_MAX_SIGHTINGS;
+  }
+  score += sightings * SCORE_PER_SIGHTING;
+  score += device->device_class->score;
+  return score;
+}
+
+static bool __device_provisioned_by_us(const device_entry_t *device) {
+  return (device->device_class->flags & DEVICE_CLASS_FLAG_PROVISION) != 0;
+}
+
+static void __heap_set(uint8_t pos, uint8_t entry) {
+  manager_instance.heap[pos] = entry;
+  manager_instance.device_table[entry].heap_pos = pos;
+}
+
+static uint16_t __heap_score(uint8_t pos) {
+  return manager_instance.device_table[manager_instance.heap[pos]].score;
+}
+
+static void __heap_sift_up(uint8_t pos) {
+  uint8_t entry = manager_instance.heap[pos];
+  uint16_t score = manager_instance.device_table[entry].score;
+  uint8_t parent;
+
+  while (pos > 0) {
+    parent = (pos - 1) / 2;
+    if (__heap_score(parent) >= score) {
+      break;
+    }
+    __heap_set(pos, manager_instance.heap[parent]);
+    pos = parent;
+  }
+  __heap_set(pos, entry);
+}
+
+static void __heap_sift_down(uint8_t pos) {
+  uint8_t entry = manager_instance.heap[pos];
+  uint16_t score = manager_instance.device_table[entry].score;
+  uint8_t child;
+
+  while ((child = 2 * pos + 1) < manager_instance.heap_len) {
+    if (child + 1 < manager_instance.heap_len &&
+        __heap_score(child + 1) > __heap_score(child)) {
+      child++;
+    }
+    if (__heap_score(child) <= score) {
+      break;
+    }
+    __heap_set(pos, manager_instance.heap[child]);
+    pos = child;
+  }
+  __heap_set(pos, entry);
+}
+
+static void __heap_push(uint8_t entry) {
+  __heap_set(manager_instance.heap_len++, entry);
+  __heap_sift_up(manager_instance.heap_len - 1);
+}
+
+static void __heap_remove(uint8_t entry) {
+  uint8_t pos = manager_instance.device_table[entry].heap_pos;
+  uint8_t last = manager_instance.heap[--manager_instance.heap_len];
+
+  if (last == entry) {
+    return;
+  }
+  __heap_set(pos, last);
+  __heap_sift_up(pos);
+  __heap_sift_down(manager_instance.device_table[last].heap_pos);
+}
+
+/*
+ * Take a new sighting of the device into account and move it in the queue
+ * */
+static void __device_sighted(uint8_t entry, int8_t rssi) {
+  device_entry_t *device = &manager_instance.device_table[entry];
+
+  if (device->sightings == 0) {
+    device->rssi = rssi;
+  } else {
+    // Average over the last few beacons, a single fade does not count much
+    device->rssi = (int8_t)((3 * device->rssi + rssi) / 4);
+  }
+  device->lifetime = DEVICE_MANAGER_LIFETIME;
+  if (device->sightings < UINT8_MAX) {
+    device->sightings++;
+  }
+  device->score = __device_score(device);
+
+  if (__device_provisioned_by_us(device)) {
+    __heap_sift_up(device->heap_pos);
+    __heap_sift_down(device->heap_pos);
+  }
+}
+
+static void aging_timer_on_timeout(sl_sleeptimer_timer_handle_t *handle,
+                                   void *data) {
+  (void)handle;
+  (void)data;
+
+  // Runs in interrupt context, the aging is done in the event loop
+  if (manager_instance.present_devices > 0) {
+    sl_bt_external_signal(DEVICE_MANAGER_AGING_SIGNAL);
+  }
+}
+
 void device_manager_init() {
-  manager_instance.present_devices = 0;
-  memset(&manager_instance.device_table[0], 0,
-         sizeof(device_entry_t) * MAX_PRESENT_DEVICE_NUMBER);
+  memset(&manager_instance, 0, sizeof(manager_instance));
+
+  manager_instance.by_address.key_offset = offsetof(device_entry_t, add);
+  manager_instance.by_address.key_len = sizeof(bd_addr);
+  manager_instance.by_uuid.key_offset = offsetof(device_entry_t, uuid);
+  manager_instance.by_uuid.key_len = sizeof(uuid_128);
+
+  for (uint8_t i = 0; i < DEVICE_MANAGER_MAX_DEVICES; i++) {
+    manager_instance.device_table[i].next =
+        (i + 1 < DEVICE_MANAGER_MAX_DEVICES) ? i + 1 : ENTRY_NONE;
+  }
+  manager_instance.first_free = 0;
+
+  sl_sleeptimer_start_periodic_timer_ms(
+      &manager_instance.aging_timer, DEVICE_MANAGER_AGING_TICK_MS,
+      aging_timer_on_timeout, NULL, 0,
+      SL_SLEEPTIMER_NO_HIGH_PRECISION_HF_CLOCKS_REQUIRED_FLAG);
 }
 
 /**
@@ -37,75 +295,172 @@ void device_manager_init() {
  * @return If the device is present, return its current index in the table. If
  * not, return 0
  */
-uint8_t __device_present(const bd_addr *devAddr) {
-  for (int i = 0; i < MAX_PRESENT_DEVICE_NUMBER; i++) {
-    if ((devAddr->addr[0] == manager_instance.device_table[i].add.addr[0]) &&
-        (devAddr->addr[1] == manager_instance.device_table[i].add.addr[1]) &&
-        (devAddr->addr[2] == manager_instance.device_table[i].add.addr[2]) &&
-        (devAddr->addr[3] == manager_instance.device_table[i].add.addr[3]) &&
-        (devAddr->addr[4] == manager_instance.device_table[i].add.addr[4]) &&
-        (devAddr->addr[5] == manager_instance.device_table[i].add.addr[5]) &&
-        (manager_instance.device_table[i].lifetime > 0)) {
-      return i + 1;
+static uint8_t __device_present(const bd_addr *devAddr) {
+  uint8_t entry =
+      __index_find(&manager_instance.by_address, (const uint8_t *)devAddr);
+
+  return entry == ENTRY_NONE ? 0 : entry + 1;
+}
+
+static void __device_release(uint8_t entry) {
+  device_entry_t *device = &manager_instance.device_table[entry];
+
+  __index_remove(&manager_instance.by_address, entry);
+  __index_remove(&manager_instance.by_uuid, entry);
+  if (__device_provisioned_by_us(device)) {
+    __heap_remove(entry);
+  }
+
+  memset(device, 0, sizeof(*device));
+  device->next = manager_instance.first_free;
+  manager_instance.first_free = entry;
+  manager_instance.present_devices--;
+}
+
+/*
+ * Make room for a new device by dropping the least recently seen one,
+ * devices of another family go first.
+ * Return the entry freed, ENTRY_NONE if the table is empty.
+ * */
+static uint8_t __device_evict(void) {
+  const device_entry_t *device;
+  uint8_t oldest = ENTRY_NONE;
+  int oldest_key = 0;
+  int key;
+
+  for (uint8_t i = 0; i < DEVICE_MANAGER_MAX_DEVICES; i++) {
+    device = &manager_instance.device_table[i];
+    if (device->lifetime < 1) {
+      continue;
+    }
+    // Family first, the least recently seen one within it
+    key = __device_provisioned_by_us(device) * (DEVICE_MANAGER_LIFETIME + 1) +
+          device->lifetime;
+    if (oldest == ENTRY_NONE || key < oldest_key) {
+      oldest = i;
+      oldest_key = key;
     }
   }
 
-  return 0;
+  if (oldest == ENTRY_NONE) {
+    return ENTRY_NONE;
+  }
+  __device_release(oldest);
+  manager_instance.evicted++;
+  return manager_instance.first_free;
 }
 
-uint8_t device_manager_add_device(uuid_128 *devUUID, bd_addr *devAddr) {
-  uint8_t retval = __device_present(devAddr);
-  if (retval > 0) {
+uint8_t device_manager_add_device(uuid_128 *devUUID, bd_addr *devAddr,
+                                  int8_t rssi) {
+  device_entry_t *device;
+  uint8_t entry;
+
+  entry = __device_present(devAddr);
+  if (entry > 0) {
+    __device_sighted(entry - 1, rssi);
+    return DEVICE_MANAGER_DEVICE_PRESENTED;
+  }
+
+  // Same device beaconing from a new (private) address
+  entry = __index_find(&manager_instance.by_uuid, (const uint8_t *)devUUID);
+  if (entry != ENTRY_NONE) {
+    device = &manager_instance.device_table[entry];
+    __index_remove(&manager_instance.by_address, entry);
+    memcpy(&device->add, devAddr, sizeof(bd_addr));
+    __index_insert(&manager_instance.by_address, entry);
+    __device_sighted(entry, rssi);
     return DEVICE_MANAGER_DEVICE_PRESENTED;
   }
 
-  for (int i = 0; i < MAX_PRESENT_DEVICE_NUMBER; i++) {
-    if (manager_instance.device_table[i].lifetime < 1) {
-      memcpy(&manager_instance.device_table[i].uuid, devUUID, sizeof(uuid_128));
-      memcpy(&manager_instance.device_table[i].add, devAddr, sizeof(bd_addr));
-      manager_instance.present_devices++;
-      manager_instance.device_table[i].lifetime = 1;
-
-      if (devUUID->data[0] == 0x02 && devUUID->data[1] == 0xFF) {
-        manager_instance.device_table[i].same_family = 1;
-      }
-      app_log("Add sucessfully, ble address of %x:%x:%x:%x:%x:%x\n",
-              manager_instance.device_table[i].add.addr[5],
-              manager_instance.device_table[i].add.addr[4],
-              manager_instance.device_table[i].add.addr[3],
-              manager_instance.device_table[i].add.addr[2],
-              manager_instance.device_table[i].add.addr[1],
-              manager_instance.device_table[i].add.addr[0]);
-      return DEVICE_MANAGER_SUCCESS;
+  entry = manager_instance.first_free;
+  if (entry == ENTRY_NONE) {
+    entry = __device_evict();
+    if (entry == ENTRY_NONE) {
+      return DEVICE_MANAGER_TABLE_FLOW;
     }
   }
+  device = &manager_instance.device_table[entry];
+  manager_instance.first_free = device->next;
+
+  memcpy(&device->uuid, devUUID, sizeof(uuid_128));
+  memcpy(&device->add, devAddr, sizeof(bd_addr));
+  manager_instance.present_devices++;
+  __index_insert(&manager_instance.by_address, entry);
+  __index_insert(&manager_instance.by_uuid, entry);
+
+  device->first_seen_ms = retry_engine_now_ms();
+  device->device_class = device_class_lookup(devUUID);
+  if (__device_provisioned_by_us(device)) {
+    __heap_push(entry);
+  }
+  __device_sighted(entry, rssi);
 
-  return DEVICE_MANAGER_TABLE_FLOW;
+  app_log("Add sucessfully, ble address of %x:%x:%x:%x:%x:%x\n",
+          device->add.addr[5], device->add.addr[4], device->add.addr[3],
+          device->add.addr[2], device->add.addr[1], device->add.addr[0]);
+  return DEVICE_MANAGER_SUCCESS;
 }
 
 uint8_t device_manager_remove_device(const bd_addr *devAddr) {
   int device_index = __device_present(devAddr);
   if (device_index > 0) {
-    device_index -= 1;
-    manager_instance.device_table[device_index].lifetime = 0;
-    manager_instance.present_devices--;
+    __device_release(device_index - 1);
     return DEVICE_MANAGER_SUCCESS;
   } else {
     return DEVICE_MANAGER_DEVICE_NOT_FOUND;
   }
 }
 
-uint8_t device_manager_get_next_device(uuid_128 *id, bd_addr *add) {
-  for (uint8_t i = 0; i < MAX_PRESENT_DEVICE_NUMBER; i++) {
-    if (manager_instance.device_table[i].lifetime > 0 &&
-        manager_instance.device_table[i].same_family == 1) {
-      *id = manager_instance.device_table[i].uuid;
-      *add = manager_instance.device_table[i].add;
-      return DEVICE_MANAGER_SUCCESS;
-    }
+uint8_t device_manager_find_by_uuid(const uuid_128 *id, bd_addr *add) {
+  uint8_t entry =
+      __index_find(&manager_instance.by_uuid, (const uint8_t *)id);
+
+  if (entry == ENTRY_NONE) {
+    return DEVICE_MANAGER_DEVICE_NOT_FOUND;
+  }
+  *add = manager_instance.device_table[entry].add;
+  return DEVICE_MANAGER_SUCCESS;
+}
+
+uint8_t device_manager_get_first_seen(const bd_addr *add,
+                                      uint32_t *first_seen_ms) {
+  uint8_t entry = __device_present(add);
+
+  if (entry == 0) {
+    return DEVICE_MANAGER_DEVICE_NOT_FOUND;
+  }
+  *first_seen_ms = manager_instance.device_table[entry - 1].first_seen_ms;
+  return DEVICE_MANAGER_SUCCESS;
+}
+
+uint8_t device_manager_get_next_device(uuid_128 *id, bd_addr *add,
+                                       const device_class_t **device_class) {
+  uint8_t entry;
+
+  if (manager_instance.heap_len == 0) {
+    return DEVICE_MANAGER_DEVICE_NOT_FOUND;
   }
+  entry = manager_instance.heap[0];
 
-  return DEVICE_MANAGER_DEVICE_NOT_FOUND;
+  *id = manager_instance.device_table[entry].uuid;
+  *add = manager_instance.device_table[entry].add;
+  *device_class = manager_instance.device_table[entry].device_class;
+  return DEVICE_MANAGER_SUCCESS;
+}
+
+void device_manager_on_aging_tick(void) {
+  device_entry_t *device;
+
+  for (uint8_t i = 0; i < DEVICE_MANAGER_MAX_DEVICES; i++) {
+    device = &manager_instance.device_table[i];
+    if (device->lifetime < 1) {
+      continue;
+    }
+    if (--device->lifetime == 0) {
+      __device_release(i);
+      manager_instance.aged_out++;
+    }
+  }
 }
 
 uint8_t device_manager_get_device_count(uint8_t *count) {
@@ -115,15 +470,17 @@ uint8_t device_manager_get_device_count(uint8_t *count) {
 }
 
 void device_manager_print_list(void) {
-  uint8_t present_devices = manager_instance.present_devices;
+  const device_entry_t *device;
+
   app_log("Devices available for provisioning:\n");
-  for (uint8_t i = 0; i < MAX_PRESENT_DEVICE_NUMBER; i++) {
-    if (manager_instance.device_table[i].lifetime > 0 &&
-        manager_instance.device_table[i].same_family > 0) {
-      app_log("BLE Address: %x:%x:%x\n",
-              manager_instance.device_table[i].add.addr[5],
-              manager_instance.device_table[i].add.addr[4],
-              manager_instance.device_table[i].add.addr[3]);
-    }
+  for (uint8_t i = 0; i < manager_instance.heap_len; i++) {
+    device = &manager_instance.device_table[manager_instance.heap[i]];
+    app_log("BLE Address: %x:%x:%x, %s rev %u, score %u (rssi %d, seen %u)\n",
+            device->add.addr[5], device->add.addr[4], device->add.addr[3],
+            device->device_class->name, mesh_uuid_get_revision(&device->uuid),
+            device->score, device->rssi, device->sightings);
   }
-}
\ No newline at end of file
+  app_log("%u/%u devices in the table, %lu aged out, %lu evicted\n",
+          manager_instance.present_devices, DEVICE_MANAGER_MAX_DEVICES,
+          manager_instance.aged_out, manager_instance.evicted);
+}
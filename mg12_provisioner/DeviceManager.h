@@ -1,8 +1,28 @@
 #ifndef __DEVICE_MAN__
 #define __DEVICE_MAN__
 
+#include "DeviceClass.h"
 #include "sl_btmesh_api.h"
 
+// Number of unprovisioned devices the table can hold
+#ifndef DEVICE_MANAGER_MAX_DEVICES
+#define DEVICE_MANAGER_MAX_DEVICES 64
+#endif
+
+// Number of slots of the address and UUID indexes, a power of two at least
+// twice DEVICE_MANAGER_MAX_DEVICES to keep the probes short
+#ifndef DEVICE_MANAGER_HASH_SIZE
+#define DEVICE_MANAGER_HASH_SIZE 128
+#endif
+
+// Period of the aging tick, and number of ticks a device stays in the table
+// after its last beacon
+#define DEVICE_MANAGER_AGING_TICK_MS 1000
+#define DEVICE_MANAGER_LIFETIME 30
+
+// External signal raised by the aging tick, see RETRY_ENGINE_SIGNAL
+#define DEVICE_MANAGER_AGING_SIGNAL 0x02
+
 #define DEVICE_MANAGER_SUCCESS 0
 #define DEVICE_MANAGER_ERROR 1
 #define DEVICE_MANAGER_TABLE_FLOW 2
@@ -18,30 +38,56 @@ void device_manager_init();
 /**
  * @brief Add new device to the current device table
  *
+ * @details If the device is already in the table, its beacon is counted as
+ * one more sighting and its priority is updated
+ *
  * @param devUUID The 128-bit UUDI of the device
  * @param devAddr The 6-byte bluetooth address of the device
+ * @param rssi The RSSI of the beacon
  * @return int Status code defined above
  */
-uint8_t device_manager_add_device(uuid_128 *devUUID, bd_addr *devAddr);
+uint8_t device_manager_add_device(uuid_128 *devUUID, bd_addr *devAddr,
+                                  int8_t rssi);
 
 /**
- * @brief Remove a device from the table.
- * @details This actually just set the entry invalid so that
- *          it could be overwritten by new entry in the future
+ * @brief Remove a device from the table, its entry is given back to the
+ * free list
  *
- * @param devAddr The 128-bit UUID of the device
+ * @param devAddr The 6-byte bluetooth address of the device
  * @return int Status code defined above
  */
 uint8_t device_manager_remove_device(const bd_addr *devAddr);
 
 /**
- * @brief Get the next item in the device table
+ * @brief Look a device up by its UUID
+ *
+ * @param id The 128-bit UUID of the device
+ * @param [out] add Buffer to hold the BLE address of the device
+ * @return uint8_t Status code defined above
+ */
+uint8_t device_manager_find_by_uuid(const uuid_128 *id, bd_addr *add);
+
+/**
+ * @brief Get the device most likely to be provisioned quickly: by the score
+ * of its class (gateways first), then by beacon RSSI and number of sightings
  *
  * @param [out] id Buffer to hold the UUID of the next device
  * @param [out] add Buffer to hold the BLE address of the next device
+ * @param [out] device_class The class of the next device
+ * @return uint8_t Status code defined above
+ */
+uint8_t device_manager_get_next_device(uuid_128 *id, bd_addr *add,
+                                       const device_class_t **device_class);
+
+/**
+ * @brief Get when the first beacon of a device was seen
+ *
+ * @param add The BLE address of the device
+ * @param [out] first_seen_ms Time of the beacon, in retry_engine_now_ms time
  * @return uint8_t Status code defined above
  */
-uint8_t device_manager_get_next_device(uuid_128 *id, bd_addr *add);
+uint8_t device_manager_get_first_seen(const bd_addr *add,
+                                      uint32_t *first_seen_ms);
 
 /**
  * @brief Get the number of current device in the list
@@ -52,7 +98,14 @@ uint8_t device_manager_get_next_device(uuid_128 *id, bd_addr *add);
 uint8_t device_manager_get_device_count(uint8_t *count);
 
 /**
- * @brief Print out the list of the beaconing device within the same family
+ * @brief Age the devices by one tick and drop the ones that stopped
+ * beaconing, called on DEVICE_MANAGER_AGING_SIGNAL
+ *
+ */
+void device_manager_on_aging_tick(void);
+
+/**
+ * @brief Print out the list of the beaconing devices we provision
  * 
  */
 void device_manager_print_list(void);
@@ -0,0 +1,162 @@
+#include "EventDispatcher.h"
+
+#include <string.h>
+
+#include "app_log.h"
+#include "em_device.h"
+
+/**
+ * @brief A subscriber and what it cost so far
+ *
+ */
+typedef struct {
+  event_dispatcher_handler_t handler;
+  const char *name;
+  uint32_t calls;
+  uint32_t max_cycles;
+  uint64_t total_cycles;
+} event_dispatcher_handler_entry_t;
+
+/**
+ * @brief One event ID to handler link, kept sorted by event ID
+ *
+ */
+typedef struct {
+  uint32_t event_id;
+  uint8_t handler_index;
+} event_dispatcher_route_t;
+
+typedef struct event_dispatcher {
+  event_dispatcher_handler_entry_t handlers[EVENT_DISPATCHER_MAX_HANDLERS];
+  uint8_t num_handlers;
+  event_dispatcher_route_t routes[EVENT_DISPATCHER_MAX_SUBSCRIPTIONS];
+  uint8_t num_routes;
+  uint32_t unhandled;
+} event_dispatcher_t;
+
+static event_dispatcher_t dispatcher_instance;
+
+void event_dispatcher_init(void) {
+  memset(&dispatcher_instance, 0, sizeof(dispatcher_instance));
+
+#if EVENT_DISPATCHER_PROFILING
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+static uint8_t __handler_index(event_dispatcher_handler_t handler,
+                               const char *name) {
+  for (uint8_t i = 0; i < dispatcher_instance.num_handlers; i++) {
+    if (dispatcher_instance.handlers[i].handler == handler) {
+      return i;
+    }
+  }
+  if (dispatcher_instance.num_handlers >= EVENT_DISPATCHER_MAX_HANDLERS) {
+    return EVENT_DISPATCHER_MAX_HANDLERS;
+  }
+  dispatcher_instance.handlers[dispatcher_instance.num_handlers].handler =
+      handler;
+  dispatcher_instance.handlers[dispatcher_instance.num_handlers].name = name;
+  return dispatcher_instance.num_handlers++;
+}
+
+/*
+ * First route whose event ID is not below the given one
+ * */
+static uint8_t __lower_bound(uint32_t event_id) {
+  uint8_t low = 0, high = dispatcher_instance.num_routes, mid;
+
+  while (low < high) {
+    mid = (low + high) / 2;
+    if (dispatcher_instance.routes[mid].event_id < event_id) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+uint8_t event_dispatcher_subscribe(const event_dispatcher_subscription_t *table,
+                                   uint8_t len) {
+  uint8_t handler_index, pos;
+
+  for (uint8_t i = 0; i < len; i++) {
+    handler_index = __handler_index(table[i].handler, table[i].name);
+    if (handler_index == EVENT_DISPATCHER_MAX_HANDLERS ||
+        dispatcher_instance.num_routes >= EVENT_DISPATCHER_MAX_SUBSCRIPTIONS) {
+      app_log("ERROR: event dispatcher full, %s not subscribed to %8.8lx\n",
+              table[i].name, (unsigned long)table[i].event_id);
+      return EVENT_DISPATCHER_FULL;
+    }
+
+    // After the routes already there for the same event, so that the
+    // handlers run in the order they subscribed
+    pos = __lower_bound(table[i].event_id + 1);
+    memmove(&dispatcher_instance.routes[pos + 1],
+            &dispatcher_instance.routes[pos],
+            (dispatcher_instance.num_routes - pos) *
+                sizeof(event_dispatcher_route_t));
+    dispatcher_instance.routes[pos].event_id = table[i].event_id;
+    dispatcher_instance.routes[pos].handler_index = handler_index;
+    dispatcher_instance.num_routes++;
+  }
+  return EVENT_DISPATCHER_SUCCESS;
+}
+
+void event_dispatcher_dispatch(sl_btmesh_msg_t *evt) {
+  uint32_t event_id = SL_BT_MSG_ID(evt->header);
+  uint8_t pos = __lower_bound(event_id);
+  event_dispatcher_handler_entry_t *entry;
+#if EVENT_DISPATCHER_PROFILING
+  uint32_t start, cycles;
+#endif
+
+  if (pos == dispatcher_instance.num_routes ||
+      dispatcher_instance.routes[pos].event_id != event_id) {
+    dispatcher_instance.unhandled++;
+    app_log("unhandled evt: %8.8x class %2.2x method %2.2x\r\n",
+            (unsigned int)event_id, (unsigned int)((event_id >> 16) & 0xFF),
+            (unsigned int)((event_id >> 24) & 0xFF));
+    return;
+  }
+
+  for (; pos < dispatcher_instance.num_routes &&
+         dispatcher_instance.routes[pos].event_id == event_id;
+       pos++) {
+    entry =
+        &dispatcher_instance.handlers[dispatcher_instance.routes[pos]
+                                          .handler_index];
+#if EVENT_DISPATCHER_PROFILING
+    start = DWT->CYCCNT;
+    entry->handler(evt);
+    cycles = DWT->CYCCNT - start;
+    entry->total_cycles += cycles;
+    if (cycles > entry->max_cycles) {
+      entry->max_cycles = cycles;
+    }
+#else
+    entry->handler(evt);
+#endif
+    entry->calls++;
+  }
+}
+
+void event_dispatcher_print_stats(void) {
+  event_dispatcher_handler_entry_t *entry;
+
+  app_log("Event handlers (%d routes, %lu events unhandled):\n",
+          dispatcher_instance.num_routes,
+          (unsigned long)dispatcher_instance.unhandled);
+  for (uint8_t i = 0; i < dispatcher_instance.num_handlers; i++) {
+    entry = &dispatcher_instance.handlers[i];
+    app_log("  %-20s %6lu calls, %8lu cycles avg, %8lu max\n", entry->name,
+            (unsigned long)entry->calls,
+            (unsigned long)(entry->calls
+                                ? entry->total_cycles / entry->calls
+                                : 0),
+            (unsigned long)entry->max_cycles);
+  }
+}
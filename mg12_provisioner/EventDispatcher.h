@@ -0,0 +1,64 @@
+#ifndef __EVENT_DISPATCHER__
+#define __EVENT_DISPATCHER__
+
+#include <stdint.h>
+
+#include "sl_btmesh_api.h"
+
+// Modules that can subscribe, and subscriptions in total
+#define EVENT_DISPATCHER_MAX_HANDLERS 12
+#define EVENT_DISPATCHER_MAX_SUBSCRIPTIONS 48
+
+// Time each handler with the DWT cycle counter
+#ifndef EVENT_DISPATCHER_PROFILING
+#define EVENT_DISPATCHER_PROFILING 1
+#endif
+
+#define EVENT_DISPATCHER_SUCCESS 0
+#define EVENT_DISPATCHER_FULL 1
+
+typedef void (*event_dispatcher_handler_t)(sl_btmesh_msg_t *evt);
+
+/**
+ * @brief One row of a subscription table: the handler is called for every
+ * event with this ID
+ *
+ */
+typedef struct {
+  uint32_t event_id;
+  event_dispatcher_handler_t handler;
+  // Shown in the statistics
+  const char *name;
+} event_dispatcher_subscription_t;
+
+/**
+ * @brief Init the dispatcher, nobody is subscribed
+ *
+ */
+void event_dispatcher_init(void);
+
+/**
+ * @brief Subscribe handlers to events. The handlers of one event are called
+ * in the order they subscribed.
+ *
+ * @param table Rows to add
+ * @param len Number of rows
+ * @return uint8_t Status code defined above
+ */
+uint8_t event_dispatcher_subscribe(const event_dispatcher_subscription_t *table,
+                                   uint8_t len);
+
+/**
+ * @brief Call the handlers subscribed to an event
+ *
+ * @param evt Event coming from the Bluetooth Mesh stack
+ */
+void event_dispatcher_dispatch(sl_btmesh_msg_t *evt);
+
+/**
+ * @brief Print the calls and the cycles spent in each handler
+ *
+ */
+void event_dispatcher_print_stats(void);
+
+#endif  // __EVENT_DISPATCHER__
@@ -0,0 +1,290 @@
+#include "KeyRefresh.h"
+
+#include <string.h>
+
+#include "NetworkConfiguration.h"
+#include "RetryEngine.h"
+#include "app_log.h"
+
+/**
+ * @brief Progress of one node. phase is the last phase the node confirmed.
+ *
+ */
+typedef struct {
+  uuid_128 uuid;
+  uint16_t address;
+  uint8_t phase;
+  uint8_t failure_code;
+  // Time the node confirmed its last phase, relative to the start
+  uint32_t updated_ms;
+  bool straggler;
+} tsKeyRefreshNode;
+
+typedef struct key_refresh {
+  bool running;
+  uint8_t phase;
+  uint32_t start_ms;
+  uint32_t phase_start_ms;
+  uint32_t phase_ms[2];
+  // Nodes which confirmed the current phase, and when the last batch of
+  // them was complete
+  uint16_t phase_done;
+  uint32_t batch_done_ms;
+  // Suspended between two batches until resume_ms
+  bool paused;
+  uint32_t resume_ms;
+  tsKeyRefreshNode nodes[KEY_REFRESH_MAX_NODES];
+  uint16_t num_nodes;
+  // Nodes of the device database past the table
+  uint16_t untracked;
+} key_refresh_t;
+
+static key_refresh_t kr_instance;
+
+static tsKeyRefreshNode *__node_find(const uuid_128 *uuid) {
+  for (uint16_t i = 0; i < kr_instance.num_nodes; i++) {
+    if (memcmp(&kr_instance.nodes[i].uuid, uuid, sizeof(uuid_128)) == 0) {
+      return &kr_instance.nodes[i];
+    }
+  }
+
+  if (kr_instance.num_nodes == KEY_REFRESH_MAX_NODES) {
+    return NULL;
+  }
+  memset(&kr_instance.nodes[kr_instance.num_nodes], 0,
+         sizeof(tsKeyRefreshNode));
+  kr_instance.nodes[kr_instance.num_nodes].uuid = *uuid;
+  return &kr_instance.nodes[kr_instance.num_nodes++];
+}
+
+bool key_refresh_is_running(void) {
+  return kr_instance.running;
+}
+
+/*
+ * Number of batches the stack needs to push a phase to every node
+ * */
+static uint16_t __batches(void) {
+  return (kr_instance.num_nodes + kr_instance.untracked +
+          KEY_REFRESH_BATCH_SIZE - 1) /
+         KEY_REFRESH_BATCH_SIZE;
+}
+
+/*
+ * Time a straggler is looked for after the start of a phase
+ * */
+static uint32_t __straggler_deadline(void) {
+  uint16_t batches = __batches();
+
+  return kr_instance.phase_start_ms +
+         (KEY_REFRESH_STRAGGLER_MS + KEY_REFRESH_BATCH_GAP_MS) *
+             (batches > 0 ? batches : 1);
+}
+
+/*
+ * Hold the stack back for KEY_REFRESH_BATCH_GAP_MS. The requests already
+ * sent still complete, no new one is sent until the rotation is resumed.
+ * */
+static void __pause(uint32_t now) {
+  sl_status_t sc;
+
+  if (kr_instance.paused) {
+    return;
+  }
+  sc = sl_btmesh_prov_suspend_key_refresh(NETWORK_ID);
+  if (sc != SL_STATUS_OK) {
+    // Not fatal, the stack goes on at its own pace
+    app_log("Key refresh: suspend failed 0x%lx\n", sc);
+    return;
+  }
+  kr_instance.paused = true;
+  kr_instance.resume_ms = now + KEY_REFRESH_BATCH_GAP_MS;
+  retry_engine_wake_at(kr_instance.resume_ms);
+}
+
+/*
+ * Resume the rotation once the pause is over, tried again after another
+ * pause if the stack refuses
+ * */
+static void __resume(uint32_t now) {
+  sl_status_t sc;
+
+  if (!kr_instance.paused) {
+    return;
+  }
+  if (!retry_engine_is_due(kr_instance.resume_ms, now)) {
+    retry_engine_wake_at(kr_instance.resume_ms);
+    return;
+  }
+  sc = sl_btmesh_prov_resume_key_refresh(NETWORK_ID);
+  if (sc != SL_STATUS_OK) {
+    app_log("Key refresh: resume failed 0x%lx\n", sc);
+    kr_instance.resume_ms = now + KEY_REFRESH_BATCH_GAP_MS;
+    retry_engine_wake_at(kr_instance.resume_ms);
+    return;
+  }
+  kr_instance.paused = false;
+}
+
+uint8_t key_refresh_start(void) {
+  uint8_t appkey_indices[2] = {APPKEY_INDEX & 0xFF, APPKEY_INDEX >> 8};
+  uint16_t count = 0;
+  sl_status_t sc;
+
+  if (kr_instance.running) {
+    return KEY_REFRESH_BUSY;
+  }
+
+  memset(&kr_instance, 0, sizeof(kr_instance));
+
+  sc = sl_btmesh_prov_start_key_refresh(NETWORK_ID, 1, sizeof(appkey_indices),
+                                        appkey_indices);
+  if (sc != SL_STATUS_OK) {
+    app_log("Key refresh: start failed 0x%lx\n", sc);
+    return KEY_REFRESH_STACK_ERROR;
+  }
+
+  kr_instance.running = true;
+  kr_instance.phase = 1;
+  kr_instance.start_ms = retry_engine_now_ms();
+  kr_instance.phase_start_ms = kr_instance.start_ms;
+  kr_instance.batch_done_ms = kr_instance.start_ms;
+
+  // The nodes come back as ddb_list events, before the first node update
+  sc = sl_btmesh_prov_list_ddb_entries(&count);
+  if (sc != SL_STATUS_OK) {
+    app_log("Key refresh: listing the nodes failed 0x%lx\n", sc);
+  }
+  retry_engine_wake_at(kr_instance.start_ms + KEY_REFRESH_STRAGGLER_MS);
+
+  app_log("Key refresh: rotating the keys of %u nodes, %d at a time\n",
+          count, KEY_REFRESH_BATCH_SIZE);
+  return KEY_REFRESH_SUCCESS;
+}
+
+/*
+ * Print the time of each phase and the nodes which were late or failed
+ * */
+static void __report(uint16_t result) {
+  const tsKeyRefreshNode *node;
+  uint32_t total = retry_engine_now_ms() - kr_instance.start_ms;
+  uint16_t late = 0;
+
+  app_log("Key refresh: %s in %lu ms (phase 1 %lu ms, phase 2 %lu ms), "
+          "%u nodes in %u batches\n",
+          result == SL_STATUS_OK ? "complete" : "failed", total,
+          kr_instance.phase_ms[0], kr_instance.phase_ms[1],
+          kr_instance.num_nodes + kr_instance.untracked, __batches());
+  if (kr_instance.untracked > 0) {
+    app_log("Key refresh: %u nodes past KEY_REFRESH_MAX_NODES not followed\n",
+            kr_instance.untracked);
+  }
+
+  for (uint16_t i = 0; i < kr_instance.num_nodes; i++) {
+    node = &kr_instance.nodes[i];
+    if (!node->straggler && node->failure_code == 0) {
+      continue;
+    }
+    late++;
+    app_log("  straggler %4.4x (%x:%x): phase %d at %lu ms, failure %d\n",
+            node->address, node->uuid.data[14], node->uuid.data[15],
+            node->phase, node->updated_ms, node->failure_code);
+  }
+  app_log("Key refresh: %u stragglers\n", late);
+}
+
+void key_refresh_on_btmesh_event(sl_btmesh_msg_t *evt) {
+  sl_btmesh_evt_prov_key_refresh_node_update_t *update;
+  tsKeyRefreshNode *node;
+  uint32_t now;
+
+  if (!kr_instance.running) {
+    return;
+  }
+
+  switch (SL_BT_MSG_ID(evt->header)) {
+    case sl_btmesh_evt_prov_ddb_list_id:
+      node = __node_find(&evt->data.evt_prov_ddb_list.uuid);
+      if (node != NULL) {
+        node->address = evt->data.evt_prov_ddb_list.address;
+      } else {
+        kr_instance.untracked++;
+      }
+      break;
+    case sl_btmesh_evt_prov_key_refresh_node_update_id:
+      update = &evt->data.evt_prov_key_refresh_node_update;
+      node = __node_find(&update->uuid);
+      if (node == NULL) {
+        break;
+      }
+      if (node->phase < kr_instance.phase &&
+          update->phase >= kr_instance.phase &&
+          ++kr_instance.phase_done % KEY_REFRESH_BATCH_SIZE == 0) {
+        now = retry_engine_now_ms();
+        app_log("Key refresh: batch %u/%u of phase %d in %lu ms\n",
+                kr_instance.phase_done / KEY_REFRESH_BATCH_SIZE, __batches(),
+                kr_instance.phase, now - kr_instance.batch_done_ms);
+        kr_instance.batch_done_ms = now;
+        // The last batch is followed by the next phase, paused there
+        if (kr_instance.phase_done < kr_instance.num_nodes) {
+          __pause(now);
+        }
+      }
+      node->phase = update->phase;
+      node->failure_code = update->failure_code;
+      node->updated_ms = retry_engine_now_ms() - kr_instance.start_ms;
+      if (node->failure_code != 0) {
+        app_log("Key refresh: node %4.4x failed, code %d\n", node->address,
+                node->failure_code);
+      }
+      break;
+    case sl_btmesh_evt_prov_key_refresh_phase_update_id:
+      now = retry_engine_now_ms();
+      if (kr_instance.phase >= 1 && kr_instance.phase <= 2) {
+        kr_instance.phase_ms[kr_instance.phase - 1] =
+            now - kr_instance.phase_start_ms;
+      }
+      kr_instance.phase = evt->data.evt_prov_key_refresh_phase_update.phase;
+      kr_instance.phase_start_ms = now;
+      kr_instance.batch_done_ms = now;
+      kr_instance.phase_done = 0;
+      app_log("Key refresh: phase %d after %lu ms\n", kr_instance.phase,
+              now - kr_instance.start_ms);
+      // The stack moved on by itself, hold the first batch of the new phase
+      // back as well
+      __pause(now);
+      retry_engine_wake_at(__straggler_deadline());
+      break;
+    case sl_btmesh_evt_prov_key_refresh_complete_id:
+      kr_instance.running = false;
+      kr_instance.paused = false;
+      __report(evt->data.evt_prov_key_refresh_complete.result);
+      break;
+    default:
+      break;
+  }
+}
+
+void key_refresh_on_retry_tick(void) {
+  tsKeyRefreshNode *node;
+  uint32_t now = retry_engine_now_ms();
+  uint32_t deadline = __straggler_deadline();
+
+  if (!kr_instance.running) {
+    return;
+  }
+  __resume(now);
+  if (!retry_engine_is_due(deadline, now)) {
+    retry_engine_wake_at(deadline);
+    return;
+  }
+
+  for (uint16_t i = 0; i < kr_instance.num_nodes; i++) {
+    node = &kr_instance.nodes[i];
+    if (node->phase < kr_instance.phase && !node->straggler) {
+      node->straggler = true;
+      app_log("Key refresh: %4.4x still in phase %d after %lu ms\n",
+              node->address, node->phase, now - kr_instance.phase_start_ms);
+    }
+  }
+}
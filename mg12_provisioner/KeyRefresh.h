@@ -0,0 +1,71 @@
+#ifndef __KEY_REFRESH__
+#define __KEY_REFRESH__
+
+#include <stdbool.h>
+
+#include "sl_btmesh_api.h"
+#include "sl_btmesh_config.h"
+
+// Nodes tracked during a rotation: every node of the device database of the
+// stack, not only the ones configured by this provisioner. Sized on its own
+// and not from the device database of this build, so that the module follows
+// a large network as well. Nodes past it are counted, not followed.
+#ifndef KEY_REFRESH_MAX_NODES
+#define KEY_REFRESH_MAX_NODES 256
+#endif
+
+// Nodes confirming a phase before the rotation is paused. Defaults to the
+// requests the stack keeps pending at a time.
+#ifndef KEY_REFRESH_BATCH_SIZE
+#define KEY_REFRESH_BATCH_SIZE SL_BTMESH_CONFIG_LIMIT_PROV_CONCURRENT_KR
+#endif
+
+// Pause after each batch and before the nodes are moved to the next phase,
+// the rotation is suspended meanwhile so that the relays and the segmented
+// messages of the previous batch settle
+#define KEY_REFRESH_BATCH_GAP_MS 2000
+
+// Time given to each batch to confirm a phase, on top of its pause. A node
+// still behind once every batch had its time since the start of the phase is
+// reported as a straggler.
+#define KEY_REFRESH_STRAGGLER_MS 30000
+
+#define KEY_REFRESH_SUCCESS 0
+#define KEY_REFRESH_BUSY 1
+#define KEY_REFRESH_STACK_ERROR 2
+
+/**
+ * @brief Start rotating the network key and the application key.
+ * @details The stack pushes the new keys to the nodes itself. This module
+ * lists the nodes of the device database and follows each of them through
+ * the phases. Every KEY_REFRESH_BATCH_SIZE nodes confirming a phase, and
+ * whenever the stack moves to the next phase, the rotation is suspended for
+ * KEY_REFRESH_BATCH_GAP_MS. It reports the time taken by each batch, the total
+ * time and the nodes holding the rotation back.
+ *
+ * @return uint8_t Status code defined above
+ */
+uint8_t key_refresh_start(void);
+
+/**
+ * @brief Check if a rotation is running
+ *
+ */
+bool key_refresh_is_running(void);
+
+/**
+ * @brief Handle the key refresh events of the stack and the device database
+ * entries listed when the rotation starts
+ *
+ * @param evt Event coming from the Bluetooth Mesh stack
+ */
+void key_refresh_on_btmesh_event(sl_btmesh_msg_t *evt);
+
+/**
+ * @brief Resume a paused rotation and report the stragglers, called when the
+ * retry timer expires
+ *
+ */
+void key_refresh_on_retry_tick(void);
+
+#endif  // __KEY_REFRESH__
@@ -14,5 +14,8 @@
 #define SWITCH_MODEL_ID 0x1001  // Generic On/Off Client
 
 #define LIGHTNESS_SEVER_MODEL 0x1300 // Light lightness server
+#define LIGHTNESS_CLIENT_MODEL 0x1302  // Light lightness client
+#define SENSOR_SERVER_MODEL 0x1100     // Sensor server
+#define SENSOR_CLIENT_MODEL 0x1102     // Sensor client
 
 #endif  // __NET_CONFIG__
\ No newline at end of file
@@ -0,0 +1,270 @@
+#include "NodeDatabase.h"
+
+#include <string.h>
+
+#include "app_log.h"
+#include "nvm3_default.h"
+#include "sl_bt_api.h"
+#include "sl_sleeptimer.h"
+
+// Bump this when tsNodeRecord changes so old NVM3 objects are dropped
+#define NODE_DB_FORMAT_VERSION 2
+
+#define NODE_DB_HEADER_KEY NODE_DB_NVM3_KEY_BASE
+#define NODE_DB_RECORD_KEY(index) (NODE_DB_NVM3_KEY_BASE + 1 + (index))
+
+#if NODE_DB_MAX_NODES > 32
+#error "The dirty mask of the node database holds 32 records"
+#endif
+
+/**
+ * @brief Header object of the database
+ *
+ */
+typedef struct {
+  uint8_t format_version;
+  uint16_t boot_count;
+} tsNodeDbHeader;
+
+typedef struct node_db {
+  tsNodeDbHeader header;
+  tsNodeRecord records[NODE_DB_MAX_NODES];
+  // Records (bit per index) and header changed since the last flush
+  uint32_t dirty;
+  bool header_dirty;
+  sl_sleeptimer_timer_handle_t flush_timer;
+  bool flush_pending;
+} node_db_t;
+
+static node_db_t db_instance;
+
+static void flush_timer_on_timeout(sl_sleeptimer_timer_handle_t *handle,
+                                   void *data) {
+  (void)handle;
+  (void)data;
+
+  // Runs in interrupt context, NVM3 is written in the event loop
+  sl_bt_external_signal(NODE_DB_FLUSH_SIGNAL);
+}
+
+static uint32_t __now_s(void) {
+  uint64_t ms = 0;
+
+  sl_sleeptimer_tick64_to_ms(sl_sleeptimer_get_tick_count64(), &ms);
+  return (uint32_t)(ms / 1000);
+}
+
+static void __schedule_flush(void) {
+  if (db_instance.flush_pending) {
+    return;
+  }
+  db_instance.flush_pending = true;
+  sl_sleeptimer_start_timer_ms(
+      &db_instance.flush_timer, NODE_DB_FLUSH_DELAY_MS, flush_timer_on_timeout,
+      NULL, 0, SL_SLEEPTIMER_NO_HIGH_PRECISION_HF_CLOCKS_REQUIRED_FLAG);
+}
+
+static void __mark_dirty(uint8_t index) {
+  db_instance.dirty |= 1UL << index;
+  __schedule_flush();
+}
+
+static void __flush(void) {
+  tsNodeRecord *record;
+
+  if (db_instance.header_dirty) {
+    if (nvm3_writeData(nvm3_defaultHandle, NODE_DB_HEADER_KEY,
+                       &db_instance.header,
+                       sizeof(db_instance.header)) != ECODE_NVM3_OK) {
+      app_log("Node DB: failed to save the header\n");
+    }
+    db_instance.header_dirty = false;
+  }
+
+  for (uint8_t i = 0; i < NODE_DB_MAX_NODES; i++) {
+    if (!(db_instance.dirty & (1UL << i))) {
+      continue;
+    }
+    record = &db_instance.records[i];
+    if (record->address == 0) {
+      nvm3_deleteObject(nvm3_defaultHandle, NODE_DB_RECORD_KEY(i));
+    } else if (nvm3_writeData(nvm3_defaultHandle, NODE_DB_RECORD_KEY(i),
+                              record, sizeof(*record)) != ECODE_NVM3_OK) {
+      app_log("Node DB: failed to save record %d\n", i);
+    }
+  }
+  db_instance.dirty = 0;
+}
+
+void node_db_init(void) {
+  tsNodeRecord *record;
+  uint8_t count = 0;
+  Ecode_t ec;
+
+  memset(&db_instance, 0, sizeof(db_instance));
+
+  ec = nvm3_readData(nvm3_defaultHandle, NODE_DB_HEADER_KEY,
+                     &db_instance.header, sizeof(db_instance.header));
+  if (ec != ECODE_NVM3_OK ||
+      db_instance.header.format_version != NODE_DB_FORMAT_VERSION) {
+    db_instance.header.format_version = NODE_DB_FORMAT_VERSION;
+    db_instance.header.boot_count = 0;
+  }
+
+  for (uint8_t i = 0; i < NODE_DB_MAX_NODES; i++) {
+    record = &db_instance.records[i];
+    ec = nvm3_readData(nvm3_defaultHandle, NODE_DB_RECORD_KEY(i), record,
+                       sizeof(*record));
+    if (ec == ECODE_NVM3_OK &&
+        record->format_version == NODE_DB_FORMAT_VERSION &&
+        record->address != 0) {
+      count++;
+    } else {
+      if (ec == ECODE_NVM3_OK) {
+        // Left by an older build
+        db_instance.dirty |= 1UL << i;
+      }
+      memset(record, 0, sizeof(*record));
+    }
+  }
+
+  db_instance.header.boot_count++;
+  db_instance.header_dirty = true;
+  __schedule_flush();
+
+  app_log("Node DB: %d nodes restored, boot %u\n", count,
+          db_instance.header.boot_count);
+}
+
+/*
+ * Find the first record from index `from` on matching the address or the UUID
+ * */
+static int __find_index(uint8_t from, uint16_t address, const uuid_128 *uuid) {
+  for (uint8_t i = from; i < NODE_DB_MAX_NODES; i++) {
+    if (db_instance.records[i].address == 0) {
+      continue;
+    }
+    if ((address != 0 && db_instance.records[i].address == address) ||
+        (uuid != NULL && memcmp(&db_instance.records[i].uuid, uuid,
+                                sizeof(uuid_128)) == 0)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+const tsNodeRecord *node_db_find_by_address(uint16_t address) {
+  int index = __find_index(0, address, NULL);
+
+  return index < 0 ? NULL : &db_instance.records[index];
+}
+
+const tsNodeRecord *node_db_find_by_uuid(const uuid_128 *uuid) {
+  int index = __find_index(0, 0, uuid);
+
+  return index < 0 ? NULL : &db_instance.records[index];
+}
+
+const tsNodeRecord *node_db_get(uint8_t index) {
+  if (index >= NODE_DB_MAX_NODES || db_instance.records[index].address == 0) {
+    return NULL;
+  }
+  return &db_instance.records[index];
+}
+
+uint8_t node_db_store(const tsNodeRecord *record) {
+  int index = __find_index(0, record->address, &record->uuid);
+
+  if (index < 0) {
+    for (uint8_t i = 0; i < NODE_DB_MAX_NODES && index < 0; i++) {
+      if (db_instance.records[i].address == 0) {
+        index = i;
+      }
+    }
+    if (index < 0) {
+      app_log("Node DB: full, node %4.4x not saved\n", record->address);
+      return NODE_DB_FULL;
+    }
+  } else {
+    // A re-provisioned node may match one record by UUID and another one by
+    // its new address, the ones after the first match are stale
+    for (int other = __find_index(index + 1, record->address, &record->uuid);
+         other >= 0;
+         other = __find_index(other + 1, record->address, &record->uuid)) {
+      memset(&db_instance.records[other], 0, sizeof(tsNodeRecord));
+      __mark_dirty(other);
+    }
+  }
+
+  db_instance.records[index] = *record;
+  db_instance.records[index].format_version = NODE_DB_FORMAT_VERSION;
+  db_instance.records[index].last_seen_boot = db_instance.header.boot_count;
+  db_instance.records[index].last_seen_s = __now_s();
+  __mark_dirty(index);
+  return NODE_DB_SUCCESS;
+}
+
+void node_db_touch(uint16_t address) {
+  int index = __find_index(0, address, NULL);
+  tsNodeRecord *record;
+  uint32_t now = __now_s();
+
+  if (index < 0) {
+    return;
+  }
+  record = &db_instance.records[index];
+  if (record->last_seen_boot == db_instance.header.boot_count &&
+      now - record->last_seen_s < NODE_DB_LAST_SEEN_RESOLUTION_S) {
+    return;
+  }
+  record->last_seen_boot = db_instance.header.boot_count;
+  record->last_seen_s = now;
+  __mark_dirty(index);
+}
+
+void node_db_set_hops(uint16_t address, uint8_t hops) {
+  int index = __find_index(0, address, NULL);
+
+  if (index < 0 || db_instance.records[index].hops == hops) {
+    return;
+  }
+  db_instance.records[index].hops = hops;
+  __mark_dirty(index);
+}
+
+uint8_t node_db_remove(const uuid_128 *uuid) {
+  int index = __find_index(0, 0, uuid);
+
+  if (index < 0) {
+    return NODE_DB_NOT_FOUND;
+  }
+  memset(&db_instance.records[index], 0, sizeof(tsNodeRecord));
+  __mark_dirty(index);
+  return NODE_DB_SUCCESS;
+}
+
+void node_db_on_signal(uint32_t extsignals) {
+  if (!(extsignals & NODE_DB_FLUSH_SIGNAL)) {
+    return;
+  }
+  db_instance.flush_pending = false;
+  __flush();
+}
+
+void node_db_print(void) {
+  const tsNodeRecord *record;
+
+  app_log("Known nodes:\n");
+  for (uint8_t i = 0; i < NODE_DB_MAX_NODES; i++) {
+    record = &db_instance.records[i];
+    if (record->address == 0) {
+      continue;
+    }
+    app_log("%4.4x type %d, %d elements, %d config requests to %4.4x, "
+            "dcd %8.8lx, %d hops, TTL %d, last seen boot %u at %lus\n",
+            record->address, record->device_type, record->number_of_elements,
+            record->num_cmds, record->group_address, record->dcd_hash,
+            record->hops, record->pub_ttl, record->last_seen_boot,
+            record->last_seen_s);
+  }
+}
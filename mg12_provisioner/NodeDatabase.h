@@ -0,0 +1,130 @@
+#ifndef __NODE_DB__
+#define __NODE_DB__
+
+#include <stdbool.h>
+
+#include "sl_btmesh_api.h"
+#include "sl_btmesh_config.h"
+
+// One record per node the provisioner can hold in its device database
+#define NODE_DB_MAX_NODES SL_BTMESH_CONFIG_MAX_PROVISIONED_DEVICES
+
+// NVM3 keys: the header at NODE_DB_NVM3_KEY_BASE, then one object per record
+#define NODE_DB_NVM3_KEY_BASE 0x0200
+
+// Changes are written together this long after the first one
+#define NODE_DB_FLUSH_DELAY_MS 2000
+
+// External signal raised when the changes are due, see RETRY_ENGINE_SIGNAL
+#define NODE_DB_FLUSH_SIGNAL 0x04
+
+// last_seen is only written again once it moved by this much, to spare the
+// flash
+#define NODE_DB_LAST_SEEN_RESOLUTION_S 600
+
+#define NODE_DB_SUCCESS 0
+#define NODE_DB_FULL 1
+#define NODE_DB_NOT_FOUND 2
+
+/**
+ * @brief What the provisioner knows about one configured node. A record is
+ * free when its address is 0.
+ *
+ */
+typedef struct {
+  uint8_t format_version;
+  uint8_t device_type;
+  uint16_t address;
+  uuid_128 uuid;
+  uint8_t number_of_elements;
+  // Applied configuration: number of bind/pub/sub requests, the group they
+  // use and the hash of the plan table they came from
+  uint8_t num_cmds;
+  uint16_t group_address;
+  uint32_t plan_hash;
+  uint32_t dcd_hash;
+  // Boot count and uptime in seconds when the node was last heard of
+  uint16_t last_seen_boot;
+  uint32_t last_seen_s;
+  // Hops of the last heartbeats heard, 0 if never measured, and the
+  // publication TTL the node was configured with
+  uint8_t hops;
+  uint8_t pub_ttl;
+} tsNodeRecord;
+
+/**
+ * @brief Load the records saved in NVM3 and count one more boot
+ *
+ */
+void node_db_init(void);
+
+/**
+ * @brief Find the record of a node
+ *
+ * @param address The unicast address of the node
+ * @return const tsNodeRecord* NULL if unknown
+ */
+const tsNodeRecord *node_db_find_by_address(uint16_t address);
+
+/**
+ * @brief Find the record of a node
+ *
+ * @param uuid The UUID of the node
+ * @return const tsNodeRecord* NULL if unknown
+ */
+const tsNodeRecord *node_db_find_by_uuid(const uuid_128 *uuid);
+
+/**
+ * @brief Get a record by index, to go through the database
+ *
+ * @param index 0 to NODE_DB_MAX_NODES - 1
+ * @return const tsNodeRecord* NULL if the record is free
+ */
+const tsNodeRecord *node_db_get(uint8_t index);
+
+/**
+ * @brief Save the record of a node, replacing the one with the same UUID or
+ * address. last_seen is set to now and the write is batched.
+ *
+ * @param record The record, format_version and last_seen are filled in
+ * @return uint8_t Status code defined above
+ */
+uint8_t node_db_store(const tsNodeRecord *record);
+
+/**
+ * @brief Mark a node as heard of now
+ *
+ * @param address The unicast address of the node
+ */
+void node_db_touch(uint16_t address);
+
+/**
+ * @brief Save the hop distance measured for a node
+ *
+ * @param address The unicast address of the node
+ * @param hops Hops of its heartbeats
+ */
+void node_db_set_hops(uint16_t address, uint8_t hops);
+
+/**
+ * @brief Forget a node, e.g. once it is removed from the device database
+ *
+ * @param uuid The UUID of the node
+ * @return uint8_t Status code defined above
+ */
+uint8_t node_db_remove(const uuid_128 *uuid);
+
+/**
+ * @brief Write the pending changes when NODE_DB_FLUSH_SIGNAL is raised
+ *
+ * @param extsignals Signals of the sl_bt_evt_system_external_signal event
+ */
+void node_db_on_signal(uint32_t extsignals);
+
+/**
+ * @brief Print the known nodes
+ *
+ */
+void node_db_print(void);
+
+#endif  // __NODE_DB__
@@ -0,0 +1,682 @@
+#include "ProvisionScheduler.h"
+
+#include <string.h>
+
+#include "AddressAllocator.h"
+#include "ConfigPlan.h"
+#include "DeviceConfiguration.h"
+#include "DeviceManager.h"
+#include "NetworkConfiguration.h"
+#include "RetryEngine.h"
+#include "StageLatency.h"
+#include "StatusIndicator.h"
+#include "app_log.h"
+
+// Number of addresses tried for one device when the stack refuses the ones
+// handed out by the allocator
+#define PROV_SCHEDULER_ADDRESS_ATTEMPTS 4
+
+// Reason of the provisioning suspended event once the capabilities of the
+// device are received
+#define PROV_SCHEDULER_SUSPENDED_CAPABILITIES 0
+
+// Mesh status "Key Index Already Stored", the key made it to the node but its
+// first status was lost
+#define PROV_SCHEDULER_KEY_ALREADY_STORED 0x1306
+
+/**
+ * @brief Commissioning of the nodes provisioned since boot
+ *
+ */
+typedef struct {
+  uint16_t configured;
+  uint16_t failed;
+  // Start of the first provisioning and end of the last configuration
+  uint32_t first_start_ms;
+  uint32_t last_done_ms;
+  // Times to configured, the oldest is overwritten first
+  uint32_t samples[PROV_SCHEDULER_STATS_SAMPLES];
+  // Most sessions in flight and configuring at the same time
+  uint8_t peak_sessions;
+  uint8_t peak_configuring;
+} prov_scheduler_stats_t;
+
+typedef struct provision_scheduler {
+  prov_session_t sessions[PROV_SCHEDULER_MAX_SESSIONS];
+  uint16_t group_address;
+  bool continuous;
+  prov_scheduler_stats_t stats;
+} provision_scheduler_t;
+
+static provision_scheduler_t scheduler_instance;
+
+void provision_scheduler_init(void) {
+  memset(&scheduler_instance, 0, sizeof(scheduler_instance));
+  address_allocator_init();
+}
+
+static prov_session_t *__session_get_free(void) {
+  uint8_t provisioning = 0;
+
+  for (uint8_t i = 0; i < PROV_SCHEDULER_MAX_SESSIONS; i++) {
+    if (scheduler_instance.sessions[i].state == PROV_SESSION_PROVISIONING) {
+      provisioning++;
+    }
+  }
+  if (provisioning >= PROV_SCHEDULER_MAX_PROVISIONING) {
+    return NULL;
+  }
+
+  for (uint8_t i = 0; i < PROV_SCHEDULER_MAX_SESSIONS; i++) {
+    if (scheduler_instance.sessions[i].state == PROV_SESSION_IDLE) {
+      return &scheduler_instance.sessions[i];
+    }
+  }
+  return NULL;
+}
+
+static prov_session_t *__session_find_by_uuid(const uuid_128 *uuid) {
+  for (uint8_t i = 0; i < PROV_SCHEDULER_MAX_SESSIONS; i++) {
+    if (scheduler_instance.sessions[i].state != PROV_SESSION_IDLE &&
+        memcmp(&scheduler_instance.sessions[i].uuid, uuid,
+               sizeof(uuid_128)) == 0) {
+      return &scheduler_instance.sessions[i];
+    }
+  }
+  return NULL;
+}
+
+static prov_session_t *__session_find_by_address(uint16_t address) {
+  for (uint8_t i = 0; i < PROV_SCHEDULER_MAX_SESSIONS; i++) {
+    if (scheduler_instance.sessions[i].state > PROV_SESSION_PROVISIONING &&
+        scheduler_instance.sessions[i].unicast_address == address) {
+      return &scheduler_instance.sessions[i];
+    }
+  }
+  return NULL;
+}
+
+static prov_session_t *__session_find_by_appkey_handle(uint32_t handle) {
+  for (uint8_t i = 0; i < PROV_SCHEDULER_MAX_SESSIONS; i++) {
+    if (scheduler_instance.sessions[i].state == PROV_SESSION_ADDING_APPKEY &&
+        scheduler_instance.sessions[i].appkey_handle == handle) {
+      return &scheduler_instance.sessions[i];
+    }
+  }
+  return NULL;
+}
+
+static void __session_release(prov_session_t *session) {
+  memset(session, 0, sizeof(*session));
+}
+
+/*
+ * Keep the most sessions seen in flight at the same time
+ * */
+static void __stats_on_session_start(void) {
+  prov_scheduler_stats_t *stats = &scheduler_instance.stats;
+  uint8_t active = provision_scheduler_get_active_count();
+  uint8_t configuring = device_configuration_get_active_count();
+
+  if (active > stats->peak_sessions) {
+    stats->peak_sessions = active;
+  }
+  if (configuring > stats->peak_configuring) {
+    stats->peak_configuring = configuring;
+  }
+}
+
+/*
+ * Account the time to configured of a node provisioned in this boot
+ * */
+static void __stats_on_done(const prov_session_t *session, bool success) {
+  prov_scheduler_stats_t *stats = &scheduler_instance.stats;
+  uint32_t now = retry_engine_now_ms();
+
+  if (session->started_ms == 0) {
+    return;
+  }
+  stats->last_done_ms = now;
+  if (!success) {
+    stats->failed++;
+    return;
+  }
+  stats->samples[stats->configured % PROV_SCHEDULER_STATS_SAMPLES] =
+      now - session->started_ms;
+  stats->configured++;
+  app_log("Node %4.4x configured %lu ms after provisioning started\n",
+          session->unicast_address, now - session->started_ms);
+}
+
+/*
+ * Release a session whose node is removed from the network, its addresses
+ * can be handed out again
+ * */
+static void __session_drop(prov_session_t *session) {
+  stage_latency_end(&session->uuid, session->unicast_address, false);
+  __stats_on_done(session, false);
+  if (session->elements != 0) {
+    address_allocator_release(session->unicast_address);
+  }
+  __session_release(session);
+}
+
+/*
+ * Pick the addresses of a device once its number of elements is known. The
+ * stack may refuse an address it knows to be taken, the range is then left
+ * marked as used and the next one is tried. If none fits, the stack picks the
+ * address itself.
+ * */
+static void __session_set_address(prov_session_t *session, uint8_t elements) {
+  uint16_t address;
+  sl_status_t sc;
+
+  for (uint8_t i = 0; i < PROV_SCHEDULER_ADDRESS_ATTEMPTS; i++) {
+    address = address_allocator_alloc(elements);
+    if (address == ADDRESS_ALLOCATOR_NONE) {
+      return;
+    }
+
+    sc = sl_btmesh_prov_set_device_address(session->uuid, address);
+    if (sc == SL_STATUS_OK) {
+      app_log("Address %4.4x assigned to %x:%x, %d elements\n", address,
+              session->uuid.data[14], session->uuid.data[15], elements);
+      session->unicast_address = address;
+      session->elements = elements;
+      return;
+    }
+    app_log("Address %4.4x refused 0x%lx\n", address, sc);
+  }
+}
+
+/**
+ * @brief Take the next device from the DeviceManager table and start
+ * provisioning it in a free session
+ *
+ * @return uint8_t Status code defined in the header
+ */
+static uint8_t __session_start_next(void) {
+  sl_status_t sc;
+  prov_session_t *session = __session_get_free();
+  uint32_t beacon_ms = retry_engine_now_ms();
+
+  if (session == NULL) {
+    return PROV_SCHEDULER_NO_SLOT;
+  }
+
+  if (device_manager_get_next_device(&session->uuid, &session->ble_address,
+                                     &session->device_class) !=
+      DEVICE_MANAGER_SUCCESS) {
+    return PROV_SCHEDULER_NO_DEVICE;
+  }
+
+  // Take the device out of the table so that the next call does not pick it
+  // again. If provisioning fails, its beacon will put it back.
+  device_manager_get_first_seen(&session->ble_address, &beacon_ms);
+  device_manager_remove_device(&session->ble_address);
+
+  app_log("Starting to prov device with id %x:%x and ble address of %x:%x\n",
+          session->uuid.data[14], session->uuid.data[15],
+          session->ble_address.addr[5], session->ble_address.addr[4]);
+
+  /* provisioning using ADV bearer (this is the default) */
+  sl_btmesh_prov_create_provisioning_session(NETWORK_ID, session->uuid, 0);
+  sc = sl_btmesh_prov_provision_adv_device(session->uuid);
+  if (sc != SL_STATUS_OK) {
+    app_log("Provisioning fail %lX: ", sc);
+    __session_release(session);
+    return PROV_SCHEDULER_STACK_ERROR;
+  }
+
+  app_log("Provisioning request sent\n");
+  session->state = PROV_SESSION_PROVISIONING;
+  session->started_ms = retry_engine_now_ms();
+  if (scheduler_instance.stats.first_start_ms == 0) {
+    scheduler_instance.stats.first_start_ms = session->started_ms;
+  }
+  session->group_address = scheduler_instance.group_address;
+  stage_latency_begin(&session->uuid, beacon_ms);
+  status_indicator_on_provisioning();
+  __stats_on_session_start();
+
+  return PROV_SCHEDULER_SUCCESS;
+}
+
+/**
+ * @brief Send the appkey to a provisioned node
+ *
+ */
+static void __session_add_appkey(prov_session_t *session);
+
+/**
+ * @brief Retry adding the appkey after a backoff, or give up on the node once
+ * the retries are exhausted: it is removed from the device database so that
+ * it can be reset and provisioned again
+ *
+ */
+static void __session_appkey_retry(prov_session_t *session) {
+  if (session->appkey_retries_left == 0) {
+    app_log("Giving up adding the appkey to %4.4x\n",
+            session->unicast_address);
+    status_indicator_on_failed();
+    sl_btmesh_prov_delete_ddb_entry(session->uuid);
+    __session_drop(session);
+    return;
+  }
+
+  session->state = PROV_SESSION_APPKEY_BACKOFF;
+  session->deadline =
+      retry_engine_now_ms() +
+      retry_engine_backoff_ms(PROV_SCHEDULER_APPKEY_RETRIES -
+                              session->appkey_retries_left);
+  session->appkey_retries_left--;
+  retry_engine_wake_at(session->deadline);
+}
+
+static void __session_add_appkey(prov_session_t *session) {
+  sl_status_t sc;
+
+  app_log(" sending app key to node %4.4x ...\r\n", session->unicast_address);
+  sc = sl_btmesh_config_client_add_appkey(NETWORK_ID, session->unicast_address,
+                                          APPKEY_INDEX, NETWORK_ID,
+                                          &session->appkey_handle);
+  if (sc != SL_STATUS_OK) {
+    app_log(
+        "sl_btmesh_config_client_add_appkey failed with result 0x%lX "
+        "addr %x\r\n",
+        sc, session->unicast_address);
+    __session_appkey_retry(session);
+    return;
+  }
+
+  session->state = PROV_SESSION_ADDING_APPKEY;
+  session->deadline = retry_engine_now_ms() + RETRY_ENGINE_REQUEST_TIMEOUT_MS;
+  retry_engine_wake_at(session->deadline);
+}
+
+/**
+ * @brief Start the configuration of the nodes waiting for it, as long as
+ * DeviceConfiguration has free sessions
+ *
+ */
+static void __session_start_config(void) {
+  prov_session_t *session;
+  sl_status_t sc;
+
+  for (uint8_t i = 0; i < PROV_SCHEDULER_MAX_SESSIONS; i++) {
+    session = &scheduler_instance.sessions[i];
+    if (session->state != PROV_SESSION_WAITING_CONFIG) {
+      continue;
+    }
+
+    // The configuration may complete before the call returns (cached DCD),
+    // so the state is set first
+    session->state = PROV_SESSION_CONFIGURING;
+    sc = device_configuration_config_session(
+        session->unicast_address, session->group_address,
+        session->device_type, session->uuid);
+    if (sc == SL_STATUS_NO_MORE_RESOURCE) {
+      // Wait for a node to finish its configuration
+      session->state = PROV_SESSION_WAITING_CONFIG;
+      return;
+    }
+
+    // Resumed from the journal after a reset: left configuring, the session
+    // is released by provision_scheduler_on_config_done like any other
+    if (sc == SL_STATUS_ALREADY_EXISTS) {
+      app_log("Node %4.4x is being configured already\n",
+              session->unicast_address);
+      continue;
+    }
+
+    if (sc != SL_STATUS_OK) {
+      // Removed from the network like a node whose appkey never got through
+      app_log("device_configuration_config_session failed 0x%lx\n", sc);
+      status_indicator_on_failed();
+      sl_btmesh_prov_delete_ddb_entry(session->uuid);
+      __session_drop(session);
+      continue;
+    }
+    __stats_on_session_start();
+  }
+}
+
+uint8_t provision_scheduler_start(uint16_t group_address, bool continuous) {
+  uint8_t retval;
+
+  scheduler_instance.group_address = group_address;
+  scheduler_instance.continuous = continuous;
+
+  retval = __session_start_next();
+  if (retval == PROV_SCHEDULER_NO_DEVICE) {
+    app_log("No device left in the table\n");
+    scheduler_instance.continuous = false;
+  } else if (retval == PROV_SCHEDULER_NO_SLOT) {
+    app_log("All provisioning sessions are busy\n");
+  }
+
+  provision_scheduler_fill();
+  return retval;
+}
+
+void provision_scheduler_fill(void) {
+  uint8_t retval = PROV_SCHEDULER_SUCCESS;
+
+  if (!scheduler_instance.continuous) {
+    return;
+  }
+
+  while (retval == PROV_SCHEDULER_SUCCESS) {
+    retval = __session_start_next();
+  }
+
+  if (retval == PROV_SCHEDULER_NO_DEVICE &&
+      provision_scheduler_get_active_count() == 0) {
+    app_log("No device left in the table\n");
+    scheduler_instance.continuous = false;
+  }
+}
+
+void provision_scheduler_setup_addresses(uint16_t own_address,
+                                         uint32_t iv_index) {
+  uint16_t count = 0;
+  sl_status_t sc;
+
+  address_allocator_reserve(own_address, 1);
+  address_allocator_on_iv_index(iv_index);
+
+  sc = sl_btmesh_prov_set_provisioning_suspend_event(1);
+  if (sc != SL_STATUS_OK) {
+    app_log("sl_btmesh_prov_set_provisioning_suspend_event failed 0x%lx\n",
+            sc);
+  }
+
+  // The nodes come back as ddb_list events
+  sc = sl_btmesh_prov_list_ddb_entries(&count);
+  if (sc != SL_STATUS_OK) {
+    app_log("sl_btmesh_prov_list_ddb_entries failed 0x%lx\n", sc);
+  }
+  app_log("%d nodes in the device database\n", count);
+}
+
+uint8_t provision_scheduler_reconfigure(const tsNodeRecord *record) {
+  prov_session_t *session = NULL;
+
+  if (__session_find_by_uuid(&record->uuid) != NULL) {
+    // Already on its way, it picks the new settings up
+    return PROV_SCHEDULER_SUCCESS;
+  }
+
+  for (uint8_t i = 0; i < PROV_SCHEDULER_MAX_SESSIONS; i++) {
+    if (scheduler_instance.sessions[i].state == PROV_SESSION_IDLE) {
+      session = &scheduler_instance.sessions[i];
+      break;
+    }
+  }
+  if (session == NULL) {
+    return PROV_SCHEDULER_NO_SLOT;
+  }
+
+  session->uuid = record->uuid;
+  session->unicast_address = record->address;
+  session->group_address = record->group_address;
+  session->device_type = record->device_type;
+  session->state = PROV_SESSION_WAITING_CONFIG;
+  __session_start_config();
+  return PROV_SCHEDULER_SUCCESS;
+}
+
+void provision_scheduler_restore(void) {
+  const tsNodeRecord *record;
+  uint16_t address;
+  uint8_t up_to_date = 0;
+
+  for (uint8_t i = 0; i < NODE_DB_MAX_NODES; i++) {
+    record = node_db_get(i);
+    if (record == NULL) {
+      continue;
+    }
+
+    if (sl_btmesh_prov_get_ddb_entry(record->uuid, NULL, NULL, &address,
+                                     NULL) != SL_STATUS_OK ||
+        address != record->address) {
+      app_log("Node %4.4x left the network, forgetting it\n",
+              record->address);
+      node_db_remove(&record->uuid);
+      continue;
+    }
+
+    if (record->plan_hash == config_plan_get_hash()) {
+      up_to_date++;
+      continue;
+    }
+
+    // Configured by a build with another plan
+    app_log("Plan of node %4.4x changed, configuring it again\n",
+            record->address);
+    if (provision_scheduler_reconfigure(record) != PROV_SCHEDULER_SUCCESS) {
+      app_log("No session left to configure %4.4x again\n", record->address);
+      break;
+    }
+  }
+
+  app_log("%d nodes restored up to date\n", up_to_date);
+  node_db_print();
+}
+
+void provision_scheduler_on_btmesh_event(sl_btmesh_msg_t *evt) {
+  prov_session_t *session;
+  uint16_t result;
+
+  switch (SL_BT_MSG_ID(evt->header)) {
+    case sl_btmesh_evt_prov_ddb_list_id:
+      address_allocator_reserve(evt->data.evt_prov_ddb_list.address,
+                                evt->data.evt_prov_ddb_list.elements);
+      break;
+    case sl_btmesh_evt_prov_capabilities_id:
+      session = __session_find_by_uuid(&evt->data.evt_prov_capabilities.uuid);
+      if (session != NULL && session->state == PROV_SESSION_PROVISIONING &&
+          session->elements == 0) {
+        session->reported_elements = evt->data.evt_prov_capabilities.elements;
+        __session_set_address(session, session->reported_elements);
+      }
+      break;
+    case sl_btmesh_evt_node_changed_ivupdate_state_id:
+      // Only once the update is over, the old index is used until then
+      if (evt->data.evt_node_changed_ivupdate_state.state == 0) {
+        address_allocator_on_iv_index(
+            evt->data.evt_node_changed_ivupdate_state.iv_index);
+      }
+      break;
+    case sl_btmesh_evt_prov_provisioning_suspended_id:
+      if (evt->data.evt_prov_provisioning_suspended.reason ==
+          PROV_SCHEDULER_SUSPENDED_CAPABILITIES) {
+        sl_btmesh_prov_continue_provisioning(
+            evt->data.evt_prov_provisioning_suspended.uuid);
+      }
+      break;
+    case sl_btmesh_evt_prov_provisioning_failed_id:
+      session = __session_find_by_uuid(
+          &evt->data.evt_prov_provisioning_failed.uuid);
+      if (session != NULL) {
+        app_log("Session of %x:%x released, reason %x\n",
+                session->uuid.data[14], session->uuid.data[15],
+                evt->data.evt_prov_provisioning_failed.reason);
+        __session_drop(session);
+        provision_scheduler_fill();
+      }
+      break;
+    case sl_btmesh_evt_prov_device_provisioned_id:
+      session = __session_find_by_uuid(
+          &evt->data.evt_prov_device_provisioned.uuid);
+      if (session == NULL) {
+        break;
+      }
+      if (session->elements == 0) {
+        // Picked by the stack, keep the allocator in sync with the range the
+        // node really takes
+        session->unicast_address =
+            evt->data.evt_prov_device_provisioned.address;
+        session->elements =
+            session->reported_elements > 0 ? session->reported_elements : 1;
+        address_allocator_reserve(session->unicast_address, session->elements);
+      }
+
+      // Move to configuration step
+      app_log("Provisioned a %s, firmware revision %u\n",
+              session->device_class->name,
+              mesh_uuid_get_revision(&session->uuid));
+      session->device_type = session->device_class->device_type;
+      stage_latency_mark(&session->uuid, STAGE_LATENCY_PROVISIONED);
+
+      session->appkey_retries_left = PROV_SCHEDULER_APPKEY_RETRIES;
+      __session_add_appkey(session);
+
+      // The stack session is free now, start provisioning the next device
+      // while this one is being configured.
+      provision_scheduler_fill();
+      break;
+    case sl_btmesh_evt_config_client_appkey_status_id:
+      session = __session_find_by_appkey_handle(
+          evt->data.evt_config_client_appkey_status.handle);
+      if (session == NULL) {
+        break;
+      }
+      result = evt->data.evt_config_client_appkey_status.result;
+      if (result != SL_STATUS_OK &&
+          result != PROV_SCHEDULER_KEY_ALREADY_STORED) {
+        app_log("Failed to add key to device %4.4x, code %x\n",
+                session->unicast_address, result);
+        __session_appkey_retry(session);
+        provision_scheduler_fill();
+        break;
+      }
+
+      app_log(" appkey added to %4.4x\r\n", session->unicast_address);
+      stage_latency_mark(&session->uuid, STAGE_LATENCY_APPKEY_ADDED);
+      session->state = PROV_SESSION_WAITING_CONFIG;
+      __session_start_config();
+      break;
+    default:
+      break;
+  }
+}
+
+void provision_scheduler_on_config_done(uint16_t address, bool success) {
+  prov_session_t *session = __session_find_by_address(address);
+
+  app_log("Node %4.4x configuration %s\n", address,
+          success ? "complete" : "failed");
+
+  if (session != NULL) {
+    stage_latency_end(&session->uuid, session->unicast_address, success);
+    __stats_on_done(session, success);
+  }
+
+  // Not found for a configuration resumed from the journal, its session is
+  // free for the nodes waiting all the same
+  if (!success) {
+    // The node was removed from the device database
+    address_allocator_release(address);
+  }
+  if (session != NULL) {
+    __session_release(session);
+  }
+
+  __session_start_config();
+  provision_scheduler_fill();
+}
+
+void provision_scheduler_on_retry_tick(void) {
+  uint32_t now = retry_engine_now_ms();
+  prov_session_t *session;
+
+  for (uint8_t i = 0; i < PROV_SCHEDULER_MAX_SESSIONS; i++) {
+    session = &scheduler_instance.sessions[i];
+    if (session->state != PROV_SESSION_ADDING_APPKEY &&
+        session->state != PROV_SESSION_APPKEY_BACKOFF) {
+      continue;
+    }
+
+    if (!retry_engine_is_due(session->deadline, now)) {
+      retry_engine_wake_at(session->deadline);
+      continue;
+    }
+
+    if (session->state == PROV_SESSION_ADDING_APPKEY) {
+      app_log("Adding the appkey to %4.4x timed out\n",
+              session->unicast_address);
+      retry_engine_count_timeout();
+      sl_btmesh_config_client_cancel_request(session->appkey_handle);
+      __session_appkey_retry(session);
+    } else if (retry_engine_take_budget()) {
+      __session_add_appkey(session);
+    } else {
+      session->deadline = now + RETRY_ENGINE_BUDGET_REFILL_MS;
+      retry_engine_wake_at(session->deadline);
+    }
+  }
+
+  provision_scheduler_fill();
+}
+
+/*
+ * Nearest rank of a percentile among count sorted samples
+ * */
+static uint16_t __stats_rank(uint16_t count, uint8_t percentile) {
+  uint16_t rank = (uint16_t)((count * percentile + 99) / 100);
+
+  return rank > 0 ? rank - 1 : 0;
+}
+
+void provision_scheduler_print_stats(void) {
+  const prov_scheduler_stats_t *stats = &scheduler_instance.stats;
+  uint32_t sorted[PROV_SCHEDULER_STATS_SAMPLES];
+  uint16_t count = stats->configured < PROV_SCHEDULER_STATS_SAMPLES
+                       ? stats->configured
+                       : PROV_SCHEDULER_STATS_SAMPLES;
+  uint32_t sample;
+  uint16_t session_size = device_configuration_get_session_size();
+  uint16_t j;
+
+  if (stats->configured == 0 && stats->failed == 0) {
+    return;
+  }
+  app_log("Commissioning: %u nodes configured, %u failed in %lu ms\n",
+          stats->configured, stats->failed,
+          stats->last_done_ms - stats->first_start_ms);
+
+  // Insertion sort, the ring is small and only sorted when printed
+  for (uint16_t i = 0; i < count; i++) {
+    sample = stats->samples[i];
+    for (j = i; j > 0 && sorted[j - 1] > sample; j--) {
+      sorted[j] = sorted[j - 1];
+    }
+    sorted[j] = sample;
+  }
+  if (count > 0) {
+    app_log("  time to configured of the last %u: %lu/%lu/%lu/%lu ms "
+            "min/p50/p90/max\n",
+            count, sorted[0], sorted[__stats_rank(count, 50)],
+            sorted[__stats_rank(count, 90)], sorted[count - 1]);
+  }
+
+  app_log("  peak %u sessions in flight, %u configuring: %u bytes of the %u "
+          "reserved, config arena peak %u/%u bytes\n",
+          stats->peak_sessions, stats->peak_configuring,
+          (unsigned)(stats->peak_sessions * sizeof(prov_session_t) +
+                     stats->peak_configuring * session_size),
+          (unsigned)(PROV_SCHEDULER_MAX_SESSIONS * sizeof(prov_session_t) +
+                     DEVICE_CONFIG_MAX_SESSIONS * session_size),
+          device_configuration_get_arena_peak(), DEVICE_CONFIG_ARENA_BYTES);
+}
+
+uint8_t provision_scheduler_get_active_count(void) {
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < PROV_SCHEDULER_MAX_SESSIONS; i++) {
+    if (scheduler_instance.sessions[i].state != PROV_SESSION_IDLE) {
+      count++;
+    }
+  }
+  return count;
+}
@@ -0,0 +1,161 @@
+#ifndef __PROV_SCHED__
+#define __PROV_SCHED__
+
+#include <stdbool.h>
+
+#include "DeviceClass.h"
+#include "DeviceConfiguration.h"
+#include "NodeDatabase.h"
+#include "sl_btmesh_api.h"
+#include "sl_btmesh_config.h"
+
+// Number of devices being provisioned at the same time, bounded by the stack
+#define PROV_SCHEDULER_MAX_PROVISIONING SL_BTMESH_CONFIG_MAX_PROV_SESSIONS
+
+// Number of devices that can be in flight (provisioning, adding appkey or
+// being configured) at the same time
+#define PROV_SCHEDULER_MAX_SESSIONS \
+  (PROV_SCHEDULER_MAX_PROVISIONING + DEVICE_CONFIG_MAX_SESSIONS)
+
+#define PROV_SCHEDULER_SUCCESS 0
+#define PROV_SCHEDULER_NO_SLOT 1
+#define PROV_SCHEDULER_NO_DEVICE 2
+#define PROV_SCHEDULER_SESSION_NOT_FOUND 3
+#define PROV_SCHEDULER_STACK_ERROR 4
+
+// Number of times adding the appkey is retried before giving up on the node
+#define PROV_SCHEDULER_APPKEY_RETRIES 3
+
+// Times to configured of the last nodes kept for the percentiles printed by
+// provision_scheduler_print_stats
+#define PROV_SCHEDULER_STATS_SAMPLES 32
+
+typedef enum {
+  PROV_SESSION_IDLE = 0,
+  PROV_SESSION_PROVISIONING,
+  PROV_SESSION_ADDING_APPKEY,
+  // Adding the appkey failed, waiting for the retry time
+  PROV_SESSION_APPKEY_BACKOFF,
+  PROV_SESSION_WAITING_CONFIG,
+  PROV_SESSION_CONFIGURING,
+} prov_session_state_t;
+
+/**
+ * @brief Context of one device going through the provisioning pipeline
+ *
+ */
+typedef struct prov_session {
+  prov_session_state_t state;
+  uuid_128 uuid;
+  bd_addr ble_address;
+  uint16_t unicast_address;
+  // Number of addresses taken by the node, 0 until its capabilities arrive
+  uint8_t elements;
+  // Number of elements in its capabilities, kept in case the stack picks the
+  // address itself
+  uint8_t reported_elements;
+  uint16_t group_address;
+  // Classified from the beacon, NULL for a node configured again
+  const device_class_t *device_class;
+  uint8_t device_type;
+  uint32_t appkey_handle;
+  uint8_t appkey_retries_left;
+  // Status deadline of the appkey request, or its retry time in backoff
+  uint32_t deadline;
+  // When provisioning started, 0 for a node configured again
+  uint32_t started_ms;
+} prov_session_t;
+
+/**
+ * @brief Init the scheduler, all sessions are set to idle
+ *
+ */
+void provision_scheduler_init(void);
+
+/**
+ * @brief Start provisioning devices from the DeviceManager table
+ *
+ * @param group_address The group the provisioned nodes will be configured to
+ * @param continuous If true, keep refilling free sessions until the table is
+ *                   empty. If false, only one device is provisioned.
+ * @return uint8_t Status code defined above
+ */
+uint8_t provision_scheduler_start(uint16_t group_address, bool continuous);
+
+/**
+ * @brief Start new sessions until all slots are busy or there is no device
+ * left in the table. Only does something in continuous mode.
+ *
+ */
+void provision_scheduler_fill(void);
+
+/**
+ * @brief Ask the stack to pause provisioning once the capabilities of a
+ * device are known, so that its addresses are picked by the AddressAllocator.
+ * The allocator is filled with the nodes of the device database. Call it once
+ * the stack is ready.
+ *
+ * @param own_address The primary element address of the provisioner
+ * @param iv_index The IV index of the network, see
+ * address_allocator_on_iv_index
+ */
+void provision_scheduler_setup_addresses(uint16_t own_address,
+                                         uint32_t iv_index);
+
+/**
+ * @brief Go through the nodes saved in the node database once the stack is
+ * ready: the ones gone from the device database are forgotten, the ones
+ * configured with another plan are configured again, the others are left
+ * untouched
+ *
+ */
+void provision_scheduler_restore(void);
+
+/**
+ * @brief Configure a known node again, e.g. when its plan or its publication
+ * TTL changed
+ *
+ * @param record The record of the node
+ * @return uint8_t PROV_SCHEDULER_NO_SLOT if all sessions are busy
+ */
+uint8_t provision_scheduler_reconfigure(const tsNodeRecord *record);
+
+/**
+ * @brief Handle the provisioning events of the stack
+ *
+ * @param evt Event coming from the Bluetooth Mesh stack
+ */
+void provision_scheduler_on_btmesh_event(sl_btmesh_msg_t *evt);
+
+/**
+ * @brief Notify the scheduler that the configuration of a node has ended
+ *
+ * @param address The unicast address of the configured node
+ * @param success True if the configuration completed successfully
+ */
+void provision_scheduler_on_config_done(uint16_t address, bool success);
+
+/**
+ * @brief Check the deadline of the appkey requests, called when the retry
+ * timer expires
+ *
+ */
+void provision_scheduler_on_retry_tick(void);
+
+/**
+ * @brief Print the commissioning of the nodes provisioned since boot: nodes
+ * configured and failed, time to configured of the last
+ * PROV_SCHEDULER_STATS_SAMPLES nodes as min/p50/p90/max, the most sessions
+ * in flight at the same time and the RAM they took
+ *
+ */
+void provision_scheduler_print_stats(void);
+
+/**
+ * @brief Get the number of sessions currently in flight
+ *
+ * @return uint8_t Number of non-idle sessions
+ */
+uint8_t provision_scheduler_get_active_count(void);
+
+#endif  // __PROV_SCHED__
@@ -0,0 +1,455 @@
+#include "RelayPlanner.h"
+
+#include <string.h>
+
+#include "NetworkConfiguration.h"
+#include "RetryEngine.h"
+#include "app_log.h"
+
+// The provisioner is one more vertex of the graph, it does not relay
+#define RELAY_PLANNER_ROOT TOPOLOGY_MAX_NODES
+#define RELAY_PLANNER_VERTICES (TOPOLOGY_MAX_NODES + 1)
+
+#define RELAY_PLANNER_BITMAP_WORDS ((TOPOLOGY_MAX_NODES + 31) / 32)
+
+typedef enum {
+  // Not dominated yet
+  RELAY_VERTEX_WHITE = 0,
+  // Next to a relay
+  RELAY_VERTEX_GRAY,
+  // Relay
+  RELAY_VERTEX_BLACK,
+  // Not part of the graph
+  RELAY_VERTEX_NONE,
+} relay_vertex_color_t;
+
+/**
+ * @brief One relay request waiting for its status
+ *
+ */
+typedef struct {
+  uint8_t index;
+  bool in_flight;
+  uint32_t handle;
+  uint32_t deadline;
+} relay_request_t;
+
+typedef struct relay_planner {
+  // Relay state wanted for each index of the topology, and the one the node
+  // is known to have
+  uint32_t wanted[RELAY_PLANNER_BITMAP_WORDS];
+  uint32_t applied[RELAY_PLANNER_BITMAP_WORDS];
+  // Indexes whose relay state must be sent
+  uint32_t dirty[RELAY_PLANNER_BITMAP_WORDS];
+  relay_request_t requests[RELAY_PLANNER_WINDOW_SIZE];
+
+  // Work areas of the greedy search
+  uint8_t color[RELAY_PLANNER_VERTICES];
+  // Number of white neighbours of each vertex
+  uint8_t gain[RELAY_PLANNER_VERTICES];
+} relay_planner_t;
+
+static relay_planner_t planner_instance;
+
+static bool __test(const uint32_t *bitmap, uint8_t index) {
+  return (bitmap[index / 32] >> (index % 32)) & 1;
+}
+
+static void __assign(uint32_t *bitmap, uint8_t index, bool value) {
+  if (value) {
+    bitmap[index / 32] |= 1UL << (index % 32);
+  } else {
+    bitmap[index / 32] &= ~(1UL << (index % 32));
+  }
+}
+
+void relay_planner_init(void) {
+  memset(&planner_instance, 0, sizeof(planner_instance));
+  // Relaying is on out of the box
+  memset(planner_instance.wanted, 0xFF, sizeof(planner_instance.wanted));
+  memset(planner_instance.applied, 0xFF, sizeof(planner_instance.applied));
+}
+
+/**
+ * @brief Graph the relays are chosen in. Vertex count - 1 is the root, the
+ * provisioner: it must be reached but does not relay.
+ *
+ */
+typedef struct {
+  uint16_t count;
+  // Vertex in use, a free index of the topology is not
+  bool (*is_present)(uint16_t v);
+  // Vertex allowed to relay, the others are leaves
+  bool (*can_relay)(uint16_t v);
+  bool (*is_linked)(uint16_t a, uint16_t b);
+} relay_graph_t;
+
+static bool __topology_is_present(uint16_t v) {
+  return v == RELAY_PLANNER_ROOT || topology_get_address(v) != 0;
+}
+
+static bool __topology_can_relay(uint16_t v) {
+  return v != RELAY_PLANNER_ROOT &&
+         topology_get_hops(v) != TOPOLOGY_HOPS_UNKNOWN;
+}
+
+static bool __topology_is_linked(uint16_t a, uint16_t b) {
+  if (a == RELAY_PLANNER_ROOT) {
+    return topology_get_hops(b) == 1;
+  }
+  if (b == RELAY_PLANNER_ROOT) {
+    return topology_get_hops(a) == 1;
+  }
+  return topology_is_linked(a, b);
+}
+
+static const relay_graph_t topology_graph = {
+    RELAY_PLANNER_VERTICES, __topology_is_present, __topology_can_relay,
+    __topology_is_linked};
+
+/*
+ * A vertex stops being white: its neighbours have one white neighbour less
+ * */
+static void __dominate(const relay_graph_t *graph, uint16_t v) {
+  planner_instance.color[v] = RELAY_VERTEX_GRAY;
+  for (uint16_t u = 0; u < graph->count; u++) {
+    if (planner_instance.color[u] != RELAY_VERTEX_NONE &&
+        graph->is_linked(u, v)) {
+      planner_instance.gain[u]--;
+    }
+  }
+}
+
+/*
+ * Make a vertex a relay, its white neighbours are dominated by it
+ * */
+static void __make_relay(const relay_graph_t *graph, uint16_t v,
+                         uint16_t *white) {
+  if (planner_instance.color[v] == RELAY_VERTEX_WHITE) {
+    __dominate(graph, v);
+    (*white)--;
+  }
+  planner_instance.color[v] = RELAY_VERTEX_BLACK;
+  for (uint16_t u = 0; u < graph->count; u++) {
+    if (planner_instance.color[u] == RELAY_VERTEX_WHITE &&
+        graph->is_linked(u, v)) {
+      __dominate(graph, u);
+      (*white)--;
+    }
+  }
+}
+
+/*
+ * Greedy connected dominating set: start from the node that reaches the most
+ * others, then keep turning into a relay the node next to the relays that
+ * reaches the most nodes not covered yet. Every node ends up next to a relay
+ * and the relays are connected, a flood reaches everyone through them. The
+ * leaves and the root are covered like the others but never picked.
+ * The result is left in the colors, relays are black.
+ * Return false if the graph is not connected.
+ * */
+static bool __plan(const relay_graph_t *graph) {
+  uint16_t count = graph->count;
+  uint16_t white = 0;
+  uint16_t best;
+  bool first = true;
+
+  for (uint16_t v = 0; v < count; v++) {
+    planner_instance.gain[v] = 0;
+    planner_instance.color[v] = graph->is_present(v) ? RELAY_VERTEX_WHITE
+                                                     : RELAY_VERTEX_NONE;
+    white += planner_instance.color[v] == RELAY_VERTEX_WHITE;
+  }
+  for (uint16_t v = 0; v < count; v++) {
+    for (uint16_t u = v + 1; u < count; u++) {
+      if (planner_instance.color[v] != RELAY_VERTEX_NONE &&
+          planner_instance.color[u] != RELAY_VERTEX_NONE &&
+          graph->is_linked(u, v)) {
+        planner_instance.gain[u]++;
+        planner_instance.gain[v]++;
+      }
+    }
+  }
+
+  while (white > 0) {
+    best = RELAY_PLANNER_VERTICES;
+    for (uint16_t v = 0; v < count; v++) {
+      if (planner_instance.color[v] == RELAY_VERTEX_NONE ||
+          planner_instance.color[v] == RELAY_VERTEX_BLACK ||
+          !graph->can_relay(v)) {
+        continue;
+      }
+      // The first relay may be anywhere, the next ones extend the backbone
+      if (!first && planner_instance.color[v] != RELAY_VERTEX_GRAY) {
+        continue;
+      }
+      if (best == RELAY_PLANNER_VERTICES ||
+          planner_instance.gain[v] > planner_instance.gain[best]) {
+        best = v;
+      }
+    }
+    if (best == RELAY_PLANNER_VERTICES ||
+        (planner_instance.gain[best] == 0 &&
+         planner_instance.color[best] != RELAY_VERTEX_WHITE)) {
+      return false;
+    }
+    __make_relay(graph, best, &white);
+    first = false;
+  }
+  return true;
+}
+
+#if RELAY_PLANNER_SELF_CHECK
+// Fixed graphs of up to 16 vertices, one adjacency row per vertex
+#define RELAY_CHECK_MAX_VERTICES 16
+
+typedef struct {
+  const char *name;
+  uint16_t count;
+  uint16_t rows[RELAY_CHECK_MAX_VERTICES];
+  uint16_t leaves;
+  bool connected;
+  // Relays expected, 0 if any valid set will do
+  uint8_t relays;
+} relay_check_graph_t;
+
+static const relay_check_graph_t relay_check_graphs[] = {
+    // root - 0 - 1 - 2 - 3
+    {"line", 5, {0x012, 0x005, 0x00A, 0x004, 0x001}, 0, true, 3},
+    // root - 0, 0 in the middle of 1..5
+    {"star", 7, {0x07E, 0x001, 0x001, 0x001, 0x001, 0x001, 0x001}, 0, true, 1},
+    // 3x3 grid, vertex 3 * row + column, the root next to vertex 0
+    {"grid",
+     10,
+     {0x20A, 0x015, 0x022, 0x051, 0x0AA, 0x114, 0x088, 0x150, 0x0A0, 0x001},
+     0,
+     true,
+     0},
+    // root - 0 - 1, leaf 2 next to 1
+    {"leaf", 4, {0x00A, 0x005, 0x002, 0x001}, 0x004, true, 2},
+    // root - 0 - 1 - leaf 2 - 3, nothing relays for 3
+    {"behind a leaf", 5, {0x012, 0x005, 0x00A, 0x004, 0x001}, 0x004, false,
+     0},
+    // 2 - 3 is not reachable from the root
+    {"split", 5, {0x012, 0x001, 0x008, 0x004, 0x001}, 0, false, 0},
+};
+
+static const relay_check_graph_t *relay_check_graph;
+
+static bool __check_is_present(uint16_t v) {
+  (void)v;
+  return true;
+}
+
+static bool __check_can_relay(uint16_t v) {
+  return v != relay_check_graph->count - 1 &&
+         !((relay_check_graph->leaves >> v) & 1);
+}
+
+static bool __check_is_linked(uint16_t a, uint16_t b) {
+  return (relay_check_graph->rows[a] >> b) & 1;
+}
+
+/*
+ * Check the colors left by __plan: the relays may relay, every vertex is
+ * one or next to one, and the relays are connected
+ * */
+static bool __check_plan(const relay_graph_t *graph, uint8_t *relays) {
+  uint16_t reached;
+  uint16_t black = 0;
+  bool grown = true;
+  bool covered;
+
+  for (uint16_t v = 0; v < graph->count; v++) {
+    if (planner_instance.color[v] == RELAY_VERTEX_BLACK) {
+      if (!graph->can_relay(v)) {
+        return false;
+      }
+      black |= 1 << v;
+    }
+  }
+  for (uint16_t v = 0; v < graph->count; v++) {
+    covered = (black >> v) & 1;
+    for (uint16_t u = 0; u < graph->count && !covered; u++) {
+      covered = ((black >> u) & 1) && graph->is_linked(u, v);
+    }
+    if (!covered) {
+      return false;
+    }
+  }
+
+  reached = black & -black;
+  while (grown) {
+    grown = false;
+    for (uint16_t v = 0; v < graph->count; v++) {
+      for (uint16_t u = 0; u < graph->count; u++) {
+        if (((black & ~reached) >> v) & 1 && (reached >> u) & 1 &&
+            graph->is_linked(u, v)) {
+          reached |= 1 << v;
+          grown = true;
+        }
+      }
+    }
+  }
+
+  *relays = 0;
+  for (uint16_t v = 0; v < graph->count; v++) {
+    *relays += (black >> v) & 1;
+  }
+  return reached == black;
+}
+
+bool relay_planner_self_check(void) {
+  relay_graph_t graph = {0, __check_is_present, __check_can_relay,
+                         __check_is_linked};
+  const relay_check_graph_t *check;
+  bool connected;
+  bool ok = true;
+  uint8_t relays = 0;
+
+  for (uint8_t i = 0;
+       i < sizeof(relay_check_graphs) / sizeof(relay_check_graphs[0]); i++) {
+    check = &relay_check_graphs[i];
+    relay_check_graph = check;
+    graph.count = check->count;
+
+    connected = __plan(&graph);
+    if (connected != check->connected ||
+        (connected && (!__check_plan(&graph, &relays) ||
+                       (check->relays != 0 && relays != check->relays)))) {
+      app_log("Relay planner check: %s failed\n", check->name);
+      ok = false;
+    }
+  }
+  app_log("Relay planner check: %s\n", ok ? "passed" : "FAILED");
+  return ok;
+}
+#endif
+
+/*
+ * Send the relay state to the nodes that must change, within the window
+ * */
+static void __pump(void) {
+  relay_request_t *request;
+  uint8_t count = topology_get_count();
+  bool value;
+  sl_status_t sc;
+
+  for (uint8_t i = 0; i < RELAY_PLANNER_WINDOW_SIZE; i++) {
+    request = &planner_instance.requests[i];
+    if (request->in_flight) {
+      continue;
+    }
+
+    for (uint8_t index = 0; index < count; index++) {
+      if (!__test(planner_instance.dirty, index)) {
+        continue;
+      }
+      __assign(planner_instance.dirty, index, false);
+      if (topology_get_address(index) == 0) {
+        continue;
+      }
+
+      value = __test(planner_instance.wanted, index);
+      sc = sl_btmesh_config_client_set_relay(
+          NETWORK_ID, topology_get_address(index), value,
+          RELAY_PLANNER_RETRANSMIT_COUNT, RELAY_PLANNER_RETRANSMIT_INTERVAL_MS,
+          &request->handle);
+      if (sc != SL_STATUS_OK) {
+        // Sent again at the next run
+        app_log("Relay %s on %4.4x failed 0x%lx\n", value ? "on" : "off",
+                topology_get_address(index), sc);
+        continue;
+      }
+      request->index = index;
+      request->in_flight = true;
+      request->deadline =
+          retry_engine_now_ms() + RETRY_ENGINE_REQUEST_TIMEOUT_MS;
+      retry_engine_wake_at(request->deadline);
+      break;
+    }
+  }
+}
+
+void relay_planner_run(void) {
+  uint8_t count = topology_get_count();
+  uint16_t nodes = 0, relays = 0, leaves = 0, changes = 0;
+  bool relay;
+
+  if (!__plan(&topology_graph)) {
+    app_log("Relay planning: the network is not connected, nothing changed\n");
+    return;
+  }
+
+  for (uint8_t i = 0; i < count; i++) {
+    if (topology_get_address(i) == 0) {
+      continue;
+    }
+    relay = planner_instance.color[i] == RELAY_VERTEX_BLACK;
+    nodes++;
+    relays += relay;
+    leaves += !__topology_can_relay(i);
+    __assign(planner_instance.wanted, i, relay);
+    if (__test(planner_instance.applied, i) != relay) {
+      __assign(planner_instance.dirty, i, true);
+      changes++;
+    }
+  }
+
+  // Every relay sends a flooded message once, plus its publisher
+  app_log("Relay planning: %d of %d nodes relay (%d leaves), %d changes, "
+          "%d -> %d transmissions per message\n",
+          relays, nodes, leaves, changes, nodes + 1, relays + 1);
+  __pump();
+}
+
+void relay_planner_on_btmesh_event(sl_btmesh_msg_t *evt) {
+  relay_request_t *request;
+
+  if (SL_BT_MSG_ID(evt->header) !=
+      sl_btmesh_evt_config_client_relay_status_id) {
+    return;
+  }
+
+  for (uint8_t i = 0; i < RELAY_PLANNER_WINDOW_SIZE; i++) {
+    request = &planner_instance.requests[i];
+    if (!request->in_flight ||
+        request->handle != evt->data.evt_config_client_relay_status.handle) {
+      continue;
+    }
+
+    request->in_flight = false;
+    if (evt->data.evt_config_client_relay_status.result == SL_STATUS_OK) {
+      __assign(planner_instance.applied, request->index,
+               evt->data.evt_config_client_relay_status.relay != 0);
+    } else {
+      app_log("Relay state of %4.4x refused, code %x\n",
+              topology_get_address(request->index),
+              evt->data.evt_config_client_relay_status.result);
+    }
+    __pump();
+    return;
+  }
+}
+
+void relay_planner_on_retry_tick(void) {
+  uint32_t now = retry_engine_now_ms();
+  relay_request_t *request;
+
+  for (uint8_t i = 0; i < RELAY_PLANNER_WINDOW_SIZE; i++) {
+    request = &planner_instance.requests[i];
+    if (!request->in_flight) {
+      continue;
+    }
+    if (!retry_engine_is_due(request->deadline, now)) {
+      retry_engine_wake_at(request->deadline);
+      continue;
+    }
+
+    // Left as it is, the next run sends it again
+    retry_engine_count_timeout();
+    sl_btmesh_config_client_cancel_request(request->handle);
+    request->in_flight = false;
+  }
+  __pump();
+}
@@ -0,0 +1,62 @@
+#ifndef __RELAY_PLANNER__
+#define __RELAY_PLANNER__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "Topology.h"
+#include "sl_btmesh_api.h"
+
+// Relay requests waiting for their status at the same time
+#define RELAY_PLANNER_WINDOW_SIZE 2
+
+// Relay retransmissions set with the relay state
+#define RELAY_PLANNER_RETRANSMIT_COUNT 0
+#define RELAY_PLANNER_RETRANSMIT_INTERVAL_MS 10
+
+// Check the greedy search on fixed graphs at init, it needs neither the stack
+// nor the topology so it runs on the host as well
+#ifndef RELAY_PLANNER_SELF_CHECK
+#define RELAY_PLANNER_SELF_CHECK 0
+#endif
+
+/**
+ * @brief Init the planner, every node is assumed to relay
+ *
+ */
+void relay_planner_init(void);
+
+/**
+ * @brief Choose the relays from the topology map and send the relay state to
+ * the nodes that must change. A node with unknown hops (no heartbeat heard,
+ * see TOPOLOGY_HOPS_UNKNOWN) is a leaf: it must be next to a relay but is
+ * never made one itself. Nothing is changed when the map is not connected.
+ *
+ */
+void relay_planner_run(void);
+
+#if RELAY_PLANNER_SELF_CHECK
+/**
+ * @brief Plan fixed graphs (line, star, grid, leaves) and check that the
+ * relays reach every node and are connected
+ *
+ * @return bool True if every graph gave the expected result
+ */
+bool relay_planner_self_check(void);
+#endif
+
+/**
+ * @brief Handle the relay statuses
+ *
+ * @param evt Event coming from the Bluetooth Mesh stack
+ */
+void relay_planner_on_btmesh_event(sl_btmesh_msg_t *evt);
+
+/**
+ * @brief Check the deadline of the relay requests, called when the retry
+ * timer expires
+ *
+ */
+void relay_planner_on_retry_tick(void);
+
+#endif  // __RELAY_PLANNER__
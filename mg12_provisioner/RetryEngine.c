@@ -0,0 +1,138 @@
+#include "RetryEngine.h"
+
+#include <string.h>
+
+#include "app_log.h"
+#include "sl_bt_api.h"
+#include "sl_sleeptimer.h"
+
+typedef struct retry_engine {
+  sl_sleeptimer_timer_handle_t timer;
+  bool armed;
+  uint32_t wake_at;
+
+  uint8_t budget;
+  uint32_t last_refill;
+
+  uint32_t random_state;
+
+  uint32_t retries;
+  uint32_t timeouts;
+  uint32_t denied;
+} retry_engine_t;
+
+static retry_engine_t engine_instance;
+
+static void retry_timer_on_timeout(sl_sleeptimer_timer_handle_t *handle,
+                                   void *data) {
+  (void)handle;
+  (void)data;
+
+  // Runs in interrupt context, the work is done in the event loop
+  sl_bt_external_signal(RETRY_ENGINE_SIGNAL);
+}
+
+/*
+ * xorshift32 mixed with the tick count, only used for the jitter
+ * */
+static uint32_t __random(void) {
+  uint32_t x = engine_instance.random_state ^ sl_sleeptimer_get_tick_count();
+
+  if (x == 0) {
+    x = 0x2545F491;
+  }
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  engine_instance.random_state = x;
+  return x;
+}
+
+void retry_engine_init(void) {
+  memset(&engine_instance, 0, sizeof(engine_instance));
+  engine_instance.budget = RETRY_ENGINE_BUDGET;
+  engine_instance.last_refill = retry_engine_now_ms();
+  engine_instance.random_state = sl_sleeptimer_get_tick_count();
+}
+
+uint32_t retry_engine_now_ms(void) {
+  uint64_t ms = 0;
+
+  sl_sleeptimer_tick64_to_ms(sl_sleeptimer_get_tick_count64(), &ms);
+  return (uint32_t)ms;
+}
+
+uint32_t retry_engine_backoff_ms(uint8_t attempt) {
+  uint32_t backoff = RETRY_ENGINE_BACKOFF_MAX_MS;
+
+  if (attempt < 16) {
+    backoff = (uint32_t)RETRY_ENGINE_BACKOFF_BASE_MS << attempt;
+    if (backoff > RETRY_ENGINE_BACKOFF_MAX_MS) {
+      backoff = RETRY_ENGINE_BACKOFF_MAX_MS;
+    }
+  }
+
+  return backoff / 2 + __random() % (backoff / 2 + 1);
+}
+
+bool retry_engine_take_budget(void) {
+  uint32_t now = retry_engine_now_ms();
+  uint32_t refill = (now - engine_instance.last_refill) /
+                    RETRY_ENGINE_BUDGET_REFILL_MS;
+
+  if (refill > 0) {
+    engine_instance.last_refill += refill * RETRY_ENGINE_BUDGET_REFILL_MS;
+    if (refill > (uint32_t)(RETRY_ENGINE_BUDGET - engine_instance.budget)) {
+      engine_instance.budget = RETRY_ENGINE_BUDGET;
+    } else {
+      engine_instance.budget += refill;
+    }
+  }
+
+  if (engine_instance.budget == 0) {
+    engine_instance.denied++;
+    return false;
+  }
+  engine_instance.budget--;
+  engine_instance.retries++;
+  return true;
+}
+
+void retry_engine_wake_at(uint32_t deadline) {
+  uint32_t now = retry_engine_now_ms();
+  uint32_t delay = 1;
+
+  if (engine_instance.armed &&
+      retry_engine_is_due(engine_instance.wake_at, deadline)) {
+    // Already firing earlier
+    return;
+  }
+
+  if (!retry_engine_is_due(deadline, now)) {
+    delay = deadline - now;
+  }
+
+  engine_instance.armed = true;
+  engine_instance.wake_at = deadline;
+  sl_sleeptimer_restart_timer_ms(
+      &engine_instance.timer, delay, retry_timer_on_timeout, NULL, 0,
+      SL_SLEEPTIMER_NO_HIGH_PRECISION_HF_CLOCKS_REQUIRED_FLAG);
+}
+
+bool retry_engine_on_signal(uint32_t extsignals) {
+  if ((extsignals & RETRY_ENGINE_SIGNAL) == 0) {
+    return false;
+  }
+  engine_instance.armed = false;
+  return true;
+}
+
+void retry_engine_count_timeout(void) {
+  engine_instance.timeouts++;
+}
+
+void retry_engine_print_stats(void) {
+  app_log("Retries: %lu sent, %lu timeouts, %lu delayed by the budget\n",
+          engine_instance.retries, engine_instance.timeouts,
+          engine_instance.denied);
+}
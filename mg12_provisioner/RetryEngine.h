@@ -0,0 +1,93 @@
+#ifndef __RETRY_ENGINE__
+#define __RETRY_ENGINE__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// External signal raised when the retry timer expires
+#define RETRY_ENGINE_SIGNAL 0x01
+
+// Time given to a config request to get its status before it is cancelled.
+// Longer than the default timeout of the config client so that the stack
+// normally reports the timeout first, this one catches the lost ones.
+#define RETRY_ENGINE_REQUEST_TIMEOUT_MS 10000
+
+// Backoff before the n-th retry is base * 2^n, capped, then jittered down to
+// half of it so that nodes failing together do not retry together
+#define RETRY_ENGINE_BACKOFF_BASE_MS 250
+#define RETRY_ENGINE_BACKOFF_MAX_MS 8000
+
+// Global retry budget shared by all the nodes: at most
+// RETRY_ENGINE_BUDGET retries in a burst, then one every
+// RETRY_ENGINE_BUDGET_REFILL_MS
+#define RETRY_ENGINE_BUDGET 8
+#define RETRY_ENGINE_BUDGET_REFILL_MS 500
+
+/**
+ * @brief Init the retry engine, the budget is full
+ *
+ */
+void retry_engine_init(void);
+
+/**
+ * @brief Get the time base used for the deadlines
+ *
+ * @return uint32_t Milliseconds since boot, wraps around
+ */
+uint32_t retry_engine_now_ms(void);
+
+/**
+ * @brief Check if a deadline is reached, wrap around safe
+ *
+ */
+static inline bool retry_engine_is_due(uint32_t deadline, uint32_t now) {
+  return (int32_t)(now - deadline) >= 0;
+}
+
+/**
+ * @brief Get the jittered delay before a retry
+ *
+ * @param attempt Number of retries already done for the request
+ * @return uint32_t Delay in milliseconds
+ */
+uint32_t retry_engine_backoff_ms(uint8_t attempt);
+
+/**
+ * @brief Take one retry from the global budget
+ *
+ * @return true The retry may be sent now
+ * @return false Budget exhausted, try again after
+ * RETRY_ENGINE_BUDGET_REFILL_MS
+ */
+bool retry_engine_take_budget(void);
+
+/**
+ * @brief Make sure the retry timer fires no later than a deadline. The timer
+ * only keeps the earliest deadline, the modules arm it again for the next one
+ * on each tick.
+ *
+ * @param deadline Time returned by retry_engine_now_ms() plus a delay
+ */
+void retry_engine_wake_at(uint32_t deadline);
+
+/**
+ * @brief Handle the external signals of the Bluetooth stack
+ *
+ * @param extsignals Signals of the sl_bt_evt_system_external_signal event
+ * @return true The retry timer expired, the deadlines must be checked
+ */
+bool retry_engine_on_signal(uint32_t extsignals);
+
+/**
+ * @brief Print the number of retries, timeouts and budget denials
+ *
+ */
+void retry_engine_print_stats(void);
+
+/**
+ * @brief Count a request that got no status before its deadline
+ *
+ */
+void retry_engine_count_timeout(void);
+
+#endif  // __RETRY_ENGINE__
@@ -0,0 +1,252 @@
+#include "StageLatency.h"
+
+#include <string.h>
+
+#include "RetryEngine.h"
+#include "app_log.h"
+#include "sl_iostream.h"
+
+// The dump buffer holds one history record or one row of the histograms
+#define STAGE_LATENCY_DUMP_BUF (4 + 4 * STAGE_LATENCY_STAGES)
+#if 2 * STAGE_LATENCY_BUCKETS > STAGE_LATENCY_DUMP_BUF
+#error "A row of the histograms must fit in the dump buffer"
+#endif
+
+/**
+ * @brief Stage times of one device being commissioned
+ *
+ */
+typedef struct {
+  uuid_128 uuid;
+  bool in_use;
+  // Bit i set once stage i was reached
+  uint16_t reached;
+  uint32_t at_ms[STAGE_LATENCY_STAGES];
+} stage_trace_t;
+
+/**
+ * @brief Stage times of a device commissioned, relative to its beacon
+ *
+ */
+typedef struct {
+  uint16_t address;
+  uint16_t reached;
+  uint32_t offset_ms[STAGE_LATENCY_STAGES];
+} stage_record_t;
+
+typedef struct stage_latency {
+  stage_trace_t traces[STAGE_LATENCY_MAX_TRACES];
+  uint16_t histograms[STAGE_LATENCY_STAGES][STAGE_LATENCY_BUCKETS];
+  stage_record_t history[STAGE_LATENCY_HISTORY];
+  // Next record of the history to write, oldest one once it is full
+  uint8_t history_next;
+  uint8_t history_count;
+  uint16_t done;
+  uint16_t failed;
+} stage_latency_t;
+
+static stage_latency_t latency_instance;
+
+static stage_trace_t *__trace_find(const uuid_128 *uuid) {
+  for (uint8_t i = 0; i < STAGE_LATENCY_MAX_TRACES; i++) {
+    if (latency_instance.traces[i].in_use &&
+        memcmp(&latency_instance.traces[i].uuid, uuid, sizeof(*uuid)) == 0) {
+      return &latency_instance.traces[i];
+    }
+  }
+  return NULL;
+}
+
+static uint8_t __bucket(uint32_t ms) {
+  uint8_t bucket = 0;
+
+  while (ms >= STAGE_LATENCY_BUCKET_MIN_MS &&
+         bucket < STAGE_LATENCY_BUCKETS - 1) {
+    ms >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+static void __histogram_add(uint8_t row, uint32_t ms) {
+  uint16_t *count = &latency_instance.histograms[row][__bucket(ms)];
+
+  if (*count < UINT16_MAX) {
+    (*count)++;
+  }
+}
+
+/*
+ * Add the stages of a commissioned device to the histograms. The bind, pub
+ * and sub stages run at the same time, so each stage is measured from the
+ * latest stage reached before it.
+ * */
+static void __trace_account(const stage_trace_t *trace) {
+  uint32_t previous = trace->at_ms[STAGE_LATENCY_BEACON_SEEN];
+  uint32_t last = previous;
+
+  for (uint8_t stage = 1; stage < STAGE_LATENCY_STAGES; stage++) {
+    if (!(trace->reached & (1 << stage))) {
+      continue;
+    }
+    if (retry_engine_is_due(previous, trace->at_ms[stage])) {
+      __histogram_add(stage, trace->at_ms[stage] - previous);
+      previous = trace->at_ms[stage];
+    } else {
+      __histogram_add(stage, 0);
+    }
+    if (retry_engine_is_due(last, trace->at_ms[stage])) {
+      last = trace->at_ms[stage];
+    }
+  }
+  __histogram_add(0, last - trace->at_ms[STAGE_LATENCY_BEACON_SEEN]);
+}
+
+static void __trace_record(const stage_trace_t *trace, uint16_t address) {
+  stage_record_t *record =
+      &latency_instance.history[latency_instance.history_next];
+
+  record->address = address;
+  record->reached = trace->reached;
+  for (uint8_t stage = 0; stage < STAGE_LATENCY_STAGES; stage++) {
+    record->offset_ms[stage] =
+        (trace->reached & (1 << stage))
+            ? trace->at_ms[stage] - trace->at_ms[STAGE_LATENCY_BEACON_SEEN]
+            : 0;
+  }
+
+  latency_instance.history_next =
+      (latency_instance.history_next + 1) % STAGE_LATENCY_HISTORY;
+  if (latency_instance.history_count < STAGE_LATENCY_HISTORY) {
+    latency_instance.history_count++;
+  }
+}
+
+void stage_latency_init(void) {
+  memset(&latency_instance, 0, sizeof(latency_instance));
+}
+
+void stage_latency_begin(const uuid_128 *uuid, uint32_t beacon_ms) {
+  stage_trace_t *trace = __trace_find(uuid);
+
+  if (trace == NULL) {
+    for (uint8_t i = 0; i < STAGE_LATENCY_MAX_TRACES; i++) {
+      if (!latency_instance.traces[i].in_use) {
+        trace = &latency_instance.traces[i];
+        break;
+      }
+    }
+  }
+  if (trace == NULL) {
+    app_log("Stage latency: no trace left, device not followed\r\n");
+    return;
+  }
+
+  memset(trace, 0, sizeof(*trace));
+  trace->in_use = true;
+  trace->uuid = *uuid;
+  trace->at_ms[STAGE_LATENCY_BEACON_SEEN] = beacon_ms;
+  trace->reached = 1 << STAGE_LATENCY_BEACON_SEEN;
+  stage_latency_mark(uuid, STAGE_LATENCY_PROV_START);
+}
+
+void stage_latency_mark(const uuid_128 *uuid, uint8_t stage) {
+  stage_trace_t *trace = __trace_find(uuid);
+
+  if (trace == NULL || stage >= STAGE_LATENCY_STAGES ||
+      (trace->reached & (1 << stage))) {
+    return;
+  }
+  trace->at_ms[stage] = retry_engine_now_ms();
+  trace->reached |= 1 << stage;
+}
+
+void stage_latency_end(const uuid_128 *uuid, uint16_t address, bool success) {
+  stage_trace_t *trace = __trace_find(uuid);
+
+  if (trace == NULL) {
+    return;
+  }
+  if (success) {
+    __trace_account(trace);
+    __trace_record(trace, address);
+    latency_instance.done++;
+  } else {
+    latency_instance.failed++;
+  }
+  trace->in_use = false;
+}
+
+void stage_latency_on_signal(uint32_t extsignals) {
+  if (extsignals & STAGE_LATENCY_DUMP_SIGNAL) {
+    stage_latency_dump();
+  }
+}
+
+static uint32_t __dump_write(uint32_t hash, const uint8_t *data,
+                             uint16_t len) {
+  for (uint16_t i = 0; i < len; i++) {
+    hash = (hash ^ data[i]) * 16777619u;
+  }
+  sl_iostream_write(SL_IOSTREAM_STDOUT, data, len);
+  return hash;
+}
+
+static uint8_t __put_u16(uint8_t *buf, uint16_t value) {
+  buf[0] = value & 0xFF;
+  buf[1] = value >> 8;
+  return 2;
+}
+
+static uint8_t __put_u32(uint8_t *buf, uint32_t value) {
+  __put_u16(buf, value & 0xFFFF);
+  __put_u16(buf + 2, value >> 16);
+  return 4;
+}
+
+void stage_latency_dump(void) {
+  uint8_t buf[STAGE_LATENCY_DUMP_BUF];
+  uint8_t len = 0;
+  uint32_t hash = 2166136261u;
+  const stage_record_t *record;
+  uint8_t index;
+
+  buf[len++] = STAGE_LATENCY_DUMP_MAGIC_0;
+  buf[len++] = STAGE_LATENCY_DUMP_MAGIC_1;
+  buf[len++] = STAGE_LATENCY_DUMP_VERSION;
+  buf[len++] = STAGE_LATENCY_STAGES;
+  buf[len++] = STAGE_LATENCY_BUCKETS;
+  len += __put_u16(&buf[len], STAGE_LATENCY_BUCKET_MIN_MS);
+  hash = __dump_write(hash, buf, len);
+
+  for (uint8_t stage = 0; stage < STAGE_LATENCY_STAGES; stage++) {
+    len = 0;
+    for (uint8_t i = 0; i < STAGE_LATENCY_BUCKETS; i++) {
+      len += __put_u16(&buf[len], latency_instance.histograms[stage][i]);
+    }
+    hash = __dump_write(hash, buf, len);
+  }
+
+  len = __put_u16(buf, latency_instance.done);
+  len += __put_u16(&buf[len], latency_instance.failed);
+  buf[len++] = latency_instance.history_count;
+  hash = __dump_write(hash, buf, len);
+
+  // Oldest record first
+  index = (latency_instance.history_next + STAGE_LATENCY_HISTORY -
+           latency_instance.history_count) %
+          STAGE_LATENCY_HISTORY;
+  for (uint8_t i = 0; i < latency_instance.history_count; i++) {
+    record = &latency_instance.history[index];
+    len = __put_u16(buf, record->address);
+    len += __put_u16(&buf[len], record->reached);
+    for (uint8_t stage = 0; stage < STAGE_LATENCY_STAGES; stage++) {
+      len += __put_u32(&buf[len], record->offset_ms[stage]);
+    }
+    hash = __dump_write(hash, buf, len);
+    index = (index + 1) % STAGE_LATENCY_HISTORY;
+  }
+
+  __put_u32(buf, hash);
+  sl_iostream_write(SL_IOSTREAM_STDOUT, buf, 4);
+}
@@ -0,0 +1,98 @@
+#ifndef __STAGE_LATENCY__
+#define __STAGE_LATENCY__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sl_btmesh_api.h"
+
+// Stages of the commissioning of one device, in the order they are expected
+#define STAGE_LATENCY_BEACON_SEEN 0
+#define STAGE_LATENCY_PROV_START 1
+#define STAGE_LATENCY_PROVISIONED 2
+#define STAGE_LATENCY_APPKEY_ADDED 3
+#define STAGE_LATENCY_DCD_RECEIVED 4
+// The three below follow the order of the config command types
+#define STAGE_LATENCY_BIND_DONE 5
+#define STAGE_LATENCY_PUB_DONE 6
+#define STAGE_LATENCY_SUB_DONE 7
+#define STAGE_LATENCY_PROXY_HEARTBEAT_SET 8
+#define STAGE_LATENCY_STAGES 9
+
+// Devices followed at the same time, one per provisioning and configuration
+#define STAGE_LATENCY_MAX_TRACES 8
+
+// Last devices whose stage times are kept for the dump
+#define STAGE_LATENCY_HISTORY 8
+
+// Histogram buckets: bucket 0 counts the times below BUCKET_MIN_MS, each
+// next one is twice as wide, the last one counts everything above
+#define STAGE_LATENCY_BUCKETS 16
+#define STAGE_LATENCY_BUCKET_MIN_MS 64
+
+// External signal asking for a dump from interrupt context, see
+// RETRY_ENGINE_SIGNAL
+#define STAGE_LATENCY_DUMP_SIGNAL 0x40
+
+// Binary dump, all fields little endian: magic, version, number of stages,
+// number of buckets, BUCKET_MIN_MS (16 bits), then per stage its bucket
+// counts (16 bits each), devices done and failed (16 bits each), number of
+// history records and per record the node address (16 bits), the stages
+// reached (16-bit mask) and the time of each stage from the beacon in ms
+// (32 bits), then the FNV-1a of everything before it.
+// Row 0 of the histograms holds the total time from the beacon to the last
+// stage, row i > 0 the time from the latest stage before i to stage i.
+#define STAGE_LATENCY_DUMP_MAGIC_0 'S'
+#define STAGE_LATENCY_DUMP_MAGIC_1 'L'
+#define STAGE_LATENCY_DUMP_VERSION 1
+
+/**
+ * @brief Init the traces and clear the histograms
+ *
+ */
+void stage_latency_init(void);
+
+/**
+ * @brief Start following a device when its provisioning starts
+ *
+ * @param uuid The UUID of the device
+ * @param beacon_ms When its first beacon was seen, in retry_engine_now_ms
+ * time
+ */
+void stage_latency_begin(const uuid_128 *uuid, uint32_t beacon_ms);
+
+/**
+ * @brief Record the time a device reached a stage, only the first time
+ * counts. Devices not followed are ignored, e.g. a node configured again.
+ *
+ * @param uuid The UUID of the device
+ * @param stage STAGE_LATENCY_*
+ */
+void stage_latency_mark(const uuid_128 *uuid, uint8_t stage);
+
+/**
+ * @brief Stop following a device. Its stage times go to the histograms and
+ * the history if it was commissioned.
+ *
+ * @param uuid The UUID of the device
+ * @param address The unicast address of the node
+ * @param success True if the node was configured
+ */
+void stage_latency_end(const uuid_128 *uuid, uint16_t address, bool success);
+
+/**
+ * @brief Write the histograms and the history in binary to the console UART
+ * when STAGE_LATENCY_DUMP_SIGNAL is raised
+ *
+ * @param extsignals Signals of the sl_bt_evt_system_external_signal event
+ */
+void stage_latency_on_signal(uint32_t extsignals);
+
+/**
+ * @brief Write the histograms and the history in binary to the console UART,
+ * see the format above
+ *
+ */
+void stage_latency_dump(void);
+
+#endif  // __STAGE_LATENCY__
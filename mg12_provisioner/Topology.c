@@ -0,0 +1,449 @@
+#include "Topology.h"
+
+#include <string.h>
+
+#include "NetworkConfiguration.h"
+#include "NodeDatabase.h"
+#include "RetryEngine.h"
+#include "app_log.h"
+#include "sl_bt_api.h"
+#include "sl_iostream.h"
+#include "sl_sleeptimer.h"
+
+// One bit per pair of nodes
+#define TOPOLOGY_PAIRS(n) ((uint32_t)(n) * ((n) - 1) / 2)
+#define TOPOLOGY_LINK_BYTES ((TOPOLOGY_PAIRS(TOPOLOGY_MAX_NODES) + 7) / 8)
+
+typedef enum {
+  TOPOLOGY_PROBE_IDLE = 0,
+  // Heartbeat subscription sent to the listener, waiting for its status
+  TOPOLOGY_PROBE_SETTING,
+  // The listener counts the heartbeats of the source
+  TOPOLOGY_PROBE_LISTENING,
+  // Heartbeat subscription read back, waiting for its status
+  TOPOLOGY_PROBE_READING,
+} topology_probe_state_t;
+
+/**
+ * @brief One node listening to the heartbeats of another one
+ *
+ */
+typedef struct {
+  topology_probe_state_t state;
+  uint8_t listener;
+  uint8_t source;
+  uint32_t handle;
+  // Status deadline, or end of the listening
+  uint32_t deadline;
+} topology_probe_t;
+
+typedef struct topology {
+  // A free index has address 0
+  uint16_t addresses[TOPOLOGY_MAX_NODES];
+  // Where each node sends its heartbeats, 0 until one was heard: a node
+  // without a heartbeat publication is never the source of a probe
+  uint16_t heartbeat_dst[TOPOLOGY_MAX_NODES];
+  uint8_t hops[TOPOLOGY_MAX_NODES];
+  uint8_t links[TOPOLOGY_LINK_BYTES];
+  uint8_t count;
+
+  // Next pair to probe, a > b
+  uint8_t next_a;
+  uint8_t next_b;
+  uint16_t probed_in_round;
+  // A link or a hop count moved during the round
+  bool changed;
+  topology_probe_t probes[TOPOLOGY_MAX_PROBES];
+  sl_sleeptimer_timer_handle_t tick_timer;
+} topology_t;
+
+static topology_t topology_instance;
+
+static void tick_timer_on_timeout(sl_sleeptimer_timer_handle_t *handle,
+                                  void *data) {
+  (void)handle;
+  (void)data;
+
+  // Runs in interrupt context, the probes are handled in the event loop
+  sl_bt_external_signal(TOPOLOGY_SIGNAL);
+}
+
+static uint32_t __pair_bit(uint8_t a, uint8_t b) {
+  if (a < b) {
+    uint8_t tmp = a;
+    a = b;
+    b = tmp;
+  }
+  return TOPOLOGY_PAIRS(a) + b;
+}
+
+static void __set_link(uint8_t a, uint8_t b, bool linked) {
+  uint32_t bit = __pair_bit(a, b);
+
+  if (((topology_instance.links[bit / 8] >> (bit % 8)) & 1) != linked) {
+    topology_instance.changed = true;
+  }
+  if (linked) {
+    topology_instance.links[bit / 8] |= 1 << (bit % 8);
+  } else {
+    topology_instance.links[bit / 8] &= ~(1 << (bit % 8));
+  }
+}
+
+bool topology_is_linked(uint8_t a, uint8_t b) {
+  uint32_t bit;
+
+  if (a == b || a >= topology_instance.count ||
+      b >= topology_instance.count) {
+    return false;
+  }
+  bit = __pair_bit(a, b);
+  return (topology_instance.links[bit / 8] & (1 << (bit % 8))) != 0;
+}
+
+uint8_t topology_find(uint16_t address) {
+  if (address == 0) {
+    return TOPOLOGY_NONE;
+  }
+  for (uint8_t i = 0; i < topology_instance.count; i++) {
+    if (topology_instance.addresses[i] == address) {
+      return i;
+    }
+  }
+  return TOPOLOGY_NONE;
+}
+
+uint8_t topology_get_count(void) {
+  return topology_instance.count;
+}
+
+uint16_t topology_get_address(uint8_t index) {
+  return index < topology_instance.count ? topology_instance.addresses[index]
+                                         : 0;
+}
+
+uint8_t topology_get_hops(uint8_t index) {
+  return index < topology_instance.count ? topology_instance.hops[index] : 0;
+}
+
+/*
+ * Give a node an index, a free one first. A reused index starts without
+ * links.
+ * */
+static uint8_t __add(uint16_t address, uint16_t heartbeat_dst) {
+  uint8_t index = topology_find(address);
+
+  if (index == TOPOLOGY_NONE) {
+    for (index = 0; index < topology_instance.count; index++) {
+      if (topology_instance.addresses[index] == 0) {
+        break;
+      }
+    }
+    if (index == topology_instance.count) {
+      if (topology_instance.count >= TOPOLOGY_MAX_NODES) {
+        return TOPOLOGY_NONE;
+      }
+      topology_instance.count++;
+    }
+    for (uint8_t j = 0; j < topology_instance.count; j++) {
+      if (j != index) {
+        __set_link(index, j, false);
+      }
+    }
+    topology_instance.addresses[index] = address;
+    topology_instance.hops[index] = TOPOLOGY_HOPS_UNKNOWN;
+    topology_instance.heartbeat_dst[index] = 0;
+  }
+
+  if (heartbeat_dst != 0) {
+    topology_instance.heartbeat_dst[index] = heartbeat_dst;
+  }
+  return index;
+}
+
+static void __set_hops(uint8_t index, uint8_t hops) {
+  if (topology_instance.hops[index] != hops) {
+    topology_instance.hops[index] = hops;
+    topology_instance.changed = true;
+  }
+}
+
+/*
+ * Add the nodes of the node database, with the hops measured by the TTL
+ * tuning. The provisioner has no heartbeat subscription of its own: the
+ * hops to it come from the TTL tuner window, one node at a time, so most
+ * nodes start with unknown hops and the nodes without a heartbeat
+ * publication keep them. A node with hops in its record was heard, so it
+ * sends its heartbeats to its group.
+ * */
+static void __sync_node_db(void) {
+  const tsNodeRecord *record;
+  uint8_t index;
+
+  for (uint8_t i = 0; i < NODE_DB_MAX_NODES; i++) {
+    record = node_db_get(i);
+    if (record == NULL) {
+      continue;
+    }
+    if (record->hops == TOPOLOGY_HOPS_UNKNOWN) {
+      __add(record->address, 0);
+      continue;
+    }
+    index = __add(record->address, record->group_address);
+    if (index != TOPOLOGY_NONE) {
+      __set_hops(index, record->hops);
+    }
+  }
+}
+
+void topology_init(void) {
+  memset(&topology_instance, 0, sizeof(topology_instance));
+  topology_instance.next_a = 1;
+
+  sl_sleeptimer_start_periodic_timer_ms(
+      &topology_instance.tick_timer, TOPOLOGY_TICK_MS, tick_timer_on_timeout,
+      NULL, 0, SL_SLEEPTIMER_NO_HIGH_PRECISION_HF_CLOCKS_REQUIRED_FLAG);
+}
+
+static bool __is_listening(uint8_t index) {
+  for (uint8_t i = 0; i < TOPOLOGY_MAX_PROBES; i++) {
+    if (topology_instance.probes[i].state != TOPOLOGY_PROBE_IDLE &&
+        topology_instance.probes[i].listener == index) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void __round_done(void) {
+  uint16_t links = 0;
+
+  for (uint8_t a = 1; a < topology_instance.count; a++) {
+    for (uint8_t b = 0; b < a; b++) {
+      links += topology_is_linked(a, b);
+    }
+  }
+  app_log("Topology: %d nodes, %d links, %d pairs probed\n",
+          topology_instance.count, links, topology_instance.probed_in_round);
+  if (topology_instance.probed_in_round > 0) {
+    topology_dump();
+  }
+  topology_on_round_done_callback(topology_instance.changed);
+  topology_instance.probed_in_round = 0;
+  topology_instance.changed = false;
+}
+
+/*
+ * Pick the next pair worth probing. Only a node known to send heartbeats is
+ * used as the source. Two nodes whose hops to the provisioner differ by more
+ * than one cannot be linked, they are not probed. A node with unknown hops
+ * may be linked to any other one, its pairs are probed.
+ * Return false once every pair was looked at since the last call.
+ * */
+static bool __next_pair(uint8_t *listener, uint8_t *source) {
+  uint32_t left = TOPOLOGY_PAIRS(topology_instance.count);
+  uint8_t a, b, ha, hb;
+
+  while (left-- > 0) {
+    a = topology_instance.next_a;
+    b = topology_instance.next_b;
+    if (++topology_instance.next_b >= topology_instance.next_a) {
+      topology_instance.next_b = 0;
+      if (++topology_instance.next_a >= topology_instance.count) {
+        topology_instance.next_a = 1;
+        __round_done();
+        __sync_node_db();
+      }
+    }
+    if (a >= topology_instance.count ||
+        topology_instance.addresses[a] == 0 ||
+        topology_instance.addresses[b] == 0) {
+      continue;
+    }
+
+    ha = topology_instance.hops[a];
+    hb = topology_instance.hops[b];
+    if (ha != TOPOLOGY_HOPS_UNKNOWN && hb != TOPOLOGY_HOPS_UNKNOWN &&
+        (ha > hb + 1 || hb > ha + 1)) {
+      __set_link(a, b, false);
+      continue;
+    }
+
+    // If neither sends heartbeats the link stays unknown
+    *source = (topology_instance.heartbeat_dst[a] != 0) ? a : b;
+    *listener = (*source == a) ? b : a;
+    if (topology_instance.heartbeat_dst[*source] == 0 ||
+        __is_listening(*listener)) {
+      continue;
+    }
+    return true;
+  }
+  return false;
+}
+
+static void __probe_start(topology_probe_t *probe) {
+  uint8_t listener, source;
+  sl_status_t sc;
+
+  if (!__next_pair(&listener, &source)) {
+    return;
+  }
+
+  sc = sl_btmesh_config_client_set_heartbeat_sub(
+      NETWORK_ID, topology_instance.addresses[listener],
+      topology_instance.addresses[source],
+      topology_instance.heartbeat_dst[source], TOPOLOGY_PROBE_PERIOD_LOG,
+      &probe->handle);
+  if (sc != SL_STATUS_OK) {
+    app_log("Topology: probe %4.4x -> %4.4x failed 0x%lx\n",
+            topology_instance.addresses[source],
+            topology_instance.addresses[listener], sc);
+    return;
+  }
+
+  probe->state = TOPOLOGY_PROBE_SETTING;
+  probe->listener = listener;
+  probe->source = source;
+  probe->deadline = retry_engine_now_ms() + RETRY_ENGINE_REQUEST_TIMEOUT_MS;
+  topology_instance.probed_in_round++;
+}
+
+void topology_on_signal(uint32_t extsignals) {
+  uint32_t now = retry_engine_now_ms();
+  topology_probe_t *probe;
+  sl_status_t sc;
+
+  if (!(extsignals & TOPOLOGY_SIGNAL)) {
+    return;
+  }
+
+  if (topology_instance.count == 0) {
+    __sync_node_db();
+  }
+
+  for (uint8_t i = 0; i < TOPOLOGY_MAX_PROBES; i++) {
+    probe = &topology_instance.probes[i];
+    if (probe->state == TOPOLOGY_PROBE_IDLE) {
+      __probe_start(probe);
+      continue;
+    }
+    if (!retry_engine_is_due(probe->deadline, now)) {
+      continue;
+    }
+
+    if (probe->state == TOPOLOGY_PROBE_LISTENING) {
+      sc = sl_btmesh_config_client_get_heartbeat_sub(
+          NETWORK_ID, topology_instance.addresses[probe->listener],
+          &probe->handle);
+      if (sc == SL_STATUS_OK) {
+        probe->state = TOPOLOGY_PROBE_READING;
+        probe->deadline = now + RETRY_ENGINE_REQUEST_TIMEOUT_MS;
+        continue;
+      }
+    } else {
+      // The listener did not answer, the pair is probed again next round
+      retry_engine_count_timeout();
+      sl_btmesh_config_client_cancel_request(probe->handle);
+    }
+    probe->state = TOPOLOGY_PROBE_IDLE;
+  }
+}
+
+static topology_probe_t *__probe_find_by_handle(uint32_t handle) {
+  for (uint8_t i = 0; i < TOPOLOGY_MAX_PROBES; i++) {
+    if ((topology_instance.probes[i].state == TOPOLOGY_PROBE_SETTING ||
+         topology_instance.probes[i].state == TOPOLOGY_PROBE_READING) &&
+        topology_instance.probes[i].handle == handle) {
+      return &topology_instance.probes[i];
+    }
+  }
+  return NULL;
+}
+
+void topology_on_btmesh_event(sl_btmesh_msg_t *evt) {
+  topology_probe_t *probe;
+  uint8_t index;
+
+  switch (SL_BT_MSG_ID(evt->header)) {
+    case sl_btmesh_evt_node_heartbeat_id:
+      index = __add(evt->data.evt_node_heartbeat.src_addr,
+                    evt->data.evt_node_heartbeat.dst_addr);
+      if (index != TOPOLOGY_NONE) {
+        __set_hops(index, evt->data.evt_node_heartbeat.hops);
+      }
+      break;
+    case sl_btmesh_evt_config_client_heartbeat_sub_status_id:
+      probe = __probe_find_by_handle(
+          evt->data.evt_config_client_heartbeat_sub_status.handle);
+      if (probe == NULL) {
+        break;
+      }
+      if (evt->data.evt_config_client_heartbeat_sub_status.result !=
+          SL_STATUS_OK) {
+        probe->state = TOPOLOGY_PROBE_IDLE;
+        break;
+      }
+
+      if (probe->state == TOPOLOGY_PROBE_SETTING) {
+        probe->state = TOPOLOGY_PROBE_LISTENING;
+        probe->deadline = retry_engine_now_ms() + TOPOLOGY_PROBE_MS;
+        break;
+      }
+
+      // No heartbeat heard means no link either
+      __set_link(
+          probe->listener, probe->source,
+          evt->data.evt_config_client_heartbeat_sub_status.count_log != 0 &&
+              evt->data.evt_config_client_heartbeat_sub_status.min_hops == 1);
+      probe->state = TOPOLOGY_PROBE_IDLE;
+      break;
+    default:
+      break;
+  }
+}
+
+static uint32_t __dump_write(uint32_t hash, const uint8_t *data,
+                             uint16_t len) {
+  for (uint16_t i = 0; i < len; i++) {
+    hash = (hash ^ data[i]) * 16777619u;
+  }
+  sl_iostream_write(SL_IOSTREAM_STDOUT, data, len);
+  return hash;
+}
+
+void topology_dump(void) {
+  uint8_t buf[3 * 8];
+  uint8_t len = 0;
+  uint32_t hash = 2166136261u;
+  uint32_t link_bytes;
+
+  buf[0] = TOPOLOGY_DUMP_MAGIC_0;
+  buf[1] = TOPOLOGY_DUMP_MAGIC_1;
+  buf[2] = TOPOLOGY_DUMP_VERSION;
+  buf[3] = topology_instance.count;
+  buf[4] = 0;
+  hash = __dump_write(hash, buf, 5);
+
+  for (uint8_t i = 0; i < topology_instance.count; i++) {
+    buf[len++] = topology_instance.addresses[i] & 0xFF;
+    buf[len++] = topology_instance.addresses[i] >> 8;
+    buf[len++] = topology_instance.hops[i];
+    if (len == sizeof(buf) || i + 1 == topology_instance.count) {
+      hash = __dump_write(hash, buf, len);
+      len = 0;
+    }
+  }
+
+  // The rows of the first count nodes are the start of the matrix
+  link_bytes = (TOPOLOGY_PAIRS(topology_instance.count) + 7) / 8;
+  for (uint32_t i = 0; i < link_bytes; i += sizeof(buf)) {
+    len = (link_bytes - i < sizeof(buf)) ? link_bytes - i : sizeof(buf);
+    hash = __dump_write(hash, &topology_instance.links[i], len);
+  }
+
+  buf[0] = hash & 0xFF;
+  buf[1] = (hash >> 8) & 0xFF;
+  buf[2] = (hash >> 16) & 0xFF;
+  buf[3] = hash >> 24;
+  sl_iostream_write(SL_IOSTREAM_STDOUT, buf, 4);
+}
@@ -0,0 +1,124 @@
+#ifndef __TOPOLOGY__
+#define __TOPOLOGY__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "TtlTuner.h"
+#include "sl_btmesh_api.h"
+
+// Number of nodes the map holds. The links are kept as one bit per pair of
+// nodes, 200 nodes take about 3.5 KB in total.
+#ifndef TOPOLOGY_MAX_NODES
+#define TOPOLOGY_MAX_NODES 200
+#endif
+
+// Returned by topology_find for an unknown node
+#define TOPOLOGY_NONE 0xFF
+
+// Hops of a node whose heartbeats never reached the provisioner. It says
+// nothing about its links: the provisioner only listens to one node at a
+// time (see TTL_TUNER_WINDOW_MS), so a node waits up to one window per known
+// node to be measured, and a node without a heartbeat publication never is.
+#define TOPOLOGY_HOPS_UNKNOWN 0
+#if TOPOLOGY_MAX_NODES >= TOPOLOGY_NONE
+#error "TOPOLOGY_MAX_NODES must fit in a node index"
+#endif
+
+// Pairs of nodes probed at the same time. A node has one heartbeat
+// subscription so it listens to one other node at a time.
+#define TOPOLOGY_MAX_PROBES 4
+
+// A probe listens to two heartbeats of the source node before reading the
+// hops back
+#define TOPOLOGY_PROBE_MS (2 * TTL_TUNER_HEARTBEAT_PERIOD_MS + 4000)
+#define TOPOLOGY_PROBE_PERIOD_LOG 8  // 2^(8-1) = 128 s, longer than the probe
+
+// The probes are checked at this interval
+#define TOPOLOGY_TICK_MS 2000
+
+// External signal raised at each tick, see RETRY_ENGINE_SIGNAL
+#define TOPOLOGY_SIGNAL 0x20
+
+// Binary dump: magic, version, node count (little endian), then per node its
+// address (little endian) and hops to the provisioner (TOPOLOGY_HOPS_UNKNOWN
+// if not measured), then the links as a
+// lower triangular bit matrix (pair i > j at bit i * (i - 1) / 2 + j, LSB
+// first) and the FNV-1a of everything before it
+#define TOPOLOGY_DUMP_MAGIC_0 'T'
+#define TOPOLOGY_DUMP_MAGIC_1 'P'
+#define TOPOLOGY_DUMP_VERSION 1
+
+/**
+ * @brief Init the map, it is filled with the nodes of the node database and
+ * the nodes heard sending heartbeats
+ *
+ */
+void topology_init(void);
+
+/**
+ * @brief Find the index of a node in the map
+ *
+ * @param address The unicast address of the node
+ * @return uint8_t TOPOLOGY_NONE if unknown
+ */
+uint8_t topology_find(uint16_t address);
+
+/**
+ * @brief Get the number of indexes in use, some may be free
+ *
+ */
+uint8_t topology_get_count(void);
+
+/**
+ * @brief Get the address of the node at an index
+ *
+ * @return uint16_t 0 if the index is free
+ */
+uint16_t topology_get_address(uint8_t index);
+
+/**
+ * @brief Get the hops from a node to the provisioner
+ *
+ * @return uint8_t TOPOLOGY_HOPS_UNKNOWN if its heartbeats were never heard
+ */
+uint8_t topology_get_hops(uint8_t index);
+
+/**
+ * @brief Check if two nodes hear each other directly
+ *
+ * @return bool False as well while the pair was not probed, which needs one
+ * of the nodes to send heartbeats
+ */
+bool topology_is_linked(uint8_t a, uint8_t b);
+
+/**
+ * @brief Handle the heartbeats and the heartbeat subscription statuses
+ *
+ * @param evt Event coming from the Bluetooth Mesh stack
+ */
+void topology_on_btmesh_event(sl_btmesh_msg_t *evt);
+
+/**
+ * @brief Move the probes on when TOPOLOGY_SIGNAL is raised
+ *
+ * @param extsignals Signals of the sl_bt_evt_system_external_signal event
+ */
+void topology_on_signal(uint32_t extsignals);
+
+/**
+ * @brief This is the prototype for the callback fucntion
+ * User should self-define it.
+ * This function will be called each time every pair of nodes was looked at
+ *
+ * @param changed True if a link or a hop count moved since the last call
+ */
+void topology_on_round_done_callback(bool changed);
+
+/**
+ * @brief Write the map in binary to the console UART, see the format above
+ *
+ */
+void topology_dump(void);
+
+#endif  // __TOPOLOGY__
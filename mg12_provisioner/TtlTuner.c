@@ -0,0 +1,175 @@
+#include "TtlTuner.h"
+
+#include <string.h>
+
+#include "DeviceConfiguration.h"
+#include "NetworkConfiguration.h"
+#include "NodeDatabase.h"
+#include "app_log.h"
+#include "sl_bt_api.h"
+#include "sl_sleeptimer.h"
+
+typedef struct ttl_tuner {
+  sl_sleeptimer_timer_handle_t window_timer;
+  // Primary element address of the provisioner, 0 until the stack is up
+  uint16_t own_address;
+  // Handle of the heartbeat subscription request of the current window
+  uint32_t sub_handle;
+  // Node listened to in the current window, 0 if none
+  uint16_t address;
+  // Index of that node in the node database
+  uint8_t index;
+  // Lowest hops heard in the window, 0 if no heartbeat came
+  uint8_t min_hops;
+} ttl_tuner_t;
+
+static ttl_tuner_t tuner_instance;
+
+static void window_timer_on_timeout(sl_sleeptimer_timer_handle_t *handle,
+                                    void *data) {
+  (void)handle;
+  (void)data;
+
+  // Runs in interrupt context, the window is closed in the event loop
+  sl_bt_external_signal(TTL_TUNER_SIGNAL);
+}
+
+void ttl_tuner_init(void) {
+  memset(&tuner_instance, 0, sizeof(tuner_instance));
+
+  sl_sleeptimer_start_periodic_timer_ms(
+      &tuner_instance.window_timer, TTL_TUNER_WINDOW_MS,
+      window_timer_on_timeout, NULL, 0,
+      SL_SLEEPTIMER_NO_HIGH_PRECISION_HF_CLOCKS_REQUIRED_FLAG);
+}
+
+void ttl_tuner_set_own_address(uint16_t own_address) {
+  tuner_instance.own_address = own_address;
+}
+
+static uint8_t __ttl_of_hops(uint8_t hops) {
+  if (hops == 0) {
+    return TTL_TUNER_DEFAULT_TTL;
+  }
+  if (hops + TTL_TUNER_MARGIN > TTL_TUNER_MAX_TTL) {
+    return TTL_TUNER_MAX_TTL;
+  }
+  return hops + TTL_TUNER_MARGIN;
+}
+
+uint8_t ttl_tuner_get_pub_ttl(uint16_t address) {
+  const tsNodeRecord *record = node_db_find_by_address(address);
+
+  return __ttl_of_hops(record != NULL ? record->hops : 0);
+}
+
+void ttl_tuner_on_btmesh_event(sl_btmesh_msg_t *evt) {
+  uint16_t src;
+  uint8_t hops;
+
+  if (SL_BT_MSG_ID(evt->header) ==
+      sl_btmesh_evt_config_client_heartbeat_sub_status_id) {
+    if (tuner_instance.address != 0 &&
+        evt->data.evt_config_client_heartbeat_sub_status.handle ==
+            tuner_instance.sub_handle &&
+        evt->data.evt_config_client_heartbeat_sub_status.result !=
+            SL_STATUS_OK) {
+      app_log("Heartbeat subscription to %4.4x refused 0x%x\n",
+              tuner_instance.address,
+              evt->data.evt_config_client_heartbeat_sub_status.result);
+      tuner_instance.address = 0;
+    }
+    return;
+  }
+  if (SL_BT_MSG_ID(evt->header) != sl_btmesh_evt_node_heartbeat_id) {
+    return;
+  }
+
+  src = evt->data.evt_node_heartbeat.src_addr;
+  hops = evt->data.evt_node_heartbeat.hops;
+  node_db_touch(src);
+  if (src != tuner_instance.address || hops == 0) {
+    return;
+  }
+
+  // The flood takes every path, the shortest one is what the TTL must cover
+  if (tuner_instance.min_hops == 0 || hops < tuner_instance.min_hops) {
+    tuner_instance.min_hops = hops;
+  }
+}
+
+/*
+ * Apply the hops measured in the window that just ended. The publications of
+ * the node are sent again when they may not reach far enough, or reach much
+ * further than needed.
+ * */
+static void __close_window(void) {
+  const tsNodeRecord *record = node_db_get(tuner_instance.index);
+  uint8_t ttl;
+
+  if (record == NULL || record->address != tuner_instance.address ||
+      tuner_instance.min_hops == 0) {
+    return;
+  }
+
+  node_db_set_hops(record->address, tuner_instance.min_hops);
+  ttl = __ttl_of_hops(tuner_instance.min_hops);
+  if (ttl <= record->pub_ttl && ttl + TTL_TUNER_HYSTERESIS > record->pub_ttl) {
+    return;
+  }
+
+  app_log("Node %4.4x is %d hops away, publication TTL %d -> %d\n",
+          record->address, tuner_instance.min_hops, record->pub_ttl, ttl);
+  if (device_configuration_update_pubs(record->address, record->group_address,
+                                      record->device_type,
+                                      record->uuid) != SL_STATUS_OK) {
+    // Still off at the next window of this node
+    app_log("No session left, TTL of %4.4x tuned later\n", record->address);
+  }
+}
+
+/*
+ * Listen to the heartbeats of the next known node
+ * */
+static void __open_window(void) {
+  const tsNodeRecord *record = NULL;
+  uint8_t index = tuner_instance.index;
+  sl_status_t sc;
+
+  tuner_instance.address = 0;
+  tuner_instance.min_hops = 0;
+  if (tuner_instance.own_address == 0) {
+    return;
+  }
+
+  for (uint8_t i = 0; i < NODE_DB_MAX_NODES && record == NULL; i++) {
+    index = (index + 1) % NODE_DB_MAX_NODES;
+    record = node_db_get(index);
+  }
+  if (record == NULL) {
+    return;
+  }
+  tuner_instance.index = index;
+
+  // Replaces the subscription of the previous window, the status comes back
+  // before the first heartbeat
+  sc = sl_btmesh_config_client_set_heartbeat_sub(
+      NETWORK_ID, tuner_instance.own_address, record->address,
+      record->group_address, TTL_TUNER_SUB_PERIOD_LOG,
+      &tuner_instance.sub_handle);
+  if (sc != SL_STATUS_OK) {
+    app_log("Heartbeat subscription to %4.4x failed 0x%lx\n", record->address,
+            sc);
+    return;
+  }
+  tuner_instance.address = record->address;
+}
+
+void ttl_tuner_on_signal(uint32_t extsignals) {
+  if (!(extsignals & TTL_TUNER_SIGNAL)) {
+    return;
+  }
+
+  __close_window();
+  __open_window();
+}
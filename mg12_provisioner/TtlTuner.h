@@ -0,0 +1,82 @@
+#ifndef __TTL_TUNER__
+#define __TTL_TUNER__
+
+#include <stdint.h>
+
+#include "sl_btmesh_api.h"
+
+// Publication TTL of a node whose hop distance is not measured yet
+#define TTL_TUNER_DEFAULT_TTL 3
+
+// Added to the measured hops, the other members of the group may be further
+// away than the provisioner
+#define TTL_TUNER_MARGIN 2
+
+// A lower TTL is only applied once it is this much below the current one, so
+// that a node on the edge of two paths is not configured again and again
+#define TTL_TUNER_HYSTERESIS 2
+
+#define TTL_TUNER_MAX_TTL 0x7F
+
+// TTL of the heartbeats of the nodes, they are the probes of the hop distance
+// so they must make it to the provisioner from anywhere on the floor. Each
+// relay forwards a heartbeat once whatever its TTL, the load of the flood is
+// set by the period below.
+#define TTL_TUNER_HEARTBEAT_TTL 16
+
+// Heartbeat publication period of the nodes, 2^(6-1) = 32 s: 100 nodes send
+// about 3 heartbeats per second in total
+#define TTL_TUNER_HEARTBEAT_PERIOD_LOG 6
+#define TTL_TUNER_HEARTBEAT_PERIOD_MS 32000
+
+// The provisioner has one heartbeat subscription, it listens to one node per
+// window of two heartbeat periods. The subscription is set with the config
+// client on the provisioner itself, the stack serves requests to its own
+// address locally.
+#define TTL_TUNER_WINDOW_MS (2 * TTL_TUNER_HEARTBEAT_PERIOD_MS + 4000)
+#define TTL_TUNER_SUB_PERIOD_LOG 8  // 2^(8-1) = 128 s, longer than the window
+
+// External signal raised at the end of each window, see RETRY_ENGINE_SIGNAL
+#define TTL_TUNER_SIGNAL 0x10
+
+/**
+ * @brief Start going through the known nodes, one window each
+ *
+ */
+void ttl_tuner_init(void);
+
+/**
+ * @brief Set the address the heartbeat subscription is configured on, no
+ * node is listened to before
+ *
+ * @param own_address The primary element address of the provisioner
+ */
+void ttl_tuner_set_own_address(uint16_t own_address);
+
+/**
+ * @brief Get the publication TTL to configure on a node
+ *
+ * @param address The unicast address of the node
+ * @return uint8_t Measured hops plus the margin, TTL_TUNER_DEFAULT_TTL if the
+ * node was never heard
+ */
+uint8_t ttl_tuner_get_pub_ttl(uint16_t address);
+
+/**
+ * @brief Record the hops of the heartbeats and check the status of the
+ * heartbeat subscription
+ *
+ * @param evt Event coming from the Bluetooth Mesh stack
+ */
+void ttl_tuner_on_btmesh_event(sl_btmesh_msg_t *evt);
+
+/**
+ * @brief Close the window when TTL_TUNER_SIGNAL is raised: only the
+ * publications of the node are sent again if its TTL is off, then the next
+ * node is listened to
+ *
+ * @param extsignals Signals of the sl_bt_evt_system_external_signal event
+ */
+void ttl_tuner_on_signal(uint32_t extsignals);
+
+#endif  // __TTL_TUNER__
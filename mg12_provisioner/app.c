@@ -3,10 +3,22 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "BeaconFilter.h"
+#include "ConfigJournal.h"
+#include "DcdCache.h"
 #include "DeviceConfiguration.h"
 #include "DeviceManager.h"
+#include "EventDispatcher.h"
+#include "KeyRefresh.h"
 #include "NetworkConfiguration.h"
+#include "NodeDatabase.h"
+#include "ProvisionScheduler.h"
+#include "RelayPlanner.h"
+#include "RetryEngine.h"
+#include "StageLatency.h"
 #include "StatusIndicator.h"
+#include "Topology.h"
+#include "TtlTuner.h"
 #include "app_assert.h"
 #include "app_button_press.h"
 #include "app_log.h"
@@ -24,6 +36,8 @@
 #define BLE_MESH_UUID_LEN_BYTE (16)
 #define BLE_ADDR_LEN_BYTE (6)
 
+static void app_subscribe_mesh_events(void);
+
 /**
  * Application Init.
  *****************************************************************************/
@@ -38,7 +52,23 @@ SL_WEAK void app_init(void) {
 
   sl_sleeptimer_delay_millisecond(1);
 
+  event_dispatcher_init();
+  app_subscribe_mesh_events();
+
   device_manager_init();
+  provision_scheduler_init();
+  dcd_cache_init();
+  node_db_init();
+  config_journal_init();
+  retry_engine_init();
+  beacon_filter_init();
+  ttl_tuner_init();
+  topology_init();
+  relay_planner_init();
+#if RELAY_PLANNER_SELF_CHECK
+  relay_planner_self_check();
+#endif
+  stage_latency_init();
   app_button_press_enable();
 }
 
@@ -110,6 +140,31 @@ void sl_bt_on_event(struct sl_bt_msg *evt) {
     case sl_bt_evt_connection_closed_id:
       app_log("Connection closed\r\n");
       break;
+    case sl_bt_evt_system_external_signal_id:
+      if (retry_engine_on_signal(
+              evt->data.evt_system_external_signal.extsignals)) {
+        provision_scheduler_on_retry_tick();
+        device_config_on_retry_tick();
+        key_refresh_on_retry_tick();
+        relay_planner_on_retry_tick();
+      }
+      if (evt->data.evt_system_external_signal.extsignals &
+          DEVICE_MANAGER_AGING_SIGNAL) {
+        device_manager_on_aging_tick();
+      }
+      node_db_on_signal(evt->data.evt_system_external_signal.extsignals);
+      config_journal_on_signal(
+          evt->data.evt_system_external_signal.extsignals);
+      ttl_tuner_on_signal(evt->data.evt_system_external_signal.extsignals);
+      topology_on_signal(evt->data.evt_system_external_signal.extsignals);
+      // On demand with the stage times, printed before their binary dump
+      if (evt->data.evt_system_external_signal.extsignals &
+          STAGE_LATENCY_DUMP_SIGNAL) {
+        provision_scheduler_print_stats();
+      }
+      stage_latency_on_signal(
+          evt->data.evt_system_external_signal.extsignals);
+      break;
     // -------------------------------
     // Default event handler.
     default:
@@ -117,29 +172,15 @@ void sl_bt_on_event(struct sl_bt_msg *evt) {
   }
 }
 
-/**
- * NOTE about the variable below
- * I think this variable should be inside the sl_btmesh_on_event fucntion.
- * However, this will make its value gone when finishing handling event.
- * So I suggest one solution is that I put the variable insize the function,
- * then I set the target_address for the device configureation module
- * right in the provisioned_id event.
- *
- * After done add app key to the node, just send the trigger signal to
- * the device configuration.
- */
-static uint16_t provisionee_addr;
 static uint16_t target_group_address;
-static bd_addr provisioning_dev_address;
-static uuid_128 device_uuid;
-static uint8_t device_type = TARGET_DEVICE_TYPE_NODE;
+
 /**
- * Bluetooth Mesh stack event handler.
- * This overrides the dummy weak implementation.
+ * Provisioner events of the application itself, subscribed through the
+ * mesh_event_table below.
  *
  * @param[in] evt Event coming from the Bluetooth Mesh stack.
  *****************************************************************************/
-void sl_btmesh_on_event(sl_btmesh_msg_t *evt) {
+static void app_on_btmesh_event(sl_btmesh_msg_t *evt) {
   uint16_t result = 0;
   sl_status_t sc;
 
@@ -165,35 +206,48 @@ void sl_btmesh_on_event(sl_btmesh_msg_t *evt) {
 
       sl_btmesh_generic_client_init();
 
+      // The device database is up, pick up what was configured before reset
+      provision_scheduler_setup_addresses(
+          evt->data.evt_prov_initialized.address,
+          evt->data.evt_prov_initialized.iv_index);
+      ttl_tuner_set_own_address(evt->data.evt_prov_initialized.address);
+      device_configuration_resume();
+      provision_scheduler_restore();
+
       result = sl_btmesh_prov_scan_unprov_beacons();
+      if (result != SL_STATUS_OK) {
+        app_log("sl_btmesh_prov_scan_unprov_beacons failed 0x%x\r\n", result);
+      }
     } break;
     case sl_btmesh_evt_prov_initialization_failed_id:
       app_log("failed: 0x%x ", evt->data.evt_prov_initialization_failed.result);
       break;
     case sl_btmesh_evt_prov_unprov_beacon_id:
-      /* PB-ADV only */
-      if (0 == evt->data.evt_prov_unprov_beacon.bearer) {
-        device_uuid = evt->data.evt_prov_unprov_beacon.uuid;
-        provisioning_dev_address = evt->data.evt_prov_unprov_beacon.address;
+      /* PB-ADV only, repeats of a recent beacon are dropped first */
+      if (0 == evt->data.evt_prov_unprov_beacon.bearer &&
+          !beacon_filter_seen(&evt->data.evt_prov_unprov_beacon.uuid)) {
+        uuid_128 device_uuid = evt->data.evt_prov_unprov_beacon.uuid;
+        bd_addr device_address = evt->data.evt_prov_unprov_beacon.address;
         /* fill up btmesh device struct */
         if ((sl_btmesh_prov_get_ddb_entry(device_uuid, NULL, NULL, NULL,
                                           NULL) != 0)) {
           /* Device is not present */
-          if (device_manager_add_device(&device_uuid,
-                                        &provisioning_dev_address) == 0) {
+          if (device_manager_add_device(
+                  &device_uuid, &device_address,
+                  evt->data.evt_prov_unprov_beacon.rssi) == 0) {
             app_log("Found new device\n");
-            app_log("Address: %x:%x:%x:%x:%x:%x\n",
-                    provisioning_dev_address.addr[5],
-                    provisioning_dev_address.addr[4],
-                    provisioning_dev_address.addr[3],
-                    provisioning_dev_address.addr[2],
-                    provisioning_dev_address.addr[1],
-                    provisioning_dev_address.addr[0]);
+            app_log("Address: %x:%x:%x:%x:%x:%x\n", device_address.addr[5],
+                    device_address.addr[4], device_address.addr[3],
+                    device_address.addr[2], device_address.addr[1],
+                    device_address.addr[0]);
             app_log("UUID: ");
             for (uint8_t i = 0; i < BLE_MESH_UUID_LEN_BYTE; i++) {
               app_log("%x", device_uuid.data[i]);
             }
             app_log("\n");
+
+            // Pick the new device up if we are provisioning all devices
+            provision_scheduler_fill();
           }
         }
       }
@@ -203,115 +257,109 @@ void sl_btmesh_on_event(sl_btmesh_msg_t *evt) {
       app_log("provisioning failed\r\n");
       break;
     case sl_btmesh_evt_prov_device_provisioned_id:
-      provisionee_addr = evt->data.evt_prov_device_provisioned.address;
-      device_uuid = evt->data.evt_prov_device_provisioned.uuid;
-      app_log("Node successfully provisioned. Address: %4.4x, ",
-              provisionee_addr);
-
-      // Delete the device from the DeviceManager Table
-      sc = device_manager_remove_device(&provisioning_dev_address);
-      if (sc == 0) {
-        app_log("Device removed from the table\n");
-      } else {
-        app_log("Error: device_manager_remove_device code %d\n", sc);
-      }
-
-      app_log(" sending app key to node ...\r\n");
-
-      sc = sl_btmesh_config_client_add_appkey(NETWORK_ID, provisionee_addr,
-                                              APPKEY_INDEX, NETWORK_ID, NULL);
-      sl_status_print(sc);
-      if (sc != SL_STATUS_OK) {
-        app_log(
-            "sl_btmesh_config_client_add_appkey failed with result 0x%lX (%ld) "
-            "addr %x\r\n",
-            sc, sc, provisionee_addr);
-
-      }
+      app_log("Node successfully provisioned. Address: %4.4x\n",
+              evt->data.evt_prov_device_provisioned.address);
       break;
 
-    /* Config events */
-    case sl_btmesh_evt_config_client_appkey_status_id:
-      result = evt->data.evt_config_client_appkey_status.result;
-      if (result == SL_STATUS_OK) {
-        app_log(" appkey added\r\n");
-      } else {
-        app_log("Failed to add key to device, code %x\n", result);
-        // TODO Retry adding key to the node
-      }
-
-      // Move to configuration step
-      if (device_uuid.data[3] == 0x02) {
-        app_log("Gateway\n");
-        device_type = TARGET_DEVICE_TYPE_GATEWAY;
-      } else if (device_uuid.data[3] == 0x01) {
-        device_type = TARGET_DEVICE_TYPE_NODE;
-      }
-      sc = device_configuration_config_session(
-          provisionee_addr, target_group_address, device_type, device_uuid);
-      app_assert_status_f(sc, "device_configuration_config_session\n");
-      break;
     // -------------------------------
     // Default event handler.
     default:
-      app_log("unhandled evt: %8.8x class %2.2x method %2.2x\r\n",
-              (unsigned int)SL_BT_MSG_ID(evt->header),
-              (unsigned int)((SL_BT_MSG_ID(evt->header) >> 16) & 0xFF),
-              (unsigned int)((SL_BT_MSG_ID(evt->header) >> 24) & 0xFF));
-      // Call other event handler fucntion
       break;
   }
 
-  device_config_handle_mesh_evt(evt);
-  status_indicator_on_btmesh_event(evt);
 }
 
 /**
- * NOTE 001 I am thinking of using the callback function
- * to trigger a new provisioning process.
- * This may cause the program a little bit confusing
- * but it is the only way to prevent out of resources
- * and data race condition in other module (due to using global variable)
- *
- */
+ * Who handles which mesh event. The handlers of one event are called in this
+ * order, an event nobody subscribed to is logged as unhandled.
+ *****************************************************************************/
+static const event_dispatcher_subscription_t mesh_event_table[] = {
+    {sl_btmesh_evt_prov_initialized_id, app_on_btmesh_event, "app"},
+    {sl_btmesh_evt_prov_initialization_failed_id, app_on_btmesh_event, "app"},
+    {sl_btmesh_evt_prov_unprov_beacon_id, app_on_btmesh_event, "app"},
+    {sl_btmesh_evt_prov_provisioning_failed_id, app_on_btmesh_event, "app"},
+    {sl_btmesh_evt_prov_device_provisioned_id, app_on_btmesh_event, "app"},
+
+    {sl_btmesh_evt_prov_ddb_list_id, provision_scheduler_on_btmesh_event,
+     "provision_scheduler"},
+    {sl_btmesh_evt_prov_capabilities_id, provision_scheduler_on_btmesh_event,
+     "provision_scheduler"},
+    {sl_btmesh_evt_prov_provisioning_suspended_id,
+     provision_scheduler_on_btmesh_event, "provision_scheduler"},
+    {sl_btmesh_evt_prov_provisioning_failed_id,
+     provision_scheduler_on_btmesh_event, "provision_scheduler"},
+    {sl_btmesh_evt_prov_device_provisioned_id,
+     provision_scheduler_on_btmesh_event, "provision_scheduler"},
+    {sl_btmesh_evt_config_client_appkey_status_id,
+     provision_scheduler_on_btmesh_event, "provision_scheduler"},
+    {sl_btmesh_evt_node_changed_ivupdate_state_id,
+     provision_scheduler_on_btmesh_event, "provision_scheduler"},
+
+    {sl_btmesh_evt_config_client_dcd_data_id, device_config_handle_mesh_evt,
+     "device_config"},
+    {sl_btmesh_evt_config_client_dcd_data_end_id,
+     device_config_handle_mesh_evt, "device_config"},
+    {sl_btmesh_evt_config_client_binding_status_id,
+     device_config_handle_mesh_evt, "device_config"},
+    {sl_btmesh_evt_config_client_model_pub_status_id,
+     device_config_handle_mesh_evt, "device_config"},
+    {sl_btmesh_evt_config_client_model_sub_status_id,
+     device_config_handle_mesh_evt, "device_config"},
+    {sl_btmesh_evt_config_client_gatt_proxy_status_id,
+     device_config_handle_mesh_evt, "device_config"},
+    {sl_btmesh_evt_config_client_heartbeat_pub_status_id,
+     device_config_handle_mesh_evt, "device_config"},
+
+    {sl_btmesh_evt_prov_key_refresh_node_update_id,
+     key_refresh_on_btmesh_event, "key_refresh"},
+    {sl_btmesh_evt_prov_key_refresh_phase_update_id,
+     key_refresh_on_btmesh_event, "key_refresh"},
+    {sl_btmesh_evt_prov_key_refresh_complete_id, key_refresh_on_btmesh_event,
+     "key_refresh"},
+    {sl_btmesh_evt_prov_ddb_list_id, key_refresh_on_btmesh_event,
+     "key_refresh"},
+
+    {sl_btmesh_evt_node_heartbeat_id, ttl_tuner_on_btmesh_event, "ttl_tuner"},
+    {sl_btmesh_evt_config_client_heartbeat_sub_status_id,
+     ttl_tuner_on_btmesh_event, "ttl_tuner"},
+
+    {sl_btmesh_evt_node_heartbeat_id, topology_on_btmesh_event, "topology"},
+    {sl_btmesh_evt_config_client_heartbeat_sub_status_id,
+     topology_on_btmesh_event, "topology"},
+
+    {sl_btmesh_evt_config_client_relay_status_id,
+     relay_planner_on_btmesh_event, "relay_planner"},
+
+    {sl_btmesh_evt_prov_provisioning_failed_id,
+     status_indicator_on_btmesh_event, "status_indicator"},
+    {sl_btmesh_evt_prov_device_provisioned_id,
+     status_indicator_on_btmesh_event, "status_indicator"},
+};
+
+static void app_subscribe_mesh_events(void) {
+  event_dispatcher_subscribe(
+      mesh_event_table,
+      sizeof(mesh_event_table) / sizeof(mesh_event_table[0]));
+}
 
 /**
- * NOTE 002 New idea:
- * Change the provision function the only one mode (NEXT)
- * Then if the button is long pressed, change to mode ALL
- * by the variable recursive below.
- * The callback function now check if this variable is higher
- * than 0, if it is, it will call the provision function again.
+ * Bluetooth Mesh stack event handler.
+ * This overrides the dummy weak implementation.
  *
+ * @param[in] evt Event coming from the Bluetooth Mesh stack.
+ *****************************************************************************/
+void sl_btmesh_on_event(sl_btmesh_msg_t *evt) {
+  event_dispatcher_dispatch(evt);
+}
+
+/**
+ * NOTE 001 Provisioning is driven by the ProvisionScheduler module.
+ * A short press provisions the next device in the table, a long press
+ * keeps up to PROV_SCHEDULER_MAX_PROVISIONING devices provisioning while the
+ * provisioned ones are configured, until the table is empty.
  */
-static uint8_t recursive = 0;
 void provisionBLEMeshStack_app() {
-  sl_status_t sc;
-
-  status_indicator_on_provisioning();
-
-  // FIXME - When there is no device left this function below should return
-  // value other than 0
-  if (device_manager_get_next_device(&device_uuid, &provisioning_dev_address) ==
-      0) {
-
-    app_log("Starting to prov device with id %x:%x and ble address of %x:%x\n",
-                              device_uuid.data[14],
-                              device_uuid.data[15],
-                              provisioning_dev_address.addr[5],
-                              provisioning_dev_address.addr[4]);
-    /* provisioning using ADV bearer (this is the default) */
-    sl_btmesh_prov_create_provisioning_session(NETWORK_ID, device_uuid, 0);
-    sc = sl_btmesh_prov_provision_adv_device(device_uuid);
-    if (sc == SL_STATUS_OK) {
-      app_log("Provisioning request sent\n");
-    } else {
-      app_log("Provisioning fail %lX: ", sc);
-    }
-  } else {
-    app_log("No device left in the table\n");
-    recursive = 0;
-  }
+  provision_scheduler_start(target_group_address, false);
 }
 
 sl_sleeptimer_timer_handle_t double_tap_timer;
@@ -325,6 +373,8 @@ void double_tap_timer_on_timeout(sl_sleeptimer_timer_handle_t *timer,
   (void)data;
 
   printf("Single push detected\n");
+  // Dumped from the event loop, this runs in interrupt context
+  sl_bt_external_signal(STAGE_LATENCY_DUMP_SIGNAL);
 }
 
 void app_button_press_cb(uint8_t button, uint8_t duration) {
@@ -346,14 +396,15 @@ void app_button_press_cb(uint8_t button, uint8_t duration) {
       } else if (button == 1) {
         target_group_address = LIGHT_GROUP_2;
       }
-      provisionBLEMeshStack_app();
-      recursive = 1;
+      provision_scheduler_start(target_group_address, true);
       break;
     case APP_BUTTON_PRESS_DURATION_VERYLONG:
       sl_sleeptimer_is_timer_running(&double_tap_timer, &sleeptimer_running);
       if (sleeptimer_running) {
         sl_sleeptimer_stop_timer(&double_tap_timer);
         printf("Double tap detected\n");
+        app_log("Rotating the network keys\n");
+        key_refresh_start();
       } else {
         sl_sleeptimer_start_timer_ms(
             &double_tap_timer, 200, double_tap_timer_on_timeout, NULL, 0,
@@ -365,9 +416,22 @@ void app_button_press_cb(uint8_t button, uint8_t duration) {
   }
 }
 
-void device_config_configuration_on_success_callback() {
+void device_config_configuration_on_success_callback(uint16_t address) {
   device_manager_print_list();
-  if (recursive > 0) {
-    provisionBLEMeshStack_app();
-  }
+  beacon_filter_print_stats();
+  retry_engine_print_stats();
+  event_dispatcher_print_stats();
+  provision_scheduler_on_config_done(address, true);
+  provision_scheduler_print_stats();
+}
+
+void device_config_configuration_on_failed_callback(uint16_t address) {
+  provision_scheduler_on_config_done(address, false);
+  provision_scheduler_print_stats();
+}
+
+void topology_on_round_done_callback(bool changed) {
+  // Also run when nothing moved, it sends again what the nodes refused
+  (void)changed;
+  relay_planner_run();
 }
\ No newline at end of file
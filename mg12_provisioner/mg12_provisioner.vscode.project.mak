@@ -58,6 +58,7 @@ INCLUDES += \
  -Iconfig/btmeshconf \
  -Iautogen \
  -I. \
+ -I../common \
  -I$(COPIED_SDK_PATH)/platform/Device/SiliconLabs/EFR32MG12P/Include \
  -I$(COPIED_SDK_PATH)/app/common/util/app_assert \
  -I$(COPIED_SDK_PATH)/app/common/util/app_button_press \
@@ -0,0 +1,28 @@
+#ifndef __DCD_SAMPLES__
+#define __DCD_SAMPLES__
+
+#include <stdint.h>
+
+/*
+ * Page 0 of the compositions of the node firmware of the group. Both report
+ * the same company, product and version ids, only their models differ.
+ * */
+
+// Light: config/health servers, on/off and lightness servers, one vendor model
+static const uint8_t dcd_sample_light[] = {
+    0xff, 0x02, 0x01, 0x00, 0x00, 0x05, 0x20, 0x00, 0x03, 0x00,  // header
+    0x00, 0x00, 0x04, 0x01,                                      // element 0
+    0x00, 0x00, 0x02, 0x00, 0x00, 0x10, 0x00, 0x13,              // SIG
+    0xff, 0x02, 0x01, 0x00,                                      // vendor
+};
+
+// Switch: config/health servers and two on/off clients on two elements
+static const uint8_t dcd_sample_switch[] = {
+    0xff, 0x02, 0x01, 0x00, 0x00, 0x05, 0x20, 0x00, 0x03, 0x00,  // header
+    0x00, 0x00, 0x03, 0x00,                                      // element 0
+    0x00, 0x00, 0x02, 0x00, 0x01, 0x10,                          // SIG
+    0x01, 0x00, 0x01, 0x00,                                      // element 1
+    0x01, 0x10,                                                  // SIG
+};
+
+#endif  // __DCD_SAMPLES__
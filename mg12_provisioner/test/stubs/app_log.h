@@ -0,0 +1,13 @@
+#ifndef __STUB_APP_LOG__
+#define __STUB_APP_LOG__
+
+// Quiet unless TEST_VERBOSE is set in the environment, see sdk_stubs.c
+void test_log(const char *format, ...);
+
+#define app_log(...) test_log(__VA_ARGS__)
+#define app_log_info(...) test_log(__VA_ARGS__)
+#define app_log_warning(...) test_log(__VA_ARGS__)
+#define app_log_error(...) test_log(__VA_ARGS__)
+#define APP_LOG_NL "\n"
+
+#endif  // __STUB_APP_LOG__
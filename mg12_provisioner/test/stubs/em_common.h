@@ -0,0 +1,8 @@
+#ifndef __STUB_EM_COMMON__
+#define __STUB_EM_COMMON__
+
+#define SL_WEAK __attribute__((weak))
+#define SL_ATTRIBUTE_PACKED __attribute__((packed))
+#define PACKSTRUCT(x) x __attribute__((packed))
+
+#endif  // __STUB_EM_COMMON__
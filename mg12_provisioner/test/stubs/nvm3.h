@@ -0,0 +1,26 @@
+#ifndef __STUB_NVM3__
+#define __STUB_NVM3__
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint32_t Ecode_t;
+typedef uint32_t nvm3_ObjectKey_t;
+typedef struct nvm3_Handle nvm3_Handle_t;
+
+#define ECODE_NVM3_OK 0
+#define ECODE_NVM3_ERR_KEY_NOT_FOUND 0xF00E0010
+#define ECODE_NVM3_ERR_STORAGE_FULL 0xF00E0003
+#define NVM3_OBJECTTYPE_DATA 0
+
+extern nvm3_Handle_t *nvm3_defaultHandle;
+
+Ecode_t nvm3_readData(nvm3_Handle_t *h, nvm3_ObjectKey_t key, void *value,
+                      size_t len);
+Ecode_t nvm3_writeData(nvm3_Handle_t *h, nvm3_ObjectKey_t key,
+                       const void *value, size_t len);
+Ecode_t nvm3_deleteObject(nvm3_Handle_t *h, nvm3_ObjectKey_t key);
+Ecode_t nvm3_getObjectInfo(nvm3_Handle_t *h, nvm3_ObjectKey_t key,
+                           uint32_t *type, size_t *len);
+
+#endif  // __STUB_NVM3__
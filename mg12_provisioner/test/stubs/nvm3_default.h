@@ -0,0 +1,6 @@
+#ifndef __STUB_NVM3_DEFAULT__
+#define __STUB_NVM3_DEFAULT__
+
+#include "nvm3.h"
+
+#endif  // __STUB_NVM3_DEFAULT__
@@ -0,0 +1,447 @@
+#include "sdk_stubs.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nvm3.h"
+#include "sl_bt_api.h"
+#include "sl_btmesh_api.h"
+#include "sl_iostream.h"
+#include "sl_sleeptimer.h"
+
+#define MAX_TIMERS 16
+#define MAX_NVM3_OBJECTS 64
+#define MAX_NVM3_OBJECT_SIZE 1900
+
+typedef struct {
+  bool used;
+  nvm3_ObjectKey_t key;
+  size_t len;
+  uint8_t data[MAX_NVM3_OBJECT_SIZE];
+} nvm3_object_t;
+
+test_call_t test_calls[TEST_MAX_CALLS];
+unsigned test_call_count;
+sl_status_t test_btmesh_result;
+uint16_t test_ddb_count;
+uint32_t test_signals;
+uint8_t test_iostream[TEST_IOSTREAM_SIZE];
+size_t test_iostream_len;
+char test_log_text[TEST_LOG_SIZE];
+static size_t test_log_len;
+
+static uint64_t now_ms;
+static uint32_t next_handle = 1;
+static sl_sleeptimer_timer_handle_t *timers[MAX_TIMERS];
+static nvm3_object_t nvm3_objects[MAX_NVM3_OBJECTS];
+nvm3_Handle_t *nvm3_defaultHandle;
+
+void test_log(const char *format, ...) {
+  static int verbose = -1;
+  va_list args;
+  int len;
+
+  if (verbose < 0) {
+    verbose = getenv("TEST_VERBOSE") != NULL;
+  }
+  va_start(args, format);
+  len = vsnprintf(&test_log_text[test_log_len],
+                  TEST_LOG_SIZE - test_log_len, format, args);
+  va_end(args);
+  if (len > 0) {
+    test_log_len += (size_t)len;
+    if (test_log_len >= TEST_LOG_SIZE) {
+      test_log_len = TEST_LOG_SIZE - 1;
+    }
+  }
+  if (verbose) {
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+  }
+}
+
+void test_reset(void) {
+  test_call_count = 0;
+  test_btmesh_result = SL_STATUS_OK;
+  test_ddb_count = 0;
+  test_signals = 0;
+  test_iostream_len = 0;
+  test_log_len = 0;
+  test_log_text[0] = '\0';
+  memset(timers, 0, sizeof(timers));
+  memset(nvm3_objects, 0, sizeof(nvm3_objects));
+}
+
+uint64_t test_now_ms(void) {
+  return now_ms;
+}
+
+void test_advance_ms(uint32_t ms) {
+  const uint64_t end = now_ms + ms;
+  sl_sleeptimer_timer_handle_t *due;
+
+  while (1) {
+    due = NULL;
+    for (int i = 0; i < MAX_TIMERS; i++) {
+      if (timers[i] != NULL && timers[i]->running &&
+          timers[i]->expire_ms <= end &&
+          (due == NULL || timers[i]->expire_ms < due->expire_ms)) {
+        due = timers[i];
+      }
+    }
+    if (due == NULL) {
+      break;
+    }
+    now_ms = due->expire_ms;
+    if (due->period_ms > 0) {
+      due->expire_ms += due->period_ms;
+    } else {
+      due->running = false;
+    }
+    due->callback(due, due->data);
+  }
+  now_ms = end;
+}
+
+const test_call_t *test_last_call(const char *name) {
+  for (unsigned i = test_call_count; i > 0; i--) {
+    if (strcmp(test_calls[i - 1].name, name) == 0) {
+      return &test_calls[i - 1];
+    }
+  }
+  return NULL;
+}
+
+unsigned test_count_calls(const char *name) {
+  unsigned count = 0;
+
+  for (unsigned i = 0; i < test_call_count; i++) {
+    count += strcmp(test_calls[i].name, name) == 0;
+  }
+  return count;
+}
+
+unsigned test_nvm3_object_count(void) {
+  unsigned count = 0;
+
+  for (int i = 0; i < MAX_NVM3_OBJECTS; i++) {
+    count += nvm3_objects[i].used;
+  }
+  return count;
+}
+
+/* Sleeptimer, one tick per millisecond */
+
+static sl_status_t __timer_start(sl_sleeptimer_timer_handle_t *handle,
+                                 uint32_t timeout_ms, uint32_t period_ms,
+                                 sl_sleeptimer_timer_callback_t callback,
+                                 void *data) {
+  int free_slot = -1;
+
+  for (int i = 0; i < MAX_TIMERS; i++) {
+    if (timers[i] == handle) {
+      free_slot = i;
+      break;
+    }
+    if (timers[i] == NULL && free_slot < 0) {
+      free_slot = i;
+    }
+  }
+  if (free_slot < 0) {
+    return SL_STATUS_NO_MORE_RESOURCE;
+  }
+  timers[free_slot] = handle;
+  handle->callback = callback;
+  handle->data = data;
+  handle->period_ms = period_ms;
+  handle->expire_ms = now_ms + timeout_ms;
+  handle->running = true;
+  return SL_STATUS_OK;
+}
+
+sl_status_t sl_sleeptimer_start_timer_ms(sl_sleeptimer_timer_handle_t *handle,
+                                         uint32_t timeout_ms,
+                                         sl_sleeptimer_timer_callback_t callback,
+                                         void *callback_data, uint8_t priority,
+                                         uint16_t option_flags) {
+  (void)priority;
+  (void)option_flags;
+  return __timer_start(handle, timeout_ms, 0, callback, callback_data);
+}
+
+sl_status_t sl_sleeptimer_restart_timer_ms(
+    sl_sleeptimer_timer_handle_t *handle, uint32_t timeout_ms,
+    sl_sleeptimer_timer_callback_t callback, void *callback_data,
+    uint8_t priority, uint16_t option_flags) {
+  (void)priority;
+  (void)option_flags;
+  return __timer_start(handle, timeout_ms, 0, callback, callback_data);
+}
+
+sl_status_t sl_sleeptimer_start_periodic_timer_ms(
+    sl_sleeptimer_timer_handle_t *handle, uint32_t timeout_ms,
+    sl_sleeptimer_timer_callback_t callback, void *callback_data,
+    uint8_t priority, uint16_t option_flags) {
+  (void)priority;
+  (void)option_flags;
+  return __timer_start(handle, timeout_ms, timeout_ms, callback,
+                       callback_data);
+}
+
+sl_status_t sl_sleeptimer_stop_timer(sl_sleeptimer_timer_handle_t *handle) {
+  handle->running = false;
+  return SL_STATUS_OK;
+}
+
+uint32_t sl_sleeptimer_get_tick_count(void) {
+  return (uint32_t)now_ms;
+}
+
+uint64_t sl_sleeptimer_get_tick_count64(void) {
+  return now_ms;
+}
+
+uint32_t sl_sleeptimer_tick_to_ms(uint32_t tick) {
+  return tick;
+}
+
+uint32_t sl_sleeptimer_ms_to_tick(uint16_t time_ms) {
+  return time_ms;
+}
+
+sl_status_t sl_sleeptimer_tick64_to_ms(uint64_t tick, uint64_t *ms) {
+  *ms = tick;
+  return SL_STATUS_OK;
+}
+
+/* Bluetooth and mesh stack */
+
+sl_status_t sl_bt_external_signal(uint32_t signals) {
+  test_signals |= signals;
+  return SL_STATUS_OK;
+}
+
+static sl_status_t __record(const char *name, uint32_t *handle, int count,
+                            ...) {
+  test_call_t *call;
+  va_list args;
+
+  if (test_call_count == TEST_MAX_CALLS) {
+    fprintf(stderr, "too many stack calls recorded\n");
+    abort();
+  }
+  call = &test_calls[test_call_count++];
+  memset(call, 0, sizeof(*call));
+  call->name = name;
+  va_start(args, count);
+  for (int i = 0; i < count; i++) {
+    call->args[i] = va_arg(args, uint32_t);
+  }
+  va_end(args);
+  if (test_btmesh_result == SL_STATUS_OK && handle != NULL) {
+    call->handle = next_handle++;
+    *handle = call->handle;
+  }
+  return test_btmesh_result;
+}
+
+uint32_t test_uuid_tail(const uuid_128 *uuid) {
+  return (uint32_t)(uuid->data[14] << 8 | uuid->data[15]);
+}
+
+sl_status_t sl_btmesh_prov_create_provisioning_session(
+    uint16_t netkey_index, uuid_128 uuid, uint8_t attention_timer_sec) {
+  (void)netkey_index;
+  (void)attention_timer_sec;
+  return __record("create_provisioning_session", NULL, 1,
+                  test_uuid_tail(&uuid));
+}
+
+sl_status_t sl_btmesh_prov_provision_adv_device(uuid_128 uuid) {
+  return __record("provision_adv_device", NULL, 1, test_uuid_tail(&uuid));
+}
+
+sl_status_t sl_btmesh_prov_set_provisioning_suspend_event(uint8_t status) {
+  return __record("set_provisioning_suspend_event", NULL, 1,
+                  (uint32_t)status);
+}
+
+sl_status_t sl_btmesh_prov_continue_provisioning(uuid_128 uuid) {
+  return __record("continue_provisioning", NULL, 1, test_uuid_tail(&uuid));
+}
+
+sl_status_t sl_btmesh_prov_set_device_address(uuid_128 uuid,
+                                              uint16_t address) {
+  return __record("set_device_address", NULL, 2, test_uuid_tail(&uuid),
+                  (uint32_t)address);
+}
+
+sl_status_t sl_btmesh_prov_delete_ddb_entry(uuid_128 uuid) {
+  return __record("delete_ddb_entry", NULL, 1, test_uuid_tail(&uuid));
+}
+
+sl_status_t sl_btmesh_prov_get_ddb_entry(uuid_128 uuid,
+                                         aes_key_128 *device_key,
+                                         uint16_t *netkey_index,
+                                         uint16_t *address,
+                                         uint8_t *elements) {
+  (void)device_key;
+  (void)netkey_index;
+  (void)address;
+  (void)elements;
+  return __record("get_ddb_entry", NULL, 1, test_uuid_tail(&uuid));
+}
+
+sl_status_t sl_btmesh_config_client_add_appkey(uint16_t enc_netkey_index,
+                                               uint16_t server_address,
+                                               uint16_t appkey_index,
+                                               uint16_t netkey_index,
+                                               uint32_t *handle) {
+  (void)enc_netkey_index;
+  (void)appkey_index;
+  (void)netkey_index;
+  return __record("add_appkey", handle, 1, (uint32_t)server_address);
+}
+
+sl_status_t sl_btmesh_prov_list_ddb_entries(uint16_t *count) {
+  *count = test_ddb_count;
+  return __record("list_ddb_entries", NULL, 0);
+}
+
+sl_status_t sl_btmesh_prov_start_key_refresh(uint16_t netkey_index,
+                                             uint8_t num_appkeys,
+                                             size_t appkey_indices_len,
+                                             const uint8_t *appkey_indices) {
+  (void)appkey_indices_len;
+  (void)appkey_indices;
+  return __record("start_key_refresh", NULL, 2, (uint32_t)netkey_index,
+                  (uint32_t)num_appkeys);
+}
+
+sl_status_t sl_btmesh_prov_suspend_key_refresh(uint16_t netkey_index) {
+  return __record("suspend_key_refresh", NULL, 1, (uint32_t)netkey_index);
+}
+
+sl_status_t sl_btmesh_prov_resume_key_refresh(uint16_t netkey_index) {
+  return __record("resume_key_refresh", NULL, 1, (uint32_t)netkey_index);
+}
+
+sl_status_t sl_btmesh_config_client_cancel_request(uint32_t handle) {
+  return __record("cancel_request", NULL, 1, handle);
+}
+
+sl_status_t sl_btmesh_config_client_set_relay(uint16_t enc_netkey_index,
+                                              uint16_t server_address,
+                                              uint8_t value,
+                                              uint8_t retransmit_count,
+                                              uint16_t retransmit_interval_ms,
+                                              uint32_t *handle) {
+  (void)enc_netkey_index;
+  (void)retransmit_count;
+  (void)retransmit_interval_ms;
+  return __record("set_relay", handle, 2, (uint32_t)server_address,
+                  (uint32_t)value);
+}
+
+sl_status_t sl_btmesh_config_client_set_heartbeat_sub(
+    uint16_t enc_netkey_index, uint16_t server_address,
+    uint16_t source_address, uint16_t destination_address, uint8_t period_log,
+    uint32_t *handle) {
+  (void)enc_netkey_index;
+  return __record("set_heartbeat_sub", handle, 4, (uint32_t)server_address,
+                  (uint32_t)source_address, (uint32_t)destination_address,
+                  (uint32_t)period_log);
+}
+
+sl_status_t sl_btmesh_config_client_get_heartbeat_sub(
+    uint16_t enc_netkey_index, uint16_t server_address, uint32_t *handle) {
+  (void)enc_netkey_index;
+  return __record("get_heartbeat_sub", handle, 1, (uint32_t)server_address);
+}
+
+/* NVM3, objects kept in RAM until test_reset */
+
+static nvm3_object_t *__nvm3_find(nvm3_ObjectKey_t key) {
+  for (int i = 0; i < MAX_NVM3_OBJECTS; i++) {
+    if (nvm3_objects[i].used && nvm3_objects[i].key == key) {
+      return &nvm3_objects[i];
+    }
+  }
+  return NULL;
+}
+
+Ecode_t nvm3_readData(nvm3_Handle_t *h, nvm3_ObjectKey_t key, void *value,
+                      size_t len) {
+  nvm3_object_t *object = __nvm3_find(key);
+
+  (void)h;
+  if (object == NULL) {
+    return ECODE_NVM3_ERR_KEY_NOT_FOUND;
+  }
+  memcpy(value, object->data, len < object->len ? len : object->len);
+  return ECODE_NVM3_OK;
+}
+
+Ecode_t nvm3_writeData(nvm3_Handle_t *h, nvm3_ObjectKey_t key,
+                       const void *value, size_t len) {
+  nvm3_object_t *object = __nvm3_find(key);
+
+  (void)h;
+  if (len > MAX_NVM3_OBJECT_SIZE) {
+    return ECODE_NVM3_ERR_STORAGE_FULL;
+  }
+  for (int i = 0; object == NULL && i < MAX_NVM3_OBJECTS; i++) {
+    if (!nvm3_objects[i].used) {
+      object = &nvm3_objects[i];
+    }
+  }
+  if (object == NULL) {
+    return ECODE_NVM3_ERR_STORAGE_FULL;
+  }
+  object->used = true;
+  object->key = key;
+  object->len = len;
+  memcpy(object->data, value, len);
+  return ECODE_NVM3_OK;
+}
+
+Ecode_t nvm3_deleteObject(nvm3_Handle_t *h, nvm3_ObjectKey_t key) {
+  nvm3_object_t *object = __nvm3_find(key);
+
+  (void)h;
+  if (object == NULL) {
+    return ECODE_NVM3_ERR_KEY_NOT_FOUND;
+  }
+  object->used = false;
+  return ECODE_NVM3_OK;
+}
+
+Ecode_t nvm3_getObjectInfo(nvm3_Handle_t *h, nvm3_ObjectKey_t key,
+                           uint32_t *type, size_t *len) {
+  nvm3_object_t *object = __nvm3_find(key);
+
+  (void)h;
+  if (object == NULL) {
+    return ECODE_NVM3_ERR_KEY_NOT_FOUND;
+  }
+  *type = NVM3_OBJECTTYPE_DATA;
+  *len = object->len;
+  return ECODE_NVM3_OK;
+}
+
+/* IO stream, kept for the tests of the binary dumps */
+
+sl_status_t sl_iostream_write(sl_iostream_t *stream, const void *buffer,
+                              size_t buffer_length) {
+  (void)stream;
+  if (test_iostream_len + buffer_length > TEST_IOSTREAM_SIZE) {
+    return SL_STATUS_NO_MORE_RESOURCE;
+  }
+  memcpy(&test_iostream[test_iostream_len], buffer, buffer_length);
+  test_iostream_len += buffer_length;
+  return SL_STATUS_OK;
+}
@@ -0,0 +1,75 @@
+#ifndef __STUB_SDK_STUBS__
+#define __STUB_SDK_STUBS__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sl_bt_api.h"
+#include "sl_status.h"
+
+#define TEST_MAX_CALLS 512
+#define TEST_MAX_CALL_ARGS 6
+#define TEST_IOSTREAM_SIZE 4096
+#define TEST_LOG_SIZE 8192
+
+/**
+ * @brief A stack call made by the module under test, the arguments are in
+ * the order of the API
+ *
+ */
+typedef struct {
+  const char *name;
+  uint32_t args[TEST_MAX_CALL_ARGS];
+  uint32_t handle;
+} test_call_t;
+
+extern test_call_t test_calls[TEST_MAX_CALLS];
+extern unsigned test_call_count;
+// Returned by the next stack calls, SL_STATUS_OK after test_reset
+extern sl_status_t test_btmesh_result;
+// Value written by sl_btmesh_prov_list_ddb_entries
+extern uint16_t test_ddb_count;
+
+// Or of the sl_bt_external_signal calls since the last test_reset
+extern uint32_t test_signals;
+
+extern uint8_t test_iostream[TEST_IOSTREAM_SIZE];
+extern size_t test_iostream_len;
+
+// app_log output since the last test_reset, the end is dropped once full
+extern char test_log_text[TEST_LOG_SIZE];
+
+/**
+ * @brief Forget the calls, signals, timers, iostream output and NVM3 objects.
+ * The clock keeps running so that the modules never see it going back.
+ *
+ */
+void test_reset(void);
+
+/**
+ * @brief Move the clock and run the sleeptimer callbacks that fall due, in
+ * order
+ *
+ */
+void test_advance_ms(uint32_t ms);
+
+uint64_t test_now_ms(void);
+
+/**
+ * @brief Find the last stack call with this name
+ *
+ * @return const test_call_t* NULL if there is none
+ */
+const test_call_t *test_last_call(const char *name);
+
+unsigned test_count_calls(const char *name);
+
+unsigned test_nvm3_object_count(void);
+
+/**
+ * @brief Last two bytes of a UUID, the number the tests give their devices
+ *
+ */
+uint32_t test_uuid_tail(const uuid_128 *uuid);
+
+#endif  // __STUB_SDK_STUBS__
@@ -0,0 +1,35 @@
+#ifndef __STUB_SL_BT_API__
+#define __STUB_SL_BT_API__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "em_common.h"
+#include "sl_status.h"
+
+typedef struct {
+  uint8_t addr[6];
+} bd_addr;
+
+typedef struct {
+  uint8_t data[16];
+} uuid_128;
+
+typedef struct {
+  uint8_t len;
+  uint8_t data[];
+} uint8array;
+
+#define SL_BT_MSG_ID(HDR) ((HDR) & 0xffff00f8)
+
+#define sl_bt_evt_system_external_signal_id 0x030100a0
+
+typedef struct {
+  uint32_t extsignals;
+} sl_bt_evt_system_external_signal_t;
+
+// Records the signals raised, see test_signals in sdk_stubs.h
+sl_status_t sl_bt_external_signal(uint32_t signals);
+
+#endif  // __STUB_SL_BT_API__
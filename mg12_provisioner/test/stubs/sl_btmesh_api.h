@@ -0,0 +1,241 @@
+#ifndef __STUB_SL_BTMESH_API__
+#define __STUB_SL_BTMESH_API__
+
+// Only what the modules under test use, the event ids do not match the SDK
+// but differ in the bits SL_BT_MSG_ID keeps
+#include "sl_bt_api.h"
+typedef struct {
+  uint8_t data[16];
+} aes_key_128;
+enum {
+  sl_btmesh_evt_prov_initialized_id = 0x00150028,
+  sl_btmesh_evt_prov_initialization_failed_id = 0x01150028,
+  sl_btmesh_evt_prov_provisioning_suspended_id = 0x02150028,
+  sl_btmesh_evt_prov_capabilities_id = 0x03150028,
+  sl_btmesh_evt_prov_provisioning_failed_id = 0x04150028,
+  sl_btmesh_evt_prov_device_provisioned_id = 0x05150028,
+  sl_btmesh_evt_prov_unprov_beacon_id = 0x06150028,
+  sl_btmesh_evt_prov_key_refresh_phase_update_id = 0x07150028,
+  sl_btmesh_evt_prov_key_refresh_node_update_id = 0x08150028,
+  sl_btmesh_evt_prov_key_refresh_complete_id = 0x09150028,
+  sl_btmesh_evt_prov_delete_ddb_entry_id = 0x0a150028,
+  sl_btmesh_evt_config_client_request_modified_id = 0x0b150028,
+  sl_btmesh_evt_config_client_appkey_status_id = 0x0c150028,
+  sl_btmesh_evt_config_client_binding_status_id = 0x0d150028,
+  sl_btmesh_evt_config_client_model_pub_status_id = 0x0e150028,
+  sl_btmesh_evt_config_client_model_sub_status_id = 0x0f150028,
+  sl_btmesh_evt_config_client_dcd_data_id = 0x10150028,
+  sl_btmesh_evt_config_client_dcd_data_end_id = 0x11150028,
+  sl_btmesh_evt_config_client_gatt_proxy_status_id = 0x12150028,
+  sl_btmesh_evt_config_client_relay_status_id = 0x13150028,
+  sl_btmesh_evt_config_client_heartbeat_pub_status_id = 0x14150028,
+  sl_btmesh_evt_config_client_heartbeat_sub_status_id = 0x15150028,
+  sl_btmesh_evt_config_client_reset_status_id = 0x16150028,
+  sl_btmesh_evt_node_heartbeat_id = 0x17150028,
+  sl_btmesh_evt_prov_ddb_list_id = 0x18150028,
+  sl_btmesh_evt_node_changed_ivupdate_state_id = 0x19150028,
+};
+typedef struct {
+  uint8_t networks;
+  uint16_t address;
+  uint32_t iv_index;
+} sl_btmesh_evt_prov_initialized_t;
+typedef struct {
+  uuid_128 uuid;
+  uint16_t address;
+  uint8_t elements;
+} sl_btmesh_evt_prov_ddb_list_t;
+typedef struct {
+  uint16_t result;
+} sl_btmesh_evt_prov_initialization_failed_t;
+typedef struct {
+  uuid_128 uuid;
+  uint8_t reason;
+} sl_btmesh_evt_prov_provisioning_suspended_t;
+typedef struct {
+  uuid_128 uuid;
+  uint8_t elements;
+  uint16_t algorithms;
+  uint8_t pkey_type;
+  uint8_t static_oob_type;
+  uint8_t ouput_oob_size;
+  uint16_t output_oob_action;
+  uint8_t input_oob_size;
+  uint16_t intput_oob_action;
+} sl_btmesh_evt_prov_capabilities_t;
+typedef struct {
+  uint8_t reason;
+  uuid_128 uuid;
+} sl_btmesh_evt_prov_provisioning_failed_t;
+typedef struct {
+  uint16_t address;
+  uuid_128 uuid;
+} sl_btmesh_evt_prov_device_provisioned_t;
+typedef struct {
+  uint16_t oob_capabilities;
+  uint32_t uri_hash;
+  uint8_t bearer;
+  bd_addr address;
+  uint8_t address_type;
+  uuid_128 uuid;
+  int8_t rssi;
+} sl_btmesh_evt_prov_unprov_beacon_t;
+typedef struct {
+  uint16_t key;
+  uint8_t phase;
+  uint8_t failure_code;
+  uuid_128 uuid;
+} sl_btmesh_evt_prov_key_refresh_node_update_t;
+typedef struct {
+  uint16_t key;
+  uint8_t phase;
+} sl_btmesh_evt_prov_key_refresh_phase_update_t;
+typedef struct {
+  uint16_t key;
+  uint16_t result;
+} sl_btmesh_evt_prov_key_refresh_complete_t;
+typedef struct {
+  uint16_t result;
+  uuid_128 uuid;
+} sl_btmesh_evt_prov_delete_ddb_entry_t;
+typedef struct {
+  uint16_t result;
+  uint32_t handle;
+} sl_btmesh_evt_config_client_appkey_status_t;
+typedef struct {
+  uint16_t result;
+  uint32_t handle;
+} sl_btmesh_evt_config_client_binding_status_t;
+typedef struct {
+  uint16_t result;
+  uint32_t handle;
+  uint16_t address;
+  uint16_t appkey_index;
+  uint8_t credentials;
+  uint8_t ttl;
+  uint32_t period_ms;
+  uint8_t retransmit_count;
+  uint16_t retransmit_interval_ms;
+} sl_btmesh_evt_config_client_model_pub_status_t;
+typedef struct {
+  uint16_t result;
+  uint32_t handle;
+} sl_btmesh_evt_config_client_model_sub_status_t;
+typedef struct {
+  uint16_t result;
+  uint32_t handle;
+  uint8_t page;
+  uint8array data;
+} sl_btmesh_evt_config_client_dcd_data_t;
+typedef struct {
+  uint16_t result;
+  uint32_t handle;
+} sl_btmesh_evt_config_client_dcd_data_end_t;
+typedef struct {
+  uint16_t result;
+  uint32_t handle;
+  uint8_t value;
+} sl_btmesh_evt_config_client_gatt_proxy_status_t;
+typedef struct {
+  uint16_t result;
+  uint32_t handle;
+  uint8_t relay;
+  uint8_t retransmit_count;
+  uint16_t retransmit_interval_ms;
+} sl_btmesh_evt_config_client_relay_status_t;
+typedef struct {
+  uint16_t result;
+  uint32_t handle;
+  uint16_t destination_address;
+  uint16_t netkey_index;
+  uint8_t count_log;
+  uint8_t period_log;
+  uint8_t ttl;
+  uint16_t features;
+} sl_btmesh_evt_config_client_heartbeat_pub_status_t;
+typedef struct {
+  uint16_t result;
+  uint32_t handle;
+  uint16_t source_address;
+  uint16_t destination_address;
+  uint8_t period_log;
+  uint8_t count_log;
+  uint8_t min_hops;
+  uint8_t max_hops;
+} sl_btmesh_evt_config_client_heartbeat_sub_status_t;
+typedef struct {
+  uint16_t result;
+  uint32_t handle;
+} sl_btmesh_evt_config_client_reset_status_t;
+typedef struct {
+  uint16_t src_addr;
+  uint16_t dst_addr;
+  uint8_t hops;
+} sl_btmesh_evt_node_heartbeat_t;
+typedef struct {
+  uint32_t iv_index;
+  uint8_t state;
+} sl_btmesh_evt_node_changed_ivupdate_state_t;
+typedef struct {
+  uint32_t header;
+  union {
+    sl_btmesh_evt_prov_initialized_t evt_prov_initialized;
+    sl_btmesh_evt_prov_ddb_list_t evt_prov_ddb_list;
+    sl_btmesh_evt_prov_initialization_failed_t evt_prov_initialization_failed;
+    sl_btmesh_evt_prov_provisioning_suspended_t evt_prov_provisioning_suspended;
+    sl_btmesh_evt_prov_capabilities_t evt_prov_capabilities;
+    sl_btmesh_evt_prov_provisioning_failed_t evt_prov_provisioning_failed;
+    sl_btmesh_evt_prov_device_provisioned_t evt_prov_device_provisioned;
+    sl_btmesh_evt_prov_unprov_beacon_t evt_prov_unprov_beacon;
+    sl_btmesh_evt_prov_key_refresh_node_update_t evt_prov_key_refresh_node_update;
+    sl_btmesh_evt_prov_key_refresh_phase_update_t evt_prov_key_refresh_phase_update;
+    sl_btmesh_evt_prov_key_refresh_complete_t evt_prov_key_refresh_complete;
+    sl_btmesh_evt_prov_delete_ddb_entry_t evt_prov_delete_ddb_entry;
+    sl_btmesh_evt_config_client_appkey_status_t evt_config_client_appkey_status;
+    sl_btmesh_evt_config_client_binding_status_t evt_config_client_binding_status;
+    sl_btmesh_evt_config_client_model_pub_status_t evt_config_client_model_pub_status;
+    sl_btmesh_evt_config_client_model_sub_status_t evt_config_client_model_sub_status;
+    sl_btmesh_evt_config_client_dcd_data_t evt_config_client_dcd_data;
+    sl_btmesh_evt_config_client_dcd_data_end_t evt_config_client_dcd_data_end;
+    sl_btmesh_evt_config_client_gatt_proxy_status_t evt_config_client_gatt_proxy_status;
+    sl_btmesh_evt_config_client_relay_status_t evt_config_client_relay_status;
+    sl_btmesh_evt_node_changed_ivupdate_state_t evt_node_changed_ivupdate_state;
+    sl_btmesh_evt_config_client_heartbeat_pub_status_t evt_config_client_heartbeat_pub_status;
+    sl_btmesh_evt_config_client_heartbeat_sub_status_t evt_config_client_heartbeat_sub_status;
+    sl_btmesh_evt_config_client_reset_status_t evt_config_client_reset_status;
+    sl_btmesh_evt_node_heartbeat_t evt_node_heartbeat;
+  } data;
+} sl_btmesh_msg_t;
+sl_status_t sl_btmesh_prov_init(void);
+sl_status_t sl_btmesh_prov_create_network(uint16_t netkey_index, size_t key_len, const uint8_t *key);
+sl_status_t sl_btmesh_prov_create_appkey(uint16_t netkey_index, uint16_t appkey_index, size_t key_len, const uint8_t *key, size_t max_key_size, size_t *key_size, uint8_t *keyout);
+sl_status_t sl_btmesh_prov_scan_unprov_beacons(void);
+sl_status_t sl_btmesh_prov_get_ddb_entry(uuid_128 uuid, aes_key_128 *device_key, uint16_t *netkey_index, uint16_t *address, uint8_t *elements);
+sl_status_t sl_btmesh_prov_delete_ddb_entry(uuid_128 uuid);
+sl_status_t sl_btmesh_prov_create_provisioning_session(uint16_t netkey_index, uuid_128 uuid, uint8_t attention_timer_sec);
+sl_status_t sl_btmesh_prov_provision_adv_device(uuid_128 uuid);
+sl_status_t sl_btmesh_prov_set_provisioning_suspend_event(uint8_t status);
+sl_status_t sl_btmesh_prov_continue_provisioning(uuid_128 uuid);
+sl_status_t sl_btmesh_prov_abort_provisioning(uuid_128 uuid, uint8_t reason);
+sl_status_t sl_btmesh_prov_set_device_address(uuid_128 uuid, uint16_t address);
+sl_status_t sl_btmesh_prov_start_key_refresh(uint16_t netkey_index, uint8_t num_appkeys, size_t appkey_indices_len, const uint8_t *appkey_indices);
+sl_status_t sl_btmesh_prov_get_key_refresh_exclusion(uint16_t key, uuid_128 uuid, uint8_t *status);
+sl_status_t sl_btmesh_prov_set_key_refresh_exclusion(uint16_t key, uint8_t status, uuid_128 uuid);
+sl_status_t sl_btmesh_prov_suspend_key_refresh(uint16_t netkey_index);
+sl_status_t sl_btmesh_prov_resume_key_refresh(uint16_t netkey_index);
+sl_status_t sl_btmesh_generic_client_init(void);
+sl_status_t sl_btmesh_config_client_cancel_request(uint32_t handle);
+sl_status_t sl_btmesh_config_client_add_appkey(uint16_t enc_netkey_index, uint16_t server_address, uint16_t appkey_index, uint16_t netkey_index, uint32_t *handle);
+sl_status_t sl_btmesh_config_client_get_dcd(uint16_t enc_netkey_index, uint16_t server_address, uint8_t page, uint32_t *handle);
+sl_status_t sl_btmesh_config_client_bind_model(uint16_t enc_netkey_index, uint16_t server_address, uint8_t element_index, uint16_t vendor_id, uint16_t model_id, uint16_t appkey_index, uint32_t *handle);
+sl_status_t sl_btmesh_config_client_set_model_pub(uint16_t enc_netkey_index, uint16_t server_address, uint8_t element_index, uint16_t vendor_id, uint16_t model_id, uint16_t address, uint16_t appkey_index, uint8_t credentials, uint8_t ttl, uint32_t period_ms, uint8_t retransmit_count, uint16_t retransmit_interval_ms, uint32_t *handle);
+sl_status_t sl_btmesh_config_client_add_model_sub(uint16_t enc_netkey_index, uint16_t server_address, uint8_t element_index, uint16_t vendor_id, uint16_t model_id, uint16_t sub_address, uint32_t *handle);
+sl_status_t sl_btmesh_config_client_set_gatt_proxy(uint16_t enc_netkey_index, uint16_t server_address, uint8_t value, uint32_t *handle);
+sl_status_t sl_btmesh_config_client_set_relay(uint16_t enc_netkey_index, uint16_t server_address, uint8_t value, uint8_t retransmit_count, uint16_t retransmit_interval_ms, uint32_t *handle);
+sl_status_t sl_btmesh_config_client_set_heartbeat_pub(uint16_t enc_netkey_index, uint16_t server_address, uint16_t destination_address, uint16_t netkey_index, uint8_t count_log, uint8_t period_log, uint8_t ttl, uint16_t features, uint32_t *handle);
+sl_status_t sl_btmesh_config_client_set_heartbeat_sub(uint16_t enc_netkey_index, uint16_t server_address, uint16_t source_address, uint16_t destination_address, uint8_t period_log, uint32_t *handle);
+sl_status_t sl_btmesh_config_client_get_heartbeat_sub(uint16_t enc_netkey_index, uint16_t server_address, uint32_t *handle);
+
+sl_status_t sl_btmesh_prov_list_ddb_entries(uint16_t *count);
+
+#endif  // __STUB_SL_BTMESH_API__
@@ -0,0 +1,15 @@
+#ifndef __STUB_SL_IOSTREAM__
+#define __STUB_SL_IOSTREAM__
+
+#include <stddef.h>
+
+#include "sl_status.h"
+
+typedef struct sl_iostream sl_iostream_t;
+
+#define SL_IOSTREAM_STDOUT ((sl_iostream_t *)0)
+
+sl_status_t sl_iostream_write(sl_iostream_t *stream, const void *buffer,
+                              size_t buffer_length);
+
+#endif  // __STUB_SL_IOSTREAM__
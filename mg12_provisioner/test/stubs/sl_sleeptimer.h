@@ -0,0 +1,43 @@
+#ifndef __STUB_SL_SLEEPTIMER__
+#define __STUB_SL_SLEEPTIMER__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sl_status.h"
+
+// The tick is one millisecond, the clock only moves in test_advance_ms
+typedef struct sl_sleeptimer_timer_handle sl_sleeptimer_timer_handle_t;
+typedef void (*sl_sleeptimer_timer_callback_t)(
+    sl_sleeptimer_timer_handle_t *handle, void *data);
+struct sl_sleeptimer_timer_handle {
+  sl_sleeptimer_timer_callback_t callback;
+  void *data;
+  uint32_t period_ms;
+  uint64_t expire_ms;
+  bool running;
+};
+
+#define SL_SLEEPTIMER_NO_HIGH_PRECISION_HF_CLOCKS_REQUIRED_FLAG 0x01
+
+sl_status_t sl_sleeptimer_start_timer_ms(sl_sleeptimer_timer_handle_t *handle,
+                                         uint32_t timeout_ms,
+                                         sl_sleeptimer_timer_callback_t callback,
+                                         void *callback_data, uint8_t priority,
+                                         uint16_t option_flags);
+sl_status_t sl_sleeptimer_restart_timer_ms(
+    sl_sleeptimer_timer_handle_t *handle, uint32_t timeout_ms,
+    sl_sleeptimer_timer_callback_t callback, void *callback_data,
+    uint8_t priority, uint16_t option_flags);
+sl_status_t sl_sleeptimer_start_periodic_timer_ms(
+    sl_sleeptimer_timer_handle_t *handle, uint32_t timeout_ms,
+    sl_sleeptimer_timer_callback_t callback, void *callback_data,
+    uint8_t priority, uint16_t option_flags);
+sl_status_t sl_sleeptimer_stop_timer(sl_sleeptimer_timer_handle_t *handle);
+uint32_t sl_sleeptimer_get_tick_count(void);
+uint64_t sl_sleeptimer_get_tick_count64(void);
+uint32_t sl_sleeptimer_tick_to_ms(uint32_t tick);
+uint32_t sl_sleeptimer_ms_to_tick(uint16_t time_ms);
+sl_status_t sl_sleeptimer_tick64_to_ms(uint64_t tick, uint64_t *ms);
+
+#endif  // __STUB_SL_SLEEPTIMER__
@@ -0,0 +1,22 @@
+#ifndef __STUB_SL_STATUS__
+#define __STUB_SL_STATUS__
+
+#include <stdint.h>
+
+// Same values as the SDK's sl_status.h, the modules print them
+typedef uint32_t sl_status_t;
+
+#define SL_STATUS_OK 0x0000
+#define SL_STATUS_FAIL 0x0001
+#define SL_STATUS_INVALID_STATE 0x0002
+#define SL_STATUS_BUSY 0x0004
+#define SL_STATUS_ABORT 0x0006
+#define SL_STATUS_TIMEOUT 0x0007
+#define SL_STATUS_NO_MORE_RESOURCE 0x001A
+#define SL_STATUS_EMPTY 0x001B
+#define SL_STATUS_FULL 0x001C
+#define SL_STATUS_INVALID_PARAMETER 0x0021
+#define SL_STATUS_NOT_FOUND 0x002D
+#define SL_STATUS_ALREADY_EXISTS 0x002E
+
+#endif  // __STUB_SL_STATUS__
@@ -0,0 +1,47 @@
+#ifndef __TEST__
+#define __TEST__
+
+#include <stdio.h>
+
+#include "sdk_stubs.h"
+
+/*
+ * Minimal test runner, each test_*.c is its own program:
+ *
+ *   TEST_RUN(test_something);
+ *   return TEST_RESULT();
+ * */
+
+static int test_failures;
+
+#define CHECK(cond)                                                        \
+  do {                                                                     \
+    if (!(cond)) {                                                         \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,     \
+              #cond);                                                      \
+      test_failures++;                                                     \
+    }                                                                      \
+  } while (0)
+
+#define CHECK_EQ(actual, expected)                                         \
+  do {                                                                     \
+    long long __actual = (long long)(actual);                              \
+    long long __expected = (long long)(expected);                          \
+    if (__actual != __expected) {                                          \
+      fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n", __FILE__,      \
+              __LINE__, #actual, __actual, __expected);                    \
+      test_failures++;                                                     \
+    }                                                                      \
+  } while (0)
+
+#define TEST_RUN(test)                                                     \
+  do {                                                                     \
+    int __before = test_failures;                                          \
+    test_reset();                                                          \
+    test();                                                                \
+    printf("%s %s\n", test_failures == __before ? "pass" : "FAIL", #test); \
+  } while (0)
+
+#define TEST_RESULT() (test_failures == 0 ? 0 : 1)
+
+#endif  // __TEST__
@@ -0,0 +1,154 @@
+#include <stdlib.h>
+
+#include "AddressAllocator.h"
+#include "test.h"
+
+#define FIRST ADDRESS_ALLOCATOR_FIRST
+
+static void test_dense_ranges(void) {
+  address_allocator_init();
+  CHECK_EQ(address_allocator_alloc(3), FIRST);
+  // Crosses the first 32-bit word
+  CHECK_EQ(address_allocator_alloc(30), FIRST + 3);
+  CHECK_EQ(address_allocator_alloc(2), FIRST + 33);
+  CHECK_EQ(address_allocator_get_used(), 35);
+
+  CHECK_EQ(address_allocator_alloc(0), ADDRESS_ALLOCATOR_NONE);
+  CHECK_EQ(address_allocator_alloc(ADDRESS_ALLOCATOR_MAX_ELEMENTS + 1),
+           ADDRESS_ALLOCATOR_NONE);
+}
+
+static void test_reserve(void) {
+  address_allocator_init();
+  // The provisioner and a node of the device database
+  address_allocator_reserve(0x0001, 1);
+  address_allocator_reserve(FIRST + 1, 2);
+  CHECK_EQ(address_allocator_get_used(), 2);
+  CHECK_EQ(address_allocator_alloc(1), FIRST);
+  CHECK_EQ(address_allocator_alloc(2), FIRST + 3);
+
+  // Out of the managed space, ignored
+  address_allocator_reserve(FIRST + ADDRESS_ALLOCATOR_SIZE, 4);
+  CHECK_EQ(address_allocator_get_used(), 5);
+}
+
+static void test_released_ranges_go_last(void) {
+  uint16_t first;
+  uint16_t second;
+
+  address_allocator_init();
+  address_allocator_on_iv_index(5);
+  first = address_allocator_alloc(2);
+  second = address_allocator_alloc(3);
+  address_allocator_release(first);
+  CHECK_EQ(address_allocator_get_used(), 3);
+  CHECK_EQ(address_allocator_get_quarantined(), 2);
+
+  // Not handed out again while other addresses are free
+  CHECK_EQ(address_allocator_alloc(1), second + 3);
+  CHECK_EQ(address_allocator_alloc(2), second + 4);
+
+  // Free again once the IV index moves
+  address_allocator_on_iv_index(5);
+  CHECK_EQ(address_allocator_get_quarantined(), 2);
+  address_allocator_on_iv_index(6);
+  CHECK_EQ(address_allocator_get_quarantined(), 0);
+  CHECK_EQ(address_allocator_alloc(2), first);
+}
+
+static void test_quarantine_used_when_full(void) {
+  uint16_t released;
+
+  address_allocator_init();
+  for (uint16_t i = 0; i < ADDRESS_ALLOCATOR_SIZE; i++) {
+    address_allocator_alloc(1);
+  }
+  CHECK_EQ(address_allocator_alloc(1), ADDRESS_ALLOCATOR_NONE);
+
+  released = FIRST + 40;
+  address_allocator_release(released);
+  CHECK_EQ(address_allocator_alloc(2), ADDRESS_ALLOCATOR_NONE);
+  CHECK_EQ(address_allocator_alloc(1), released);
+  CHECK_EQ(address_allocator_get_quarantined(), 0);
+  CHECK_EQ(address_allocator_get_used(), ADDRESS_ALLOCATOR_SIZE);
+}
+
+static void test_release_whole_range(void) {
+  uint16_t first;
+  uint16_t second;
+
+  address_allocator_init();
+  first = address_allocator_alloc(4);
+  second = address_allocator_alloc(4);
+  // Only a primary element address releases anything
+  address_allocator_release(first + 1);
+  CHECK_EQ(address_allocator_get_used(), 8);
+
+  // Stops at the next range
+  address_allocator_release(first);
+  CHECK_EQ(address_allocator_get_used(), 4);
+  address_allocator_release(first);
+  CHECK_EQ(address_allocator_get_used(), 4);
+  address_allocator_release(second);
+  CHECK_EQ(address_allocator_get_used(), 0);
+  CHECK_EQ(address_allocator_get_quarantined(), 8);
+}
+
+/*
+ * Random allocations and releases checked against a plain array
+ * */
+static void test_churn_against_model(void) {
+  enum { MAX_RANGES = 64 };
+  bool taken[ADDRESS_ALLOCATOR_SIZE] = {false};
+  uint16_t starts[MAX_RANGES];
+  uint8_t sizes[MAX_RANGES];
+  uint8_t count = 0;
+  uint16_t used = 0;
+  uint16_t address;
+  uint8_t elements;
+  uint8_t pick;
+
+  srand(2);
+  address_allocator_init();
+  address_allocator_on_iv_index(0);
+  for (int step = 0; step < 5000; step++) {
+    if (count > 0 && (count == MAX_RANGES || rand() % 2 == 0)) {
+      pick = (uint8_t)(rand() % count);
+      address_allocator_release(starts[pick]);
+      for (uint8_t i = 0; i < sizes[pick]; i++) {
+        taken[starts[pick] - FIRST + i] = false;
+      }
+      used -= sizes[pick];
+      starts[pick] = starts[--count];
+      sizes[pick] = sizes[count];
+    } else {
+      elements = (uint8_t)(1 + rand() % 6);
+      address = address_allocator_alloc(elements);
+      if (address == ADDRESS_ALLOCATOR_NONE) {
+        continue;
+      }
+      for (uint8_t i = 0; i < elements; i++) {
+        CHECK(address - FIRST + i < ADDRESS_ALLOCATOR_SIZE);
+        CHECK(!taken[address - FIRST + i]);
+        taken[address - FIRST + i] = true;
+      }
+      starts[count] = address;
+      sizes[count++] = elements;
+      used += elements;
+    }
+    if (step % 500 == 0) {
+      address_allocator_on_iv_index((uint32_t)step);
+    }
+    CHECK_EQ(address_allocator_get_used(), used);
+  }
+}
+
+int main(void) {
+  TEST_RUN(test_dense_ranges);
+  TEST_RUN(test_reserve);
+  TEST_RUN(test_released_ranges_go_last);
+  TEST_RUN(test_quarantine_used_when_full);
+  TEST_RUN(test_release_whole_range);
+  TEST_RUN(test_churn_against_model);
+  return TEST_RESULT();
+}
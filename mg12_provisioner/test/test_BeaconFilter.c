@@ -0,0 +1,95 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "mesh_uuid.h"
+#include "BeaconFilter.h"
+#include "test.h"
+
+static uint32_t uuid_counter;
+
+/*
+ * A device of the family, the bytes after the prefix are random like the
+ * ones the stack leaves
+ * */
+static uuid_128 __new_uuid(void) {
+  uuid_128 uuid;
+
+  for (uint8_t i = 0; i < sizeof(uuid.data); i++) {
+    uuid.data[i] = (uint8_t)rand();
+  }
+  mesh_uuid_write(&uuid, MESH_UUID_CLASS_LIGHT, MESH_UUID_CAP_RELAY, 1);
+  memcpy(&uuid.data[12], &uuid_counter, sizeof(uuid_counter));
+  uuid_counter++;
+  return uuid;
+}
+
+static void test_repeats_dropped(void) {
+  uuid_128 first = __new_uuid();
+  uuid_128 second = __new_uuid();
+
+  beacon_filter_init();
+  CHECK(!beacon_filter_seen(&first));
+  CHECK(beacon_filter_seen(&first));
+  CHECK(!beacon_filter_seen(&second));
+  CHECK(beacon_filter_seen(&second));
+  CHECK(beacon_filter_seen(&first));
+}
+
+static void test_let_through_again(void) {
+  uuid_128 uuid = __new_uuid();
+
+  beacon_filter_init();
+  beacon_filter_seen(&uuid);
+
+  // Still in the previous bucket after one period
+  test_advance_ms(BEACON_FILTER_BUCKET_MS - 1);
+  CHECK(beacon_filter_seen(&uuid));
+  test_advance_ms(1);
+  CHECK(beacon_filter_seen(&uuid));
+
+  // Not let through for two periods, handled again even though its repeats
+  // kept coming
+  test_advance_ms(BEACON_FILTER_BUCKET_MS);
+  CHECK(!beacon_filter_seen(&uuid));
+  CHECK(beacon_filter_seen(&uuid));
+
+  // A long silence clears both buckets
+  test_advance_ms(10 * BEACON_FILTER_BUCKET_MS);
+  CHECK(!beacon_filter_seen(&uuid));
+}
+
+/*
+ * New devices taken for repeats while both buckets hold
+ * BEACON_FILTER_EXPECTED_DEVICES UUIDs, stays below the 1% target
+ * */
+static void test_false_positive_rate(void) {
+  enum { ROUNDS = 40 };
+  uuid_128 uuid;
+  uint32_t false_positives = 0;
+  uint32_t lookups = 0;
+
+  srand(3);
+  beacon_filter_init();
+  for (int i = 0; i < BEACON_FILTER_EXPECTED_DEVICES; i++) {
+    uuid = __new_uuid();
+    beacon_filter_seen(&uuid);
+  }
+  for (int round = 0; round < ROUNDS; round++) {
+    test_advance_ms(BEACON_FILTER_BUCKET_MS);
+    for (int i = 0; i < BEACON_FILTER_EXPECTED_DEVICES; i++) {
+      uuid = __new_uuid();
+      false_positives += beacon_filter_seen(&uuid);
+      lookups++;
+    }
+  }
+  printf("  %u false positives in %u new devices\n", false_positives,
+         lookups);
+  CHECK(false_positives * 100 < lookups);
+}
+
+int main(void) {
+  TEST_RUN(test_repeats_dropped);
+  TEST_RUN(test_let_through_again);
+  TEST_RUN(test_false_positive_rate);
+  return TEST_RESULT();
+}
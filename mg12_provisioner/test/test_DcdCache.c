@@ -0,0 +1,121 @@
+#include <string.h>
+
+#include "DcdCache.h"
+#include "dcd_samples.h"
+#include "test.h"
+
+static uint16_t arena[64];
+static tsDcdComposition comp;
+static tsDcdParser parser;
+
+static uuid_128 __uuid(uint8_t device_class, uint8_t revision, uint8_t n) {
+  uuid_128 uuid;
+
+  memset(&uuid, 0, sizeof(uuid));
+  mesh_uuid_write(&uuid, device_class, MESH_UUID_CAP_RELAY, revision);
+  uuid.data[15] = n;
+  return uuid;
+}
+
+static void __decode(const uint8_t *dcd, uint8_t len) {
+  dcd_composition_init(&comp, arena, 64);
+  dcd_parser_init(&parser, &comp);
+  dcd_parser_feed(&parser, dcd, len);
+}
+
+static void test_find_by_uuid(void) {
+  uuid_128 light = __uuid(MESH_UUID_CLASS_LIGHT, 1, 1);
+  uuid_128 other_light = __uuid(MESH_UUID_CLASS_LIGHT, 1, 2);
+  uuid_128 new_light = __uuid(MESH_UUID_CLASS_LIGHT, 2, 3);
+  uuid_128 switch_uuid = __uuid(MESH_UUID_CLASS_SWITCH, 1, 4);
+  const tsDcdCacheEntry *cached;
+  uint32_t hash;
+
+  dcd_cache_init();
+  __decode(dcd_sample_light, sizeof(dcd_sample_light));
+  hash = dcd_composition_hash(&comp);
+  dcd_cache_store(&comp, &light);
+
+  cached = dcd_cache_find_by_uuid(&other_light);
+  CHECK(cached != NULL);
+  CHECK(cached != NULL && dcd_composition_hash(&cached->comp) == hash);
+  // Another firmware revision or another class is fetched
+  CHECK(dcd_cache_find_by_uuid(&new_light) == NULL);
+  CHECK(dcd_cache_find_by_uuid(&switch_uuid) == NULL);
+}
+
+static void test_same_header_other_product(void) {
+  uuid_128 light = __uuid(MESH_UUID_CLASS_LIGHT, 1, 1);
+  uuid_128 switch_uuid = __uuid(MESH_UUID_CLASS_SWITCH, 1, 2);
+  uuid_128 other_switch = __uuid(MESH_UUID_CLASS_SWITCH, 1, 3);
+  const tsDcdCacheEntry *cached;
+  uint32_t switch_hash;
+
+  dcd_cache_init();
+  __decode(dcd_sample_light, sizeof(dcd_sample_light));
+  dcd_cache_store(&comp, &light);
+
+  // Both report 02ff/0001/0500, the light's composition is not the switch's
+  __decode(dcd_sample_switch, 10);
+  CHECK(dcd_parser_header_done(&parser));
+  CHECK(dcd_cache_find_by_header(&comp, &switch_uuid) == NULL);
+
+  __decode(dcd_sample_switch, sizeof(dcd_sample_switch));
+  switch_hash = dcd_composition_hash(&comp);
+  dcd_cache_store(&comp, &switch_uuid);
+
+  __decode(dcd_sample_switch, 10);
+  cached = dcd_cache_find_by_header(&comp, &other_switch);
+  CHECK(cached != NULL);
+  CHECK(cached != NULL && dcd_composition_hash(&cached->comp) == switch_hash);
+  cached = dcd_cache_find_by_header(&comp, &light);
+  CHECK(cached != NULL && cached->comp.number_of_elements == 1);
+}
+
+static void test_old_firmware_never_cached(void) {
+  uuid_128 old_light = __uuid(MESH_UUID_CLASS_NODE, 0, 1);
+  uuid_128 old_switch = __uuid(MESH_UUID_CLASS_NODE, 0, 2);
+
+  // The older node firmware writes the same UUID prefix for every node type
+  dcd_cache_init();
+  __decode(dcd_sample_light, sizeof(dcd_sample_light));
+  dcd_cache_store(&comp, &old_light);
+  CHECK(dcd_cache_find_by_uuid(&old_switch) == NULL);
+  __decode(dcd_sample_switch, 10);
+  CHECK(dcd_cache_find_by_header(&comp, &old_switch) == NULL);
+}
+
+static void test_lru_and_nvm3(void) {
+  uuid_128 uuids[DCD_CACHE_SIZE + 1];
+
+  dcd_cache_init();
+  __decode(dcd_sample_light, sizeof(dcd_sample_light));
+  for (uint8_t i = 0; i <= DCD_CACHE_SIZE; i++) {
+    uuids[i] = __uuid(MESH_UUID_CLASS_LIGHT, i, i);
+    if (i == DCD_CACHE_SIZE) {
+      // Used again, the next oldest goes
+      CHECK(dcd_cache_find_by_uuid(&uuids[0]) != NULL);
+    }
+    dcd_cache_store(&comp, &uuids[i]);
+  }
+  CHECK(dcd_cache_find_by_uuid(&uuids[0]) != NULL);
+  CHECK(dcd_cache_find_by_uuid(&uuids[1]) == NULL);
+  CHECK(dcd_cache_find_by_uuid(&uuids[DCD_CACHE_SIZE]) != NULL);
+
+#if DCD_CACHE_USE_NVM3
+  // Loaded again after a reset, with an arena of its own
+  dcd_cache_init();
+  CHECK(dcd_cache_find_by_uuid(&uuids[0]) != NULL);
+  CHECK(dcd_cache_find_by_uuid(&uuids[0])->comp.arena ==
+        dcd_cache_find_by_uuid(&uuids[0])->words);
+  CHECK(dcd_cache_find_by_uuid(&uuids[1]) == NULL);
+#endif
+}
+
+int main(void) {
+  TEST_RUN(test_find_by_uuid);
+  TEST_RUN(test_same_header_other_product);
+  TEST_RUN(test_old_firmware_never_cached);
+  TEST_RUN(test_lru_and_nvm3);
+  return TEST_RESULT();
+}
@@ -0,0 +1,130 @@
+#include <string.h>
+
+#include "DcdParser.h"
+#include "dcd_samples.h"
+#include "test.h"
+
+static uint16_t arena[64];
+static tsDcdComposition comp;
+static tsDcdParser parser;
+
+static uint8_t __decode(const uint8_t *dcd, uint8_t len, uint8_t fragment,
+                        uint16_t capacity) {
+  uint8_t status = DCD_PARSER_OK;
+  uint8_t size;
+
+  dcd_composition_init(&comp, arena, capacity);
+  dcd_parser_init(&parser, &comp);
+  for (uint8_t i = 0; i < len && status == DCD_PARSER_OK; i += size) {
+    size = len - i < fragment ? len - i : fragment;
+    status = dcd_parser_feed(&parser, &dcd[i], size);
+  }
+  return status;
+}
+
+static void test_decode_light(void) {
+  tsDcdElementView view;
+  uint16_t next;
+
+  CHECK_EQ(__decode(dcd_sample_light, sizeof(dcd_sample_light), 255, 64),
+           DCD_PARSER_OK);
+  CHECK(dcd_parser_finish(&parser));
+  CHECK_EQ(comp.companyID, 0x02ff);
+  CHECK_EQ(comp.productID, 0x0001);
+  CHECK_EQ(comp.version, 0x0500);
+  CHECK_EQ(comp.featureBitmask, 0x0003);
+  CHECK_EQ(comp.number_of_elements, 1);
+  // 2 words of element header, 4 SIG models, 1 vendor model
+  CHECK_EQ(comp.used, 2 + 4 + 2);
+
+  next = dcd_composition_get_element(&comp, 0, &view);
+  CHECK_EQ(next, comp.used);
+  CHECK_EQ(view.numSIGModels, 4);
+  CHECK_EQ(view.numVendorModels, 1);
+  CHECK_EQ(view.SIG_models[2], 0x1000);
+  CHECK_EQ(view.SIG_models[3], 0x1300);
+  CHECK_EQ(view.vendor_models[0], 0x02ff);
+  CHECK_EQ(view.vendor_models[1], 0x0001);
+}
+
+static void test_fragments(void) {
+  uint32_t whole;
+
+  __decode(dcd_sample_switch, sizeof(dcd_sample_switch), 255, 64);
+  CHECK(dcd_parser_finish(&parser));
+  whole = dcd_composition_hash(&comp);
+
+  // Fields split across fragments of any size decode the same
+  for (uint8_t fragment = 1; fragment < 12; fragment++) {
+    CHECK_EQ(__decode(dcd_sample_switch, sizeof(dcd_sample_switch), fragment,
+                      64),
+             DCD_PARSER_OK);
+    CHECK(dcd_parser_finish(&parser));
+    CHECK_EQ(comp.number_of_elements, 2);
+    CHECK_EQ(dcd_composition_hash(&comp), whole);
+  }
+}
+
+static void test_header_done(void) {
+  dcd_composition_init(&comp, arena, 64);
+  dcd_parser_init(&parser, &comp);
+  dcd_parser_feed(&parser, dcd_sample_light, 9);
+  CHECK(!dcd_parser_header_done(&parser));
+  dcd_parser_feed(&parser, &dcd_sample_light[9], 1);
+  CHECK(dcd_parser_header_done(&parser));
+
+  // Skipped once the header is known, the rest is ignored
+  dcd_parser_skip(&parser);
+  CHECK_EQ(dcd_parser_feed(&parser, &dcd_sample_light[10], 4), DCD_PARSER_OK);
+  CHECK(dcd_parser_finish(&parser));
+  CHECK_EQ(comp.used, 0);
+}
+
+static void test_truncated(void) {
+  // Cut inside the models of the last element
+  __decode(dcd_sample_switch, sizeof(dcd_sample_switch) - 1, 255, 64);
+  CHECK(!dcd_parser_finish(&parser));
+  // Header only
+  __decode(dcd_sample_switch, 10, 255, 64);
+  CHECK(!dcd_parser_finish(&parser));
+}
+
+static void test_arena_full(void) {
+  CHECK_EQ(__decode(dcd_sample_light, sizeof(dcd_sample_light), 255, 7),
+           DCD_PARSER_ARENA_FULL);
+  CHECK_EQ(dcd_parser_feed(&parser, dcd_sample_light, 1), DCD_PARSER_ERROR);
+  CHECK_EQ(__decode(dcd_sample_light, sizeof(dcd_sample_light), 255, 8),
+           DCD_PARSER_OK);
+}
+
+static void test_copy_and_hash(void) {
+  uint16_t small[4];
+  uint16_t large[16];
+  tsDcdComposition copy;
+  uint32_t light;
+
+  __decode(dcd_sample_light, sizeof(dcd_sample_light), 255, 64);
+  light = dcd_composition_hash(&comp);
+
+  dcd_composition_init(&copy, small, 4);
+  CHECK(!dcd_composition_copy(&copy, &comp));
+  dcd_composition_init(&copy, large, 16);
+  CHECK(dcd_composition_copy(&copy, &comp));
+  CHECK(copy.arena == large);
+  CHECK_EQ(copy.capacity, 16);
+  CHECK_EQ(dcd_composition_hash(&copy), light);
+
+  // Same header, other models
+  __decode(dcd_sample_switch, sizeof(dcd_sample_switch), 255, 64);
+  CHECK(dcd_composition_hash(&comp) != light);
+}
+
+int main(void) {
+  TEST_RUN(test_decode_light);
+  TEST_RUN(test_fragments);
+  TEST_RUN(test_header_done);
+  TEST_RUN(test_truncated);
+  TEST_RUN(test_arena_full);
+  TEST_RUN(test_copy_and_hash);
+  return TEST_RESULT();
+}
@@ -0,0 +1,258 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "DeviceManager.h"
+#include "test.h"
+
+static uuid_128 __uuid(uint8_t device_class, uint16_t n) {
+  uuid_128 uuid;
+
+  memset(&uuid, 0, sizeof(uuid));
+  mesh_uuid_write(&uuid, device_class, 0, 1);
+  uuid.data[14] = (uint8_t)(n >> 8);
+  uuid.data[15] = (uint8_t)n;
+  return uuid;
+}
+
+static uuid_128 __foreign_uuid(uint16_t n) {
+  uuid_128 uuid;
+
+  memset(&uuid, 0, sizeof(uuid));
+  uuid.data[0] = 0x12;
+  uuid.data[14] = (uint8_t)(n >> 8);
+  uuid.data[15] = (uint8_t)n;
+  return uuid;
+}
+
+static bd_addr __addr(uint16_t n) {
+  bd_addr addr = {{(uint8_t)n, (uint8_t)(n >> 8), 0x5a, 0x11, 0x22, 0x33}};
+  return addr;
+}
+
+static uint8_t __count(void) {
+  uint8_t count;
+
+  device_manager_get_device_count(&count);
+  return count;
+}
+
+static bool __present(uint16_t n) {
+  bd_addr addr = __addr(n);
+  uint32_t first_seen;
+
+  return device_manager_get_first_seen(&addr, &first_seen) ==
+         DEVICE_MANAGER_SUCCESS;
+}
+
+static void test_add_find_remove(void) {
+  uuid_128 uuid = __uuid(MESH_UUID_CLASS_LIGHT, 1);
+  bd_addr addr = __addr(1);
+  bd_addr found;
+
+  device_manager_init();
+  CHECK_EQ(device_manager_add_device(&uuid, &addr, -60),
+           DEVICE_MANAGER_SUCCESS);
+  CHECK_EQ(__count(), 1);
+  CHECK_EQ(device_manager_find_by_uuid(&uuid, &found), DEVICE_MANAGER_SUCCESS);
+  CHECK(memcmp(&found, &addr, sizeof(addr)) == 0);
+
+  CHECK_EQ(device_manager_remove_device(&addr), DEVICE_MANAGER_SUCCESS);
+  CHECK_EQ(__count(), 0);
+  CHECK_EQ(device_manager_remove_device(&addr),
+           DEVICE_MANAGER_DEVICE_NOT_FOUND);
+  CHECK_EQ(device_manager_find_by_uuid(&uuid, &found),
+           DEVICE_MANAGER_DEVICE_NOT_FOUND);
+}
+
+static void test_same_device_new_address(void) {
+  uuid_128 uuid = __uuid(MESH_UUID_CLASS_SWITCH, 7);
+  bd_addr first = __addr(1);
+  bd_addr second = __addr(2);
+  bd_addr found;
+
+  device_manager_init();
+  device_manager_add_device(&uuid, &first, -70);
+  CHECK_EQ(device_manager_add_device(&uuid, &first, -70),
+           DEVICE_MANAGER_DEVICE_PRESENTED);
+
+  // A private address rotation keeps one entry, under the new address
+  CHECK_EQ(device_manager_add_device(&uuid, &second, -70),
+           DEVICE_MANAGER_DEVICE_PRESENTED);
+  CHECK_EQ(__count(), 1);
+  CHECK(!__present(1));
+  CHECK(__present(2));
+  device_manager_find_by_uuid(&uuid, &found);
+  CHECK(memcmp(&found, &second, sizeof(second)) == 0);
+}
+
+static void test_next_device_order(void) {
+  uuid_128 uuids[4] = {
+      __uuid(MESH_UUID_CLASS_SWITCH, 1), __uuid(MESH_UUID_CLASS_LIGHT, 2),
+      __uuid(MESH_UUID_CLASS_GATEWAY, 3), __foreign_uuid(4)};
+  bd_addr addrs[4] = {__addr(1), __addr(2), __addr(3), __addr(4)};
+  const device_class_t *device_class;
+  uuid_128 uuid;
+  bd_addr addr;
+
+  device_manager_init();
+  // The foreign device is the loudest, it is still never picked
+  device_manager_add_device(&uuids[3], &addrs[3], -20);
+  for (int i = 0; i < 3; i++) {
+    device_manager_add_device(&uuids[i], &addrs[i], -80);
+  }
+
+  // Gateway first, then the light that relays for the others
+  for (int i = 2; i >= 0; i--) {
+    CHECK_EQ(device_manager_get_next_device(&uuid, &addr, &device_class),
+             DEVICE_MANAGER_SUCCESS);
+    CHECK(memcmp(&uuid, &uuids[i], sizeof(uuid)) == 0);
+    device_manager_remove_device(&addr);
+  }
+  CHECK_EQ(device_manager_get_next_device(&uuid, &addr, &device_class),
+           DEVICE_MANAGER_DEVICE_NOT_FOUND);
+  CHECK_EQ(__count(), 1);
+}
+
+static void test_next_device_by_rssi_and_sightings(void) {
+  uuid_128 near = __uuid(MESH_UUID_CLASS_SWITCH, 1);
+  uuid_128 far = __uuid(MESH_UUID_CLASS_SWITCH, 2);
+  bd_addr near_addr = __addr(1);
+  bd_addr far_addr = __addr(2);
+  const device_class_t *device_class;
+  uuid_128 uuid;
+  bd_addr addr;
+
+  device_manager_init();
+  device_manager_add_device(&far, &far_addr, -90);
+  device_manager_add_device(&near, &near_addr, -50);
+  device_manager_get_next_device(&uuid, &addr, &device_class);
+  CHECK(memcmp(&uuid, &near, sizeof(uuid)) == 0);
+
+  // A device heard steadily overtakes one heard once
+  for (int i = 0; i < 10; i++) {
+    device_manager_add_device(&far, &far_addr, -60);
+  }
+  device_manager_get_next_device(&uuid, &addr, &device_class);
+  CHECK(memcmp(&uuid, &far, sizeof(uuid)) == 0);
+}
+
+static void test_aging(void) {
+  uuid_128 quiet = __uuid(MESH_UUID_CLASS_LIGHT, 1);
+  uuid_128 chatty = __uuid(MESH_UUID_CLASS_LIGHT, 2);
+  bd_addr quiet_addr = __addr(1);
+  bd_addr chatty_addr = __addr(2);
+
+  device_manager_init();
+  test_advance_ms(DEVICE_MANAGER_AGING_TICK_MS);
+  CHECK_EQ(test_signals, 0);
+
+  device_manager_add_device(&quiet, &quiet_addr, -60);
+  device_manager_add_device(&chatty, &chatty_addr, -60);
+  test_advance_ms(DEVICE_MANAGER_AGING_TICK_MS);
+  CHECK_EQ(test_signals, DEVICE_MANAGER_AGING_SIGNAL);
+
+  for (int i = 0; i < DEVICE_MANAGER_LIFETIME - 1; i++) {
+    device_manager_on_aging_tick();
+    device_manager_add_device(&chatty, &chatty_addr, -60);
+  }
+  CHECK(__present(1));
+  device_manager_on_aging_tick();
+  CHECK(!__present(1));
+  CHECK(__present(2));
+  CHECK_EQ(__count(), 1);
+}
+
+static void test_evict_foreign_first(void) {
+  uuid_128 uuid;
+  bd_addr addr;
+
+  device_manager_init();
+  // Device 0 is the least recently seen, the foreign one the most recently
+  for (uint16_t n = 0; n < DEVICE_MANAGER_MAX_DEVICES - 1; n++) {
+    uuid = __uuid(MESH_UUID_CLASS_SWITCH, n);
+    addr = __addr(n);
+    device_manager_add_device(&uuid, &addr, -60);
+    if (n == 0) {
+      device_manager_on_aging_tick();
+    }
+  }
+  uuid = __foreign_uuid(1000);
+  addr = __addr(1000);
+  device_manager_add_device(&uuid, &addr, -60);
+  CHECK_EQ(__count(), DEVICE_MANAGER_MAX_DEVICES);
+
+  uuid = __uuid(MESH_UUID_CLASS_SWITCH, 2000);
+  addr = __addr(2000);
+  CHECK_EQ(device_manager_add_device(&uuid, &addr, -60),
+           DEVICE_MANAGER_SUCCESS);
+  CHECK(!__present(1000));
+  CHECK(__present(0));
+
+  // Only ours left, the least recently seen goes
+  uuid = __uuid(MESH_UUID_CLASS_SWITCH, 3000);
+  addr = __addr(3000);
+  CHECK_EQ(device_manager_add_device(&uuid, &addr, -60),
+           DEVICE_MANAGER_SUCCESS);
+  CHECK(!__present(0));
+  CHECK(__present(1));
+  CHECK(__present(2000));
+  CHECK_EQ(__count(), DEVICE_MANAGER_MAX_DEVICES);
+}
+
+/*
+ * Random churn checked against a plain array, covers the hash index removal
+ * with its back shifts and the heap updates
+ * */
+static void test_churn_against_model(void) {
+  enum { IDS = 3 * DEVICE_MANAGER_MAX_DEVICES / 2 };
+  bool model[IDS] = {false};
+  uint8_t model_count = 0;
+  const device_class_t *device_class;
+  uuid_128 uuid;
+  bd_addr addr;
+  uint16_t n;
+
+  srand(1);
+  device_manager_init();
+  for (int step = 0; step < 20000; step++) {
+    n = (uint16_t)(rand() % IDS);
+    addr = __addr(n);
+    if (rand() % 3 == 0) {
+      CHECK_EQ(device_manager_remove_device(&addr),
+               model[n] ? DEVICE_MANAGER_SUCCESS
+                        : DEVICE_MANAGER_DEVICE_NOT_FOUND);
+      model_count -= model[n];
+      model[n] = false;
+    } else if (model[n] || model_count < DEVICE_MANAGER_MAX_DEVICES) {
+      uuid = __uuid(MESH_UUID_CLASS_LIGHT + n % 4, n);
+      CHECK_EQ(device_manager_add_device(&uuid, &addr, (int8_t)-(rand() % 90)),
+               model[n] ? DEVICE_MANAGER_DEVICE_PRESENTED
+                        : DEVICE_MANAGER_SUCCESS);
+      model_count += !model[n];
+      model[n] = true;
+    }
+    CHECK_EQ(__count(), model_count);
+  }
+
+  for (n = 0; n < IDS; n++) {
+    CHECK_EQ(__present(n), model[n]);
+  }
+  // Everything present comes out of the queue exactly once
+  for (uint8_t i = 0; i < model_count; i++) {
+    CHECK_EQ(device_manager_get_next_device(&uuid, &addr, &device_class),
+             DEVICE_MANAGER_SUCCESS);
+    CHECK_EQ(device_manager_remove_device(&addr), DEVICE_MANAGER_SUCCESS);
+  }
+  CHECK_EQ(__count(), 0);
+}
+
+int main(void) {
+  TEST_RUN(test_add_find_remove);
+  TEST_RUN(test_same_device_new_address);
+  TEST_RUN(test_next_device_order);
+  TEST_RUN(test_next_device_by_rssi_and_sightings);
+  TEST_RUN(test_aging);
+  TEST_RUN(test_evict_foreign_first);
+  TEST_RUN(test_churn_against_model);
+  return TEST_RESULT();
+}
@@ -0,0 +1,196 @@
+#include <string.h>
+
+#include "KeyRefresh.h"
+#include "RetryEngine.h"
+#include "test.h"
+
+// Time the fake stack takes to update one node
+#define NODE_UPDATE_MS 50
+
+static uuid_128 __uuid(uint16_t n) {
+  uuid_128 uuid;
+
+  memset(&uuid, 0, sizeof(uuid));
+  uuid.data[0] = 0x4b;
+  uuid.data[14] = (uint8_t)(n >> 8);
+  uuid.data[15] = (uint8_t)n;
+  return uuid;
+}
+
+/*
+ * Move the clock and run the retry tick as app.c does
+ * */
+static void __advance(uint32_t ms) {
+  test_advance_ms(ms);
+  if (retry_engine_on_signal(test_signals)) {
+    test_signals = 0;
+    key_refresh_on_retry_tick();
+  }
+}
+
+static bool __suspended(void) {
+  return test_count_calls("suspend_key_refresh") >
+         test_count_calls("resume_key_refresh");
+}
+
+static void __ddb_list(uint16_t n) {
+  sl_btmesh_msg_t evt;
+
+  memset(&evt, 0, sizeof(evt));
+  evt.header = sl_btmesh_evt_prov_ddb_list_id;
+  evt.data.evt_prov_ddb_list.uuid = __uuid(n);
+  evt.data.evt_prov_ddb_list.address = 0x0100 + n;
+  evt.data.evt_prov_ddb_list.elements = 1;
+  key_refresh_on_btmesh_event(&evt);
+}
+
+static void __node_update(uint16_t n, uint8_t phase) {
+  sl_btmesh_msg_t evt;
+
+  memset(&evt, 0, sizeof(evt));
+  evt.header = sl_btmesh_evt_prov_key_refresh_node_update_id;
+  evt.data.evt_prov_key_refresh_node_update.phase = phase;
+  evt.data.evt_prov_key_refresh_node_update.uuid = __uuid(n);
+  key_refresh_on_btmesh_event(&evt);
+}
+
+static void __phase_update(uint8_t phase) {
+  sl_btmesh_msg_t evt;
+
+  memset(&evt, 0, sizeof(evt));
+  evt.header = sl_btmesh_evt_prov_key_refresh_phase_update_id;
+  evt.data.evt_prov_key_refresh_phase_update.phase = phase;
+  key_refresh_on_btmesh_event(&evt);
+}
+
+static void __complete(void) {
+  sl_btmesh_msg_t evt;
+
+  memset(&evt, 0, sizeof(evt));
+  evt.header = sl_btmesh_evt_prov_key_refresh_complete_id;
+  key_refresh_on_btmesh_event(&evt);
+  CHECK(!key_refresh_is_running());
+}
+
+static void __start(uint16_t nodes) {
+  retry_engine_init();
+  test_ddb_count = nodes;
+  CHECK_EQ(key_refresh_start(), KEY_REFRESH_SUCCESS);
+  CHECK(key_refresh_is_running());
+  for (uint16_t n = 0; n < nodes; n++) {
+    __ddb_list(n);
+  }
+}
+
+/*
+ * Fake stack: updates one node after the other while the rotation is not
+ * suspended, and checks that every pause falls on a batch boundary and lasts
+ * the whole gap
+ * */
+static void __run_phase(uint8_t phase, uint16_t nodes, uint16_t *pauses) {
+  uint64_t paused_at;
+  uint16_t done = 0;
+
+  while (done < nodes) {
+    if (__suspended()) {
+      CHECK_EQ(done % KEY_REFRESH_BATCH_SIZE, 0);
+      paused_at = test_now_ms();
+      while (__suspended()) {
+        __advance(100);
+      }
+      CHECK(test_now_ms() - paused_at >= KEY_REFRESH_BATCH_GAP_MS);
+      (*pauses)++;
+      continue;
+    }
+    __advance(NODE_UPDATE_MS);
+    __node_update(done++, phase);
+  }
+}
+
+static void test_paced_by_batch(void) {
+  uint16_t nodes = 200;
+  uint16_t batches =
+      (nodes + KEY_REFRESH_BATCH_SIZE - 1) / KEY_REFRESH_BATCH_SIZE;
+  uint16_t pauses = 0;
+
+  // Well past the device database of the target build
+  CHECK(nodes > SL_BTMESH_CONFIG_MAX_PROVISIONED_DEVICES);
+  CHECK(nodes <= KEY_REFRESH_MAX_NODES);
+  __start(nodes);
+
+  __run_phase(1, nodes, &pauses);
+  // A pause between two batches, none after the last one
+  CHECK_EQ(pauses, batches - 1);
+  CHECK(!__suspended());
+
+  // The next phase waits for the gap as well
+  __phase_update(2);
+  CHECK(__suspended());
+  pauses = 0;
+  while (__suspended()) {
+    __advance(100);
+  }
+  __run_phase(2, nodes, &pauses);
+  CHECK_EQ(pauses, batches - 1);
+
+  __phase_update(3);
+  __complete();
+  CHECK_EQ(test_count_calls("suspend_key_refresh"),
+           test_count_calls("resume_key_refresh") + 1);
+}
+
+static void test_complete_while_paused(void) {
+  __start(KEY_REFRESH_BATCH_SIZE * 2);
+  for (uint16_t n = 0; n < KEY_REFRESH_BATCH_SIZE; n++) {
+    __node_update(n, 1);
+  }
+  CHECK(__suspended());
+
+  // A failed rotation ends while paused, nothing is resumed afterwards
+  __complete();
+  __advance(KEY_REFRESH_BATCH_GAP_MS * 2);
+  CHECK_EQ(test_count_calls("resume_key_refresh"), 0);
+}
+
+static void test_resume_retried(void) {
+  __start(KEY_REFRESH_BATCH_SIZE * 2);
+  for (uint16_t n = 0; n < KEY_REFRESH_BATCH_SIZE; n++) {
+    __node_update(n, 1);
+  }
+  CHECK(__suspended());
+
+  test_btmesh_result = SL_STATUS_BUSY;
+  __advance(KEY_REFRESH_BATCH_GAP_MS);
+  CHECK_EQ(test_count_calls("resume_key_refresh"), 1);
+
+  test_btmesh_result = SL_STATUS_OK;
+  __advance(KEY_REFRESH_BATCH_GAP_MS);
+  CHECK_EQ(test_count_calls("resume_key_refresh"), 2);
+
+  // Resumed, the failed call does not count
+  for (uint16_t n = KEY_REFRESH_BATCH_SIZE; n < KEY_REFRESH_BATCH_SIZE * 2;
+       n++) {
+    __node_update(n, 1);
+  }
+  CHECK_EQ(test_count_calls("suspend_key_refresh"), 1);
+  __complete();
+}
+
+static void test_more_nodes_than_tracked(void) {
+  uint16_t nodes = KEY_REFRESH_MAX_NODES + 20;
+  uint16_t pauses = 0;
+
+  __start(nodes);
+  // The nodes past the table are not followed, the others still paced
+  __run_phase(1, nodes, &pauses);
+  CHECK_EQ(pauses, (KEY_REFRESH_MAX_NODES - 1) / KEY_REFRESH_BATCH_SIZE);
+  __complete();
+}
+
+int main(void) {
+  TEST_RUN(test_paced_by_batch);
+  TEST_RUN(test_complete_while_paused);
+  TEST_RUN(test_resume_retried);
+  TEST_RUN(test_more_nodes_than_tracked);
+  return TEST_RESULT();
+}
@@ -0,0 +1,151 @@
+#include <string.h>
+
+#include "NodeDatabase.h"
+#include "test.h"
+
+static tsNodeRecord __record(uint16_t address, uint8_t uuid_n) {
+  tsNodeRecord record;
+
+  memset(&record, 0, sizeof(record));
+  record.address = address;
+  record.uuid.data[15] = uuid_n;
+  record.number_of_elements = 1;
+  return record;
+}
+
+static unsigned __count(void) {
+  unsigned count = 0;
+
+  for (uint8_t i = 0; i < NODE_DB_MAX_NODES; i++) {
+    count += node_db_get(i) != NULL;
+  }
+  return count;
+}
+
+static void __flush(void) {
+  test_advance_ms(NODE_DB_FLUSH_DELAY_MS);
+  CHECK(test_signals & NODE_DB_FLUSH_SIGNAL);
+  node_db_on_signal(test_signals);
+  test_signals = 0;
+}
+
+static void test_store_and_find(void) {
+  tsNodeRecord record = __record(0x0010, 1);
+  const tsNodeRecord *found;
+
+  node_db_init();
+  CHECK_EQ(node_db_store(&record), NODE_DB_SUCCESS);
+  found = node_db_find_by_address(0x0010);
+  CHECK(found != NULL);
+  CHECK(found == node_db_find_by_uuid(&record.uuid));
+  CHECK_EQ(node_db_find_by_address(0x0011) == NULL, 1);
+
+  // Same node stored again, same record
+  record.pub_ttl = 5;
+  node_db_store(&record);
+  CHECK_EQ(__count(), 1);
+  CHECK_EQ(node_db_find_by_address(0x0010)->pub_ttl, 5);
+
+  CHECK_EQ(node_db_remove(&record.uuid), NODE_DB_SUCCESS);
+  CHECK_EQ(node_db_remove(&record.uuid), NODE_DB_NOT_FOUND);
+  CHECK_EQ(__count(), 0);
+}
+
+static void test_reprovisioned_node_clears_duplicates(void) {
+  tsNodeRecord first = __record(0x0010, 1);
+  tsNodeRecord second = __record(0x0020, 2);
+  tsNodeRecord moved;
+
+  node_db_init();
+  node_db_store(&first);
+  node_db_store(&second);
+
+  // Node 2 comes back at the address node 1 had: one record left, found
+  // both ways
+  moved = __record(0x0010, 2);
+  CHECK_EQ(node_db_store(&moved), NODE_DB_SUCCESS);
+  CHECK_EQ(__count(), 1);
+  CHECK(node_db_find_by_address(0x0020) == NULL);
+  CHECK(node_db_find_by_uuid(&first.uuid) == NULL);
+  CHECK(node_db_find_by_uuid(&moved.uuid) == node_db_find_by_address(0x0010));
+
+  // The other way around, the UUID match comes first
+  node_db_init();
+  node_db_store(&first);
+  node_db_store(&second);
+  moved = __record(0x0020, 1);
+  node_db_store(&moved);
+  CHECK_EQ(__count(), 1);
+  CHECK(node_db_find_by_address(0x0010) == NULL);
+  CHECK(node_db_find_by_uuid(&moved.uuid) == node_db_find_by_address(0x0020));
+}
+
+static void test_full(void) {
+  tsNodeRecord record;
+
+  node_db_init();
+  for (uint8_t i = 0; i < NODE_DB_MAX_NODES; i++) {
+    record = __record(0x0010 + i, i);
+    CHECK_EQ(node_db_store(&record), NODE_DB_SUCCESS);
+  }
+  record = __record(0x0100, 0xF0);
+  CHECK_EQ(node_db_store(&record), NODE_DB_FULL);
+  CHECK_EQ(__count(), NODE_DB_MAX_NODES);
+}
+
+static void test_persisted_across_boots(void) {
+  tsNodeRecord record = __record(0x0030, 3);
+  const tsNodeRecord *found;
+  uint16_t boot;
+
+  node_db_init();
+  node_db_store(&record);
+  node_db_set_hops(0x0030, 2);
+  __flush();
+  boot = node_db_find_by_address(0x0030)->last_seen_boot;
+
+  node_db_init();
+  found = node_db_find_by_address(0x0030);
+  CHECK(found != NULL);
+  CHECK_EQ(found->hops, 2);
+
+  // Touched in the new boot, the old record is removed from NVM3 on remove
+  node_db_touch(0x0030);
+  CHECK_EQ(found->last_seen_boot, boot + 1);
+  node_db_remove(&record.uuid);
+  __flush();
+  node_db_init();
+  CHECK_EQ(__count(), 0);
+}
+
+static void test_touch_resolution(void) {
+  tsNodeRecord record = __record(0x0040, 4);
+  uint32_t stored_s;
+
+  node_db_init();
+  node_db_store(&record);
+  stored_s = node_db_find_by_address(0x0040)->last_seen_s;
+  __flush();
+
+  // Not written again within the resolution
+  test_advance_ms(1000 * (NODE_DB_LAST_SEEN_RESOLUTION_S - 1) -
+                  NODE_DB_FLUSH_DELAY_MS);
+  node_db_touch(0x0040);
+  CHECK_EQ(node_db_find_by_address(0x0040)->last_seen_s, stored_s);
+  CHECK_EQ(test_signals, 0);
+
+  test_advance_ms(1000);
+  node_db_touch(0x0040);
+  CHECK_EQ(node_db_find_by_address(0x0040)->last_seen_s,
+           stored_s + NODE_DB_LAST_SEEN_RESOLUTION_S);
+  __flush();
+}
+
+int main(void) {
+  TEST_RUN(test_store_and_find);
+  TEST_RUN(test_reprovisioned_node_clears_duplicates);
+  TEST_RUN(test_full);
+  TEST_RUN(test_persisted_across_boots);
+  TEST_RUN(test_touch_resolution);
+  return TEST_RESULT();
+}
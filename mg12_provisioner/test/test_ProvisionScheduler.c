@@ -0,0 +1,359 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "AddressAllocator.h"
+#include "DeviceManager.h"
+#include "ProvisionScheduler.h"
+#include "RetryEngine.h"
+#include "StageLatency.h"
+#include "test.h"
+
+// Time the fake stack takes to provision a node, add its appkey and
+// configure it
+#define PROVISION_MS 3000
+#define APPKEY_MS 200
+#define CONFIG_MS 1500
+
+#define MAX_DEVICES 40
+
+/*
+ * Fake DeviceConfiguration: sessions stay open until __config_step, with
+ * DEVICE_CONFIG_MAX_SESSIONS of them at most
+ * */
+static uint16_t config_open[DEVICE_CONFIG_MAX_SESSIONS];
+static uint8_t config_count;
+static unsigned config_refused;
+static sl_status_t config_result;
+
+sl_status_t device_configuration_config_session(uint16_t target_device,
+                                                uint16_t target_group,
+                                                uint8_t device_type,
+                                                uuid_128 dev_uuid) {
+  (void)target_group;
+  (void)device_type;
+  (void)dev_uuid;
+
+  if (config_result != SL_STATUS_OK) {
+    return config_result;
+  }
+  if (config_count == DEVICE_CONFIG_MAX_SESSIONS) {
+    config_refused++;
+    return SL_STATUS_NO_MORE_RESOURCE;
+  }
+  config_open[config_count++] = target_device;
+  return SL_STATUS_OK;
+}
+
+uint8_t device_configuration_get_active_count(void) {
+  return config_count;
+}
+
+uint16_t device_configuration_get_session_size(void) {
+  return 1700;
+}
+
+uint16_t device_configuration_get_arena_peak(void) {
+  return 900;
+}
+
+void status_indicator_on_provisioning(void) {}
+
+void status_indicator_on_failed(void) {}
+
+uint32_t config_plan_get_hash(void) {
+  return 0;
+}
+
+const tsNodeRecord *node_db_get(uint8_t index) {
+  (void)index;
+  return NULL;
+}
+
+uint8_t node_db_remove(const uuid_128 *uuid) {
+  (void)uuid;
+  return 0;
+}
+
+void node_db_print(void) {}
+
+/*
+ * Fake stack, answers the calls of the scheduler in order
+ * */
+static unsigned answered;
+// Nodes whose appkey is refused, numbered from 1
+static bool appkey_refused[MAX_DEVICES + 1];
+
+static uuid_128 __uuid(uint16_t n) {
+  uuid_128 uuid;
+
+  memset(&uuid, 0, sizeof(uuid));
+  mesh_uuid_write(&uuid, MESH_UUID_CLASS_LIGHT, 0, 1);
+  uuid.data[14] = (uint8_t)(n >> 8);
+  uuid.data[15] = (uint8_t)n;
+  return uuid;
+}
+
+static void __add_device(uint16_t n) {
+  uuid_128 uuid = __uuid(n);
+  bd_addr addr = {{(uint8_t)n, (uint8_t)(n >> 8), 0x5a, 0x11, 0x22, 0x33}};
+
+  CHECK_EQ(device_manager_add_device(&uuid, &addr, -50),
+           DEVICE_MANAGER_SUCCESS);
+}
+
+static void __advance(uint32_t ms) {
+  test_advance_ms(ms);
+  if (retry_engine_on_signal(test_signals)) {
+    test_signals = 0;
+    provision_scheduler_on_retry_tick();
+  }
+}
+
+static void __event(sl_btmesh_msg_t *evt, uint32_t id) {
+  evt->header = id;
+  provision_scheduler_on_btmesh_event(evt);
+}
+
+/*
+ * Last address the scheduler gave to node n
+ * */
+static const test_call_t *__address_of(uint16_t n) {
+  for (unsigned i = test_call_count; i > 0; i--) {
+    if (strcmp(test_calls[i - 1].name, "set_device_address") == 0 &&
+        test_calls[i - 1].args[0] == n) {
+      return &test_calls[i - 1];
+    }
+  }
+  return NULL;
+}
+
+/*
+ * Node holding the primary address
+ * */
+static uint16_t __node_at(uint32_t address) {
+  for (unsigned i = test_call_count; i > 0; i--) {
+    if (strcmp(test_calls[i - 1].name, "set_device_address") == 0 &&
+        test_calls[i - 1].args[1] == address) {
+      return (uint16_t)test_calls[i - 1].args[0];
+    }
+  }
+  return 0;
+}
+
+static void __answer(const test_call_t *call) {
+  sl_btmesh_msg_t evt;
+  uint16_t n = (uint16_t)call->args[0];
+  const test_call_t *address;
+
+  memset(&evt, 0, sizeof(evt));
+  if (strcmp(call->name, "provision_adv_device") == 0) {
+    // Two elements each, the scheduler picks the address and goes on
+    evt.data.evt_prov_capabilities.uuid = __uuid(n);
+    evt.data.evt_prov_capabilities.elements = 2;
+    __event(&evt, sl_btmesh_evt_prov_capabilities_id);
+    memset(&evt, 0, sizeof(evt));
+    evt.data.evt_prov_provisioning_suspended.uuid = __uuid(n);
+    __event(&evt, sl_btmesh_evt_prov_provisioning_suspended_id);
+  } else if (strcmp(call->name, "continue_provisioning") == 0) {
+    __advance(PROVISION_MS);
+    address = __address_of(n);
+    CHECK(address != NULL);
+    evt.data.evt_prov_device_provisioned.uuid = __uuid(n);
+    if (address != NULL) {
+      evt.data.evt_prov_device_provisioned.address =
+          (uint16_t)address->args[1];
+    }
+    __event(&evt, sl_btmesh_evt_prov_device_provisioned_id);
+  } else if (strcmp(call->name, "add_appkey") == 0) {
+    __advance(APPKEY_MS);
+    evt.data.evt_config_client_appkey_status.handle = call->handle;
+    evt.data.evt_config_client_appkey_status.result =
+        appkey_refused[__node_at(call->args[0])] ? 0x0001 : SL_STATUS_OK;
+    __event(&evt, sl_btmesh_evt_config_client_appkey_status_id);
+  }
+}
+
+/*
+ * Finish the oldest configuration
+ * */
+static bool __config_step(void) {
+  uint16_t address;
+
+  if (config_count == 0) {
+    return false;
+  }
+  __advance(CONFIG_MS);
+  address = config_open[0];
+  memmove(&config_open[0], &config_open[1],
+          --config_count * sizeof(config_open[0]));
+  provision_scheduler_on_config_done(address, true);
+  return true;
+}
+
+/*
+ * Run the fake stack until nothing is left to do
+ * */
+static void __run(void) {
+  bool busy = true;
+
+  for (unsigned step = 0; busy && step < 10000; step++) {
+    busy = false;
+    for (; answered < test_call_count; answered++) {
+      __answer(&test_calls[answered]);
+      busy = true;
+    }
+    busy |= __config_step();
+    if (!busy && provision_scheduler_get_active_count() > 0) {
+      // Waiting for an appkey retry
+      __advance(1000);
+      busy = true;
+    }
+  }
+  CHECK(!busy);
+}
+
+static void __reset(void) {
+  answered = 0;
+  config_count = 0;
+  config_refused = 0;
+  config_result = SL_STATUS_OK;
+  memset(appkey_refused, 0, sizeof(appkey_refused));
+  retry_engine_init();
+  stage_latency_init();
+  device_manager_init();
+  provision_scheduler_init();
+  provision_scheduler_setup_addresses(0x0001, 0);
+}
+
+static void test_commission_all(void) {
+  uint16_t addresses[MAX_DEVICES];
+  unsigned count = 0;
+
+  __reset();
+  for (uint16_t n = 1; n <= 20; n++) {
+    __add_device(n);
+  }
+
+  provision_scheduler_start(0xC001, true);
+  // The stack provisions a bounded number of devices at a time
+  CHECK_EQ(test_count_calls("provision_adv_device"),
+           PROV_SCHEDULER_MAX_PROVISIONING);
+  __run();
+
+  CHECK_EQ(test_count_calls("provision_adv_device"), 20);
+  CHECK_EQ(test_count_calls("delete_ddb_entry"), 0);
+  CHECK_EQ(provision_scheduler_get_active_count(), 0);
+  // The configurations queued behind the busy sessions
+  CHECK(config_refused > 0);
+
+  // Two addresses each, no range handed out twice
+  for (unsigned i = 0; i < test_call_count; i++) {
+    if (strcmp(test_calls[i].name, "set_device_address") == 0) {
+      addresses[count++] = (uint16_t)test_calls[i].args[1];
+    }
+  }
+  CHECK_EQ(count, 20);
+  for (unsigned i = 0; i < count; i++) {
+    for (unsigned j = i + 1; j < count; j++) {
+      CHECK(addresses[i] + 1 < addresses[j] || addresses[j] + 1 < addresses[i]);
+    }
+  }
+}
+
+static void test_stats(void) {
+  const char *line;
+  unsigned samples, min, p50, p90, max;
+  unsigned peak, configuring;
+
+  __reset();
+  for (uint16_t n = 1; n <= PROV_SCHEDULER_STATS_SAMPLES + 8; n++) {
+    __add_device(n);
+  }
+  appkey_refused[5] = true;
+  provision_scheduler_start(0xC001, true);
+  __run();
+
+  test_reset();
+  provision_scheduler_print_stats();
+  CHECK(strstr(test_log_text, "39 nodes configured, 1 failed") != NULL);
+
+  line = strstr(test_log_text, "time to configured of the last ");
+  CHECK(line != NULL);
+  if (line != NULL) {
+    CHECK_EQ(sscanf(line,
+                    "time to configured of the last %u: %u/%u/%u/%u ms",
+                    &samples, &min, &p50, &p90, &max),
+             5);
+    CHECK_EQ(samples, PROV_SCHEDULER_STATS_SAMPLES);
+    // At least the time of each step, longer when waiting for a session
+    CHECK(min >= PROVISION_MS + APPKEY_MS + CONFIG_MS);
+    CHECK(min <= p50);
+    CHECK(p50 <= p90);
+    CHECK(p90 <= max);
+    CHECK(min < max);
+  }
+
+  line = strstr(test_log_text, "  peak ");
+  CHECK(line != NULL);
+  if (line != NULL) {
+    CHECK_EQ(sscanf(line, "  peak %u sessions in flight, %u configuring",
+                    &peak, &configuring),
+             2);
+    CHECK(peak > PROV_SCHEDULER_MAX_PROVISIONING);
+    CHECK(peak <= PROV_SCHEDULER_MAX_SESSIONS);
+    CHECK_EQ(configuring, DEVICE_CONFIG_MAX_SESSIONS);
+  }
+}
+
+static void test_appkey_gives_up(void) {
+  __reset();
+  __add_device(3);
+  appkey_refused[3] = true;
+
+  provision_scheduler_start(0xC001, true);
+  __run();
+
+  CHECK_EQ(test_count_calls("add_appkey"), PROV_SCHEDULER_APPKEY_RETRIES + 1);
+  CHECK_EQ(test_count_calls("delete_ddb_entry"), 1);
+  CHECK_EQ(provision_scheduler_get_active_count(), 0);
+  // Its addresses wait in quarantine
+  CHECK_EQ(address_allocator_get_quarantined(), 2);
+}
+
+static void test_config_refused(void) {
+  __reset();
+  __add_device(7);
+  config_result = SL_STATUS_FAIL;
+
+  provision_scheduler_start(0xC001, true);
+  __run();
+
+  // Removed from the network like a node without its appkey
+  CHECK_EQ(test_count_calls("delete_ddb_entry"), 1);
+  CHECK_EQ(provision_scheduler_get_active_count(), 0);
+}
+
+static void test_stats_skip_reconfigured(void) {
+  tsNodeRecord record;
+
+  __reset();
+  memset(&record, 0, sizeof(record));
+  record.uuid = __uuid(9);
+  record.address = 0x0040;
+  CHECK_EQ(provision_scheduler_reconfigure(&record), PROV_SCHEDULER_SUCCESS);
+  __run();
+
+  // Not provisioned in this boot, nothing to print
+  test_reset();
+  provision_scheduler_print_stats();
+  CHECK_EQ(strlen(test_log_text), 0);
+}
+
+int main(void) {
+  TEST_RUN(test_commission_all);
+  TEST_RUN(test_stats);
+  TEST_RUN(test_appkey_gives_up);
+  TEST_RUN(test_config_refused);
+  TEST_RUN(test_stats_skip_reconfigured);
+  return TEST_RESULT();
+}
@@ -0,0 +1,338 @@
+#include <string.h>
+
+#include "RelayPlanner.h"
+#include "RetryEngine.h"
+#include "test.h"
+
+// Nodes of the fake topology. The planner looks at every index of the map,
+// the root (the provisioner) is the one past them.
+#define MAX_NODES 48
+#define ROOT TOPOLOGY_MAX_NODES
+
+/*
+ * Fake topology map, RelayPlanner only reads it through the getters below
+ * */
+static uint8_t fake_count;
+static uint8_t fake_hops[ROOT + 1];
+static bool fake_links[ROOT + 1][ROOT + 1];
+// Relay state of each node, as set by the status events
+static bool fake_relay[MAX_NODES];
+static unsigned answered;
+
+uint8_t topology_get_count(void) {
+  return fake_count;
+}
+
+uint16_t topology_get_address(uint8_t index) {
+  return index < fake_count ? 0x0100 + index : 0;
+}
+
+uint8_t topology_get_hops(uint8_t index) {
+  return fake_hops[index];
+}
+
+bool topology_is_linked(uint8_t a, uint8_t b) {
+  return fake_links[a][b];
+}
+
+static void __link(uint8_t a, uint8_t b) {
+  fake_links[a][b] = true;
+  fake_links[b][a] = true;
+}
+
+/*
+ * Set the hops from the links to the root, as the heartbeats would. A node
+ * the root does not reach keeps TOPOLOGY_HOPS_UNKNOWN.
+ * */
+static void __measure_hops(void) {
+  uint8_t hops[ROOT + 1];
+  bool grown = true;
+
+  memset(hops, 0, sizeof(hops));
+  hops[ROOT] = 0;
+  for (uint8_t v = 0; v < fake_count; v++) {
+    hops[v] = fake_links[ROOT][v] ? 1 : 0;
+  }
+  while (grown) {
+    grown = false;
+    for (uint8_t v = 0; v < fake_count; v++) {
+      for (uint8_t u = 0; u < fake_count; u++) {
+        if (hops[v] == 0 && hops[u] != 0 && fake_links[u][v]) {
+          hops[v] = hops[u] + 1;
+          grown = true;
+        }
+      }
+    }
+  }
+  memcpy(fake_hops, hops, sizeof(fake_hops));
+}
+
+static void __reset(uint8_t count) {
+  fake_count = count;
+  memset(fake_hops, 0, sizeof(fake_hops));
+  memset(fake_links, 0, sizeof(fake_links));
+  for (uint8_t i = 0; i < MAX_NODES; i++) {
+    fake_relay[i] = true;
+  }
+  answered = 0;
+  test_call_count = 0;
+  retry_engine_init();
+  relay_planner_init();
+}
+
+static void __relay_status(const test_call_t *call, uint16_t result) {
+  sl_btmesh_msg_t evt;
+
+  memset(&evt, 0, sizeof(evt));
+  evt.header = sl_btmesh_evt_config_client_relay_status_id;
+  evt.data.evt_config_client_relay_status.result = result;
+  evt.data.evt_config_client_relay_status.handle = call->handle;
+  evt.data.evt_config_client_relay_status.relay = (uint8_t)call->args[1];
+  if (result == SL_STATUS_OK) {
+    fake_relay[call->args[0] - 0x0100] = call->args[1] != 0;
+  }
+  relay_planner_on_btmesh_event(&evt);
+}
+
+/*
+ * Answer every relay request, the ones sent from the answers as well
+ * */
+static void __answer_all(void) {
+  for (; answered < test_call_count; answered++) {
+    if (strcmp(test_calls[answered].name, "set_relay") == 0) {
+      __relay_status(&test_calls[answered], SL_STATUS_OK);
+    }
+  }
+}
+
+static bool __relays(uint8_t v) {
+  return v != ROOT && fake_relay[v];
+}
+
+static bool __covered(uint8_t v) {
+  if (__relays(v)) {
+    return true;
+  }
+  for (uint8_t u = 0; u < fake_count; u++) {
+    if (__relays(u) && fake_links[u][v]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * Every node and the root is a relay or next to one, and the relays are
+ * connected
+ * */
+static bool __is_connected_dominating_set(void) {
+  bool reached[MAX_NODES] = {false};
+  bool grown = true;
+  uint8_t first = ROOT;
+
+  if (!__covered(ROOT)) {
+    return false;
+  }
+  for (uint8_t v = 0; v < fake_count; v++) {
+    if (!__covered(v)) {
+      return false;
+    }
+    if (first == ROOT && __relays(v)) {
+      first = v;
+    }
+  }
+  if (first == ROOT) {
+    return false;
+  }
+
+  reached[first] = true;
+  while (grown) {
+    grown = false;
+    for (uint8_t v = 0; v < fake_count; v++) {
+      for (uint8_t u = 0; u < fake_count; u++) {
+        if (__relays(v) && !reached[v] && reached[u] && fake_links[u][v]) {
+          reached[v] = true;
+          grown = true;
+        }
+      }
+    }
+  }
+  for (uint8_t v = 0; v < fake_count; v++) {
+    if (__relays(v) && !reached[v]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void test_self_check(void) {
+  CHECK(relay_planner_self_check());
+}
+
+static void test_line(void) {
+  // root - 0 - 1 - 2 - 3, only the end of the line stops relaying
+  __reset(4);
+  __link(ROOT, 0);
+  for (uint8_t i = 0; i < 3; i++) {
+    __link(i, i + 1);
+  }
+  __measure_hops();
+
+  relay_planner_run();
+  CHECK_EQ(test_count_calls("set_relay"), 1);
+  CHECK_EQ(test_last_call("set_relay")->args[0], 0x0103);
+  CHECK_EQ(test_last_call("set_relay")->args[1], 0);
+  __answer_all();
+
+  // Nothing left to change
+  relay_planner_run();
+  CHECK_EQ(test_count_calls("set_relay"), 1);
+}
+
+static void test_window(void) {
+  // 0 next to the root and to every other node, only 0 relays
+  __reset(7);
+  __link(ROOT, 0);
+  for (uint8_t i = 1; i < 7; i++) {
+    __link(0, i);
+  }
+  __measure_hops();
+
+  relay_planner_run();
+  CHECK_EQ(test_count_calls("set_relay"), RELAY_PLANNER_WINDOW_SIZE);
+  __answer_all();
+  CHECK_EQ(test_count_calls("set_relay"), 6);
+  CHECK(fake_relay[0]);
+  for (uint8_t i = 1; i < 7; i++) {
+    CHECK(!fake_relay[i]);
+  }
+}
+
+static void test_refused_and_timed_out(void) {
+  const test_call_t *first;
+
+  __reset(4);
+  __link(ROOT, 0);
+  for (uint8_t i = 1; i < 4; i++) {
+    __link(0, i);
+  }
+  __measure_hops();
+
+  relay_planner_run();
+  CHECK_EQ(test_count_calls("set_relay"), 2);
+  first = &test_calls[0];
+  __relay_status(first, 0x0001);
+  // The third node goes out in the freed slot
+  CHECK_EQ(test_count_calls("set_relay"), 3);
+
+  // The second one never answers, it is cancelled and left for the next run
+  test_advance_ms(RETRY_ENGINE_REQUEST_TIMEOUT_MS);
+  if (retry_engine_on_signal(test_signals)) {
+    relay_planner_on_retry_tick();
+  }
+  CHECK_EQ(test_count_calls("cancel_request"), 2);
+
+  // The refused and the timed out nodes are sent again
+  answered = test_call_count;
+  relay_planner_run();
+  CHECK_EQ(test_count_calls("set_relay"), 5);
+  __answer_all();
+  for (uint8_t i = 1; i < 4; i++) {
+    CHECK(!fake_relay[i]);
+  }
+}
+
+static void test_not_connected(void) {
+  // 2 hears nobody, nothing is changed
+  __reset(3);
+  __link(ROOT, 0);
+  __link(0, 1);
+  __measure_hops();
+
+  relay_planner_run();
+  CHECK_EQ(test_count_calls("set_relay"), 0);
+}
+
+static void test_leaf_never_relays(void) {
+  // root - 0 - 1 - 2, 1 never sent a heartbeat: 2 can only be reached
+  // through it so the plan gives up
+  __reset(3);
+  __link(ROOT, 0);
+  __link(0, 1);
+  __link(1, 2);
+  __measure_hops();
+  fake_hops[1] = TOPOLOGY_HOPS_UNKNOWN;
+
+  relay_planner_run();
+  CHECK_EQ(test_count_calls("set_relay"), 0);
+
+  // Also next to 0, 2 is covered without 1 relaying
+  __link(0, 2);
+  relay_planner_run();
+  __answer_all();
+  CHECK(fake_relay[0]);
+  CHECK(!fake_relay[1]);
+  CHECK(!fake_relay[2]);
+}
+
+static void test_random_networks(void) {
+  uint32_t seed = 0x1234567;
+  // The root stands in the middle, after the nodes
+  uint8_t x[MAX_NODES + 1], y[MAX_NODES + 1];
+  int dx, dy;
+  unsigned relays = 0, nodes = 0;
+
+  for (int round = 0; round < 40; round++) {
+    __reset(MAX_NODES);
+    // Nodes spread on a 100 x 100 floor, in range under 30
+    for (uint8_t v = 0; v < MAX_NODES; v++) {
+      seed = seed * 1103515245u + 12345u;
+      x[v] = (uint8_t)((seed >> 16) % 100);
+      seed = seed * 1103515245u + 12345u;
+      y[v] = (uint8_t)((seed >> 16) % 100);
+    }
+    x[MAX_NODES] = 50;
+    y[MAX_NODES] = 50;
+    for (uint8_t v = 0; v <= MAX_NODES; v++) {
+      for (uint8_t u = v + 1; u <= MAX_NODES; u++) {
+        dx = x[v] - x[u];
+        dy = y[v] - y[u];
+        if (dx * dx + dy * dy < 30 * 30) {
+          __link(u == MAX_NODES ? ROOT : u, v);
+        }
+      }
+    }
+    __measure_hops();
+
+    relay_planner_run();
+    __answer_all();
+    if (test_count_calls("set_relay") == 0) {
+      // Not connected, left as it was
+      for (uint8_t v = 0; v < MAX_NODES; v++) {
+        CHECK(fake_relay[v]);
+      }
+      continue;
+    }
+    CHECK(__is_connected_dominating_set());
+    for (uint8_t v = 0; v < MAX_NODES; v++) {
+      relays += fake_relay[v];
+    }
+    nodes += MAX_NODES;
+  }
+  printf("  %u relays for %u nodes in the connected networks\n", relays,
+         nodes);
+  // Far fewer relays than nodes on such floors
+  CHECK(nodes > 0);
+  CHECK(relays * 2 < nodes);
+}
+
+int main(void) {
+  TEST_RUN(test_self_check);
+  TEST_RUN(test_line);
+  TEST_RUN(test_window);
+  TEST_RUN(test_refused_and_timed_out);
+  TEST_RUN(test_not_connected);
+  TEST_RUN(test_leaf_never_relays);
+  TEST_RUN(test_random_networks);
+  return TEST_RESULT();
+}
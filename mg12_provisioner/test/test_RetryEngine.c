@@ -0,0 +1,124 @@
+#include "RetryEngine.h"
+#include "test.h"
+
+static void test_is_due_wraps_around(void) {
+  CHECK(retry_engine_is_due(100, 100));
+  CHECK(retry_engine_is_due(100, 101));
+  CHECK(!retry_engine_is_due(100, 99));
+  CHECK(retry_engine_is_due(0xFFFFFFF0, 0x10));
+  CHECK(!retry_engine_is_due(0x10, 0xFFFFFFF0));
+}
+
+static void test_backoff_bounds(void) {
+  uint32_t backoff;
+  uint32_t expected;
+
+  retry_engine_init();
+  for (uint8_t attempt = 0; attempt < 40; attempt++) {
+    expected = attempt < 16 ? RETRY_ENGINE_BACKOFF_BASE_MS << attempt
+                            : RETRY_ENGINE_BACKOFF_MAX_MS;
+    if (expected > RETRY_ENGINE_BACKOFF_MAX_MS) {
+      expected = RETRY_ENGINE_BACKOFF_MAX_MS;
+    }
+    for (int i = 0; i < 50; i++) {
+      test_advance_ms(3);
+      backoff = retry_engine_backoff_ms(attempt);
+      CHECK(backoff >= expected / 2);
+      CHECK(backoff <= expected);
+    }
+  }
+}
+
+static void test_backoff_jitter(void) {
+  uint32_t first;
+  bool differ = false;
+
+  retry_engine_init();
+  first = retry_engine_backoff_ms(4);
+  for (int i = 0; i < 20 && !differ; i++) {
+    differ = retry_engine_backoff_ms(4) != first;
+  }
+  CHECK(differ);
+}
+
+static void test_budget(void) {
+  retry_engine_init();
+  for (int i = 0; i < RETRY_ENGINE_BUDGET; i++) {
+    CHECK(retry_engine_take_budget());
+  }
+  CHECK(!retry_engine_take_budget());
+
+  test_advance_ms(RETRY_ENGINE_BUDGET_REFILL_MS - 1);
+  CHECK(!retry_engine_take_budget());
+  test_advance_ms(1);
+  CHECK(retry_engine_take_budget());
+  CHECK(!retry_engine_take_budget());
+
+  // A long idle time refills up to the budget, not beyond
+  test_advance_ms(100 * RETRY_ENGINE_BUDGET_REFILL_MS);
+  for (int i = 0; i < RETRY_ENGINE_BUDGET; i++) {
+    CHECK(retry_engine_take_budget());
+  }
+  CHECK(!retry_engine_take_budget());
+}
+
+static void test_partial_refill(void) {
+  retry_engine_init();
+  for (int i = 0; i < RETRY_ENGINE_BUDGET; i++) {
+    retry_engine_take_budget();
+  }
+  test_advance_ms(3 * RETRY_ENGINE_BUDGET_REFILL_MS +
+                  RETRY_ENGINE_BUDGET_REFILL_MS / 2);
+  for (int i = 0; i < 3; i++) {
+    CHECK(retry_engine_take_budget());
+  }
+  CHECK(!retry_engine_take_budget());
+  // The half period left over is not lost
+  test_advance_ms(RETRY_ENGINE_BUDGET_REFILL_MS / 2);
+  CHECK(retry_engine_take_budget());
+}
+
+static void test_wake_at_keeps_earliest(void) {
+  uint32_t now;
+
+  retry_engine_init();
+  now = retry_engine_now_ms();
+  retry_engine_wake_at(now + 300);
+  retry_engine_wake_at(now + 100);
+  // A later deadline does not push the timer back
+  retry_engine_wake_at(now + 500);
+
+  test_advance_ms(99);
+  CHECK_EQ(test_signals, 0);
+  test_advance_ms(1);
+  CHECK_EQ(test_signals, RETRY_ENGINE_SIGNAL);
+  CHECK(retry_engine_on_signal(test_signals));
+  CHECK(!retry_engine_on_signal(0x80));
+
+  // Disarmed by the signal, a later deadline arms it again
+  test_signals = 0;
+  retry_engine_wake_at(now + 400);
+  test_advance_ms(300);
+  CHECK_EQ(test_signals, RETRY_ENGINE_SIGNAL);
+}
+
+static void test_wake_at_past_deadline(void) {
+  uint32_t now;
+
+  retry_engine_init();
+  now = retry_engine_now_ms();
+  retry_engine_wake_at(now - 50);
+  test_advance_ms(1);
+  CHECK_EQ(test_signals, RETRY_ENGINE_SIGNAL);
+}
+
+int main(void) {
+  TEST_RUN(test_is_due_wraps_around);
+  TEST_RUN(test_backoff_bounds);
+  TEST_RUN(test_backoff_jitter);
+  TEST_RUN(test_budget);
+  TEST_RUN(test_partial_refill);
+  TEST_RUN(test_wake_at_keeps_earliest);
+  TEST_RUN(test_wake_at_past_deadline);
+  return TEST_RESULT();
+}
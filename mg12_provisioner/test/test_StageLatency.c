@@ -0,0 +1,219 @@
+#include <string.h>
+
+#include "RetryEngine.h"
+#include "StageLatency.h"
+#include "test.h"
+
+// Offsets in the dump, see its format in StageLatency.h
+#define DUMP_HEADER_LEN 7
+#define DUMP_ROW_LEN (2 * STAGE_LATENCY_BUCKETS)
+#define DUMP_COUNTS (DUMP_HEADER_LEN + STAGE_LATENCY_STAGES * DUMP_ROW_LEN)
+#define DUMP_HISTORY (DUMP_COUNTS + 5)
+#define DUMP_RECORD_LEN (4 + 4 * STAGE_LATENCY_STAGES)
+
+static uuid_128 __uuid(uint16_t n) {
+  uuid_128 uuid;
+
+  memset(&uuid, 0, sizeof(uuid));
+  uuid.data[0] = 0x5c;
+  uuid.data[14] = (uint8_t)(n >> 8);
+  uuid.data[15] = (uint8_t)n;
+  return uuid;
+}
+
+static uint16_t __u16(size_t offset) {
+  return (uint16_t)(test_iostream[offset] | (test_iostream[offset + 1] << 8));
+}
+
+static uint32_t __u32(size_t offset) {
+  return __u16(offset) | ((uint32_t)__u16(offset + 2) << 16);
+}
+
+static uint16_t __count(uint8_t row, uint8_t bucket) {
+  return __u16(DUMP_HEADER_LEN + row * DUMP_ROW_LEN + 2 * bucket);
+}
+
+static size_t __record(uint8_t index) {
+  return DUMP_HISTORY + index * DUMP_RECORD_LEN;
+}
+
+/*
+ * Dump into test_iostream and check its length and checksum
+ * */
+static void __dump(uint8_t records) {
+  uint32_t hash = 2166136261u;
+  size_t len = __record(records);
+
+  test_iostream_len = 0;
+  stage_latency_dump();
+  CHECK_EQ(test_iostream_len, len + 4);
+  for (size_t i = 0; i < len; i++) {
+    hash = (hash ^ test_iostream[i]) * 16777619u;
+  }
+  CHECK_EQ(__u32(len), hash);
+}
+
+/*
+ * Commission device n: beacon seen before_ms before its provisioning starts,
+ * then one stage every step_ms
+ * */
+static void __commission(uint16_t n, uint32_t before_ms, uint32_t step_ms) {
+  uuid_128 uuid = __uuid(n);
+
+  stage_latency_begin(&uuid, retry_engine_now_ms() - before_ms);
+  for (uint8_t stage = STAGE_LATENCY_PROVISIONED;
+       stage < STAGE_LATENCY_STAGES; stage++) {
+    test_advance_ms(step_ms);
+    stage_latency_mark(&uuid, stage);
+  }
+  stage_latency_end(&uuid, 0x0100 + n, true);
+}
+
+static void test_dump_layout(void) {
+  size_t record;
+
+  stage_latency_init();
+  __commission(1, 1000, 100);
+  __dump(1);
+
+  CHECK_EQ(test_iostream[0], STAGE_LATENCY_DUMP_MAGIC_0);
+  CHECK_EQ(test_iostream[1], STAGE_LATENCY_DUMP_MAGIC_1);
+  CHECK_EQ(test_iostream[2], STAGE_LATENCY_DUMP_VERSION);
+  CHECK_EQ(test_iostream[3], STAGE_LATENCY_STAGES);
+  CHECK_EQ(test_iostream[4], STAGE_LATENCY_BUCKETS);
+  CHECK_EQ(__u16(5), STAGE_LATENCY_BUCKET_MIN_MS);
+
+  CHECK_EQ(__u16(DUMP_COUNTS), 1);
+  CHECK_EQ(__u16(DUMP_COUNTS + 2), 0);
+  CHECK_EQ(test_iostream[DUMP_COUNTS + 4], 1);
+
+  record = __record(0);
+  CHECK_EQ(__u16(record), 0x0101);
+  CHECK_EQ(__u16(record + 2), (1 << STAGE_LATENCY_STAGES) - 1);
+  CHECK_EQ(__u32(record + 4 + 4 * STAGE_LATENCY_BEACON_SEEN), 0);
+  CHECK_EQ(__u32(record + 4 + 4 * STAGE_LATENCY_PROV_START), 1000);
+  CHECK_EQ(__u32(record + 4 + 4 * STAGE_LATENCY_PROXY_HEARTBEAT_SET),
+           1000 + 100 * (STAGE_LATENCY_STAGES - 2));
+}
+
+static void test_buckets(void) {
+  // Each bucket twice as wide as the one before, the last one unbounded
+  const uint32_t steps[] = {0, 63, 64, 127, 128, 1000, 4000000};
+  const uint8_t buckets[] = {0, 0, 1, 1, 2, 4, STAGE_LATENCY_BUCKETS - 1};
+  const uint8_t count = sizeof(steps) / sizeof(steps[0]);
+  uuid_128 uuid;
+
+  stage_latency_init();
+  for (uint8_t i = 0; i < count; i++) {
+    uuid = __uuid(i);
+    stage_latency_begin(&uuid, retry_engine_now_ms());
+    test_advance_ms(steps[i]);
+    stage_latency_mark(&uuid, STAGE_LATENCY_PROVISIONED);
+    stage_latency_end(&uuid, 0x0100 + i, true);
+  }
+  __dump(count);
+
+  CHECK_EQ(__count(STAGE_LATENCY_PROVISIONED, 0), 2);
+  CHECK_EQ(__count(STAGE_LATENCY_PROVISIONED, 1), 2);
+  CHECK_EQ(__count(STAGE_LATENCY_PROVISIONED, 2), 1);
+  CHECK_EQ(__count(STAGE_LATENCY_PROVISIONED, 4), 1);
+  CHECK_EQ(__count(STAGE_LATENCY_PROVISIONED, STAGE_LATENCY_BUCKETS - 1), 1);
+  // The total matches the only stage timed
+  for (uint8_t i = 0; i < count; i++) {
+    CHECK(__count(0, buckets[i]) > 0);
+  }
+}
+
+static void test_parallel_stages(void) {
+  uuid_128 uuid = __uuid(1);
+
+  stage_latency_init();
+  stage_latency_begin(&uuid, retry_engine_now_ms());
+  test_advance_ms(100);
+  stage_latency_mark(&uuid, STAGE_LATENCY_DCD_RECEIVED);
+  // The publications are set before the bindings are done
+  test_advance_ms(100);
+  stage_latency_mark(&uuid, STAGE_LATENCY_PUB_DONE);
+  test_advance_ms(100);
+  stage_latency_mark(&uuid, STAGE_LATENCY_BIND_DONE);
+  // Only the first time counts
+  test_advance_ms(5000);
+  stage_latency_mark(&uuid, STAGE_LATENCY_BIND_DONE);
+  stage_latency_end(&uuid, 0x0101, true);
+  __dump(1);
+
+  // 200 ms from the DCD to the bindings, the publications done before them
+  CHECK_EQ(__count(STAGE_LATENCY_BIND_DONE, 2), 1);
+  CHECK_EQ(__count(STAGE_LATENCY_PUB_DONE, 0), 1);
+  // The total ends at the latest stage, 300 ms after the beacon
+  CHECK_EQ(__count(0, 3), 1);
+  // Stages never reached are not counted
+  CHECK_EQ(__count(STAGE_LATENCY_SUB_DONE, 0), 0);
+}
+
+static void test_failed_and_unfollowed(void) {
+  uuid_128 uuid = __uuid(1);
+  uuid_128 other = __uuid(2);
+
+  stage_latency_init();
+  stage_latency_begin(&uuid, retry_engine_now_ms());
+  stage_latency_end(&uuid, 0x0101, false);
+  // A node configured again was never begun
+  stage_latency_mark(&other, STAGE_LATENCY_DCD_RECEIVED);
+  stage_latency_end(&other, 0x0102, true);
+  __dump(0);
+
+  CHECK_EQ(__u16(DUMP_COUNTS), 0);
+  CHECK_EQ(__u16(DUMP_COUNTS + 2), 1);
+  for (uint8_t row = 0; row < STAGE_LATENCY_STAGES; row++) {
+    for (uint8_t bucket = 0; bucket < STAGE_LATENCY_BUCKETS; bucket++) {
+      CHECK_EQ(__count(row, bucket), 0);
+    }
+  }
+}
+
+static void test_history_oldest_first(void) {
+  uint16_t devices = STAGE_LATENCY_HISTORY + 3;
+
+  stage_latency_init();
+  for (uint16_t n = 1; n <= devices; n++) {
+    __commission(n, 0, 10);
+  }
+  __dump(STAGE_LATENCY_HISTORY);
+
+  CHECK_EQ(__u16(DUMP_COUNTS), devices);
+  CHECK_EQ(test_iostream[DUMP_COUNTS + 4], STAGE_LATENCY_HISTORY);
+  for (uint8_t i = 0; i < STAGE_LATENCY_HISTORY; i++) {
+    CHECK_EQ(__u16(__record(i)), 0x0100 + devices - STAGE_LATENCY_HISTORY +
+                                     1 + i);
+  }
+}
+
+static void test_traces_full(void) {
+  uuid_128 uuid;
+
+  stage_latency_init();
+  for (uint16_t n = 0; n <= STAGE_LATENCY_MAX_TRACES; n++) {
+    uuid = __uuid(n);
+    stage_latency_begin(&uuid, retry_engine_now_ms());
+  }
+  CHECK(strstr(test_log_text, "no trace left") != NULL);
+
+  // The one left out is not counted, the others are
+  for (uint16_t n = 0; n <= STAGE_LATENCY_MAX_TRACES; n++) {
+    uuid = __uuid(n);
+    stage_latency_end(&uuid, 0x0100 + n, false);
+  }
+  __dump(0);
+  CHECK_EQ(__u16(DUMP_COUNTS + 2), STAGE_LATENCY_MAX_TRACES);
+}
+
+int main(void) {
+  TEST_RUN(test_dump_layout);
+  TEST_RUN(test_buckets);
+  TEST_RUN(test_parallel_stages);
+  TEST_RUN(test_failed_and_unfollowed);
+  TEST_RUN(test_history_oldest_first);
+  TEST_RUN(test_traces_full);
+  return TEST_RESULT();
+}
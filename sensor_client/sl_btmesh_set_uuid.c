@@ -9,11 +9,14 @@
 #include "sl_bluetooth.h"
 #include "stdio.h"
 #include "sl_btmesh_api.h"
+#include "mesh_uuid.h"
 #include "app_log.h"
 
 /*******************************************************************************
  *******************************   DEFINES   ***********************************
  ******************************************************************************/
+// Firmware revision written in the device UUID
+#define UUID_FW_REVISION 1
 
 /*******************************************************************************
  *******************************   LOCAL VARIABLES   ***************************
@@ -45,10 +48,8 @@ void sl_btmesh_set_my_uuid(void)
     {
         // set uuid for device
         app_log("Success,sl_btmesh_node_get_uuid\n");
-        my_uuid_device.data[0] = 0x02;
-        my_uuid_device.data[1] = 0xFF;
-        my_uuid_device.data[2] = 0x00;
-        my_uuid_device.data[3] = 0x01;
+        mesh_uuid_write(&my_uuid_device, MESH_UUID_CLASS_SENSOR_CLIENT,
+                        MESH_UUID_CAP_FRIEND, UUID_FW_REVISION);
     }
     sc = sl_btmesh_node_set_uuid(my_uuid_device);
     if(sc != SL_STATUS_OK)